@@ -516,6 +516,60 @@ void layout_absolute(AppClient *client, cairo_t *cr, Container *container, const
     }
 }
 
+// What a VirtualList keeps on each container of its pool
+struct VirtualRow : UserData {
+    size_t index = 0;
+};
+
+static void paint_virtual_row(AppClient *client, cairo_t *cr, Container *row) {
+    auto list = (VirtualList *) row->parent;
+    auto index = virtual_row_index(row);
+    if (list->when_paint_row && index < list->row_count)
+        list->when_paint_row(client, cr, row, index);
+}
+
+// Lays the pool over the rows inside the scroll pane the list is in (all of them outside of one), the row at 'i' always
+// going to the same container while it stays in view, so what the mouse is over doesn't jump around as it scrolls
+void layout_virtual_list(AppClient *client, cairo_t *cr, VirtualList *list, const Bounds &bounds) {
+    Bounds window = list->real_bounds;
+    for (auto p = list->parent; p; p = p->parent) {
+        if (p->type == ::newscroll) {
+            window = p->real_bounds;
+            break;
+        }
+    }
+    
+    size_t first = 0;
+    size_t last = 0;
+    if (list->row_height > 0) {
+        double top = std::floor((window.y - bounds.y) / list->row_height);
+        double bottom = std::ceil((window.y + window.h - bounds.y) / list->row_height);
+        first = (size_t) std::min(std::max(top, 0.0), (double) list->row_count);
+        last = (size_t) std::min(std::max(bottom, 0.0), (double) list->row_count);
+        if (last < first)
+            last = first;
+    }
+    
+    while (list->children.size() < last - first) {
+        auto row = list->child(FILL_SPACE, list->row_height);
+        row->user_data = new VirtualRow;
+        row->when_paint = paint_virtual_row;
+        if (list->when_row_made)
+            list->when_row_made(client, row);
+    }
+    for (auto row: list->children)
+        row->exists = false;
+    
+    size_t pool = list->children.size();
+    for (size_t i = first; i < last; i++) {
+        auto row = list->children[i % pool];
+        ((VirtualRow *) row->user_data)->index = i;
+        row->exists = true;
+        row->wanted_bounds.h = list->row_height;
+        layout(client, cr, row, Bounds(bounds.x, bounds.y + i * list->row_height, bounds.w, list->row_height));
+    }
+}
+
 // Expected container children:
 // [required] right_box
 // [required] bottom_box
@@ -746,8 +800,8 @@ void layout(AppClient *client, cairo_t *cr, Container *container, const Bounds &
         s->content->exists = true;
         s->right->exists = true;
         s->bottom->exists = true;
-    } else if (container->children.empty()) {
-        return;
+    } else if (container->children.empty() && !(container->type & layout_type::virtual_list)) {
+        return; // (a virtual list makes its children while laying out)
     }
     if (!container->should_layout_children)
         return;
@@ -776,6 +830,8 @@ void layout(AppClient *client, cairo_t *cr, Container *container, const Bounds &
     
     } else if (container->type & layout_type::absolute) {
         layout_absolute(client, cr, container, container->children_bounds);
+    } else if (container->type & layout_type::virtual_list) {
+        layout_virtual_list(client, cr, (VirtualList *) container, container->children_bounds);
     }
     
     // TODO: this only covers the first layer and not all of them
@@ -970,6 +1026,24 @@ Container::child(int type, int wanted_width, int wanted_height) {
     return child_container;
 }
 
+VirtualList *
+make_virtual_list_as_child(Container *parent, double row_height,
+                           void (*when_paint_row)(AppClient *, cairo_t *, Container *, size_t)) {
+    auto list = new VirtualList(row_height, when_paint_row);
+    list->parent = parent;
+    parent->children.push_back(list);
+    return list;
+}
+
+void virtual_list_set_row_count(VirtualList *list, size_t row_count) {
+    list->row_count = row_count;
+    list->wanted_bounds.h = row_count * list->row_height;
+}
+
+size_t virtual_row_index(Container *row) {
+    return ((VirtualRow *) row->user_data)->index;
+}
+
 Container::Container(layout_type type, double wanted_width, double wanted_height) {
     this->type = type;
     wanted_bounds.w = wanted_width;
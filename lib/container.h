@@ -82,6 +82,8 @@ enum layout_type {
     editable_label = 1 << 13,
     
     absolute = 1 << 14,
+    
+    virtual_list = 1 << 15,
 };
 
 enum container_alignment {
@@ -1055,6 +1057,29 @@ struct ScrollContainer : public Container {
     }
 };
 
+// A column of row_count rows, all row_height tall, that only has containers for the rows that can be seen: each layout
+// lays a small pool of them over the rows the scroll pane it's in shows, handing them out again as it scrolls, so a
+// hundred thousand rows cost what thirty do. Its wanted height is all of the rows, so the scroll pane scrolls as if
+// they were there. Rows are told apart by their index (virtual_row_index), since the container showing one changes.
+struct VirtualList : public Container {
+    size_t row_count = 0;
+    double row_height = 0;
+    
+    // Paints the row at 'index' into the pool container that's showing it
+    void (*when_paint_row)(AppClient *client, cairo_t *cr, Container *row, size_t index) = nullptr;
+    
+    // Called once for every container the pool makes, to set what it does when clicked and so on
+    void (*when_row_made)(AppClient *client, Container *row) = nullptr;
+    
+    VirtualList(double row_height, void (*when_paint_row)(AppClient *, cairo_t *, Container *, size_t)) {
+        type = ::virtual_list;
+        wanted_bounds.w = FILL_SPACE;
+        wanted_bounds.h = 0;
+        this->row_height = row_height;
+        this->when_paint_row = when_paint_row;
+    }
+};
+
 struct EditableSelectableLabel : public Container {
     std::string font = "Segoe MDL2 Assets Mod";
     PangoWeight weight = PANGO_WEIGHT_NORMAL;
@@ -1105,4 +1130,14 @@ actual_true_width(Container *box);
 
 void clamp_scroll(ScrollContainer *scrollpane);
 
+VirtualList *
+make_virtual_list_as_child(Container *parent, double row_height,
+                           void (*when_paint_row)(AppClient *, cairo_t *, Container *, size_t));
+
+// Changes how many rows the list has (takes effect at the next layout)
+void virtual_list_set_row_count(VirtualList *list, size_t row_count);
+
+// Which row of its VirtualList one of the pool's containers is showing
+size_t virtual_row_index(Container *row);
+
 #endif
@@ -0,0 +1,181 @@
+
+#include "rt_log.h"
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <thread>
+#include <unistd.h>
+
+// Bounded multi-producer queue (Dmitry Vyukov's design), every slot is claimed with a single CAS
+// and handed to the consumer by bumping its sequence number.
+
+#define RT_LOG_SLOTS 1024 // must be a power of two
+#define RT_LOG_TEXT 232
+
+struct RtLogRecord {
+    std::atomic<uint64_t> sequence;
+    uint64_t time_ns;
+    RtLogLevel level;
+    char text[RT_LOG_TEXT];
+};
+
+static RtLogRecord records[RT_LOG_SLOTS];
+static std::atomic<uint64_t> enqueue_pos{0};
+static uint64_t dequeue_pos = 0; // only touched by the consumer (under write_mutex)
+static std::atomic<uint64_t> dropped{0};
+static std::atomic<bool> started{false};
+
+static std::mutex write_mutex;
+static std::string log_path;
+static FILE *log_file = nullptr;
+static long log_file_size = 0;
+static bool echo_to_stderr = false;
+static int64_t realtime_offset_ns = 0; // CLOCK_REALTIME - CLOCK_MONOTONIC at startup
+
+// Sequences are stored relative to the slot index, so the zero initialized ring is already valid before rt_log_start
+static uint64_t slot_sequence(uint64_t pos) {
+    uint64_t index = pos & (RT_LOG_SLOTS - 1);
+    return records[index].sequence.load(std::memory_order_acquire) + index;
+}
+
+static void set_slot_sequence(uint64_t pos, uint64_t sequence) {
+    uint64_t index = pos & (RT_LOG_SLOTS - 1);
+    records[index].sequence.store(sequence - index, std::memory_order_release);
+}
+
+static uint64_t monotonic_ns() {
+    timespec ts{};
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void rt_log(RtLogLevel level, const char *fmt, ...) {
+    uint64_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    RtLogRecord *record;
+    while (true) {
+        record = &records[pos & (RT_LOG_SLOTS - 1)];
+        uint64_t seq = slot_sequence(pos);
+        int64_t diff = (int64_t) seq - (int64_t) pos;
+        if (diff == 0) {
+            if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                break;
+        } else if (diff < 0) { // Full
+            dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+    }
+    
+    record->time_ns = monotonic_ns();
+    record->level = level;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(record->text, RT_LOG_TEXT, fmt, args);
+    va_end(args);
+    
+    set_slot_sequence(pos, pos + 1);
+}
+
+static void rotate_if_needed() {
+    if (!log_file || log_file_size < 1024 * 1024)
+        return;
+    fclose(log_file);
+    std::string old = log_path + ".1";
+    rename(log_path.c_str(), old.c_str());
+    log_file = fopen(log_path.c_str(), "a");
+    log_file_size = 0;
+}
+
+static void write_line(const char *line, int length) {
+    if (echo_to_stderr)
+        fwrite(line, 1, length, stderr);
+    if (log_file) {
+        fwrite(line, 1, length, log_file);
+        log_file_size += length;
+        rotate_if_needed();
+    }
+}
+
+static void format_time(uint64_t time_ns, char *buffer, size_t size) {
+    int64_t real_ns = (int64_t) time_ns + realtime_offset_ns;
+    time_t seconds = real_ns / 1000000000ll;
+    long micros = (real_ns % 1000000000ll) / 1000;
+    tm local{};
+    localtime_r(&seconds, &local);
+    size_t n = strftime(buffer, size, "%Y-%m-%d %H:%M:%S", &local);
+    snprintf(buffer + n, size - n, ".%06ld", micros);
+}
+
+void rt_log_flush() {
+    static const char *level_names[] = {"debug", "info", "warning", "error"};
+    std::lock_guard<std::mutex> guard(write_mutex);
+    
+    bool wrote = false;
+    while (true) {
+        RtLogRecord *record = &records[dequeue_pos & (RT_LOG_SLOTS - 1)];
+        uint64_t seq = slot_sequence(dequeue_pos);
+        if ((int64_t) seq - (int64_t) (dequeue_pos + 1) < 0)
+            break; // Nothing published in this slot yet
+        
+        char time[64];
+        format_time(record->time_ns, time, sizeof(time));
+        char line[RT_LOG_TEXT + 128];
+        int length = snprintf(line, sizeof(line), "%s [%s] %s\n", time, level_names[record->level], record->text);
+        if (length > (int) sizeof(line) - 1)
+            length = sizeof(line) - 1;
+        write_line(line, length);
+        wrote = true;
+        
+        set_slot_sequence(dequeue_pos, dequeue_pos + RT_LOG_SLOTS);
+        dequeue_pos++;
+    }
+    
+    uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+    if (lost) {
+        char time[64];
+        format_time(monotonic_ns(), time, sizeof(time));
+        char line[128];
+        int length = snprintf(line, sizeof(line), "%s [warning] log ring was full, dropped %llu records\n", time,
+                              (unsigned long long) lost);
+        write_line(line, length);
+        wrote = true;
+    }
+    
+    if (wrote && log_file)
+        fflush(log_file);
+}
+
+void rt_log_start(const std::string &file_path) {
+    bool expected = false;
+    if (!started.compare_exchange_strong(expected, true))
+        return;
+    
+    timespec real{};
+    clock_gettime(CLOCK_REALTIME, &real);
+    realtime_offset_ns = ((int64_t) real.tv_sec * 1000000000ll + real.tv_nsec) - (int64_t) monotonic_ns();
+    
+    echo_to_stderr = file_path.empty() || isatty(STDERR_FILENO);
+    if (!file_path.empty()) {
+        log_path = file_path;
+        log_file = fopen(log_path.c_str(), "a");
+        if (log_file) {
+            fseek(log_file, 0, SEEK_END);
+            log_file_size = ftell(log_file);
+        } else {
+            echo_to_stderr = true;
+        }
+    }
+    
+    std::thread t([]() {
+        while (true) {
+            rt_log_flush();
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+    });
+    t.detach();
+}
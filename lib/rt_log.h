@@ -0,0 +1,27 @@
+/* date = October 19th 2026 11:05 am */
+
+#ifndef RT_LOG_H
+#define RT_LOG_H
+
+#include <string>
+
+enum RtLogLevel {
+    RT_DEBUG,
+    RT_INFO,
+    RT_WARNING,
+    RT_ERROR,
+};
+
+// Starts the thread which formats queued records out to 'file_path' (rotated at 1MB into 'file_path'.1),
+// and also to stderr when that is a terminal. An empty path only writes to stderr.
+void rt_log_start(const std::string &file_path);
+
+// Safe to call from the audio callback: never locks, never allocates, never blocks on I/O.
+// The message is formatted into a fixed size record (truncated if too long), and dropped if the ring is full.
+// Stick to plain %d %s %f style conversions.
+void rt_log(RtLogLevel level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+// Writes out whatever is still queued
+void rt_log_flush();
+
+#endif //RT_LOG_H
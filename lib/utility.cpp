@@ -2,6 +2,7 @@
 #include "utility.h"
 #include "hsluv.h"
 #include "drawer.h"
+#include "rt_log.h"
 #include <stdio.h>
 #include <X11/Xlib.h>
 #include <string.h>
@@ -577,7 +578,18 @@ bool paint_jpg_to_surface(cairo_surface_t *surface, std::string path, int target
     if (!data) {
         return false;
     }
+    
+    paint_rgba_to_surface(surface, data, width, height, target_size);
+    stbi_image_free(data);
+    
+    return true;
+}
 
+void paint_rgba_to_surface(cairo_surface_t *surface, unsigned char *data, int width, int height, int target_size) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    
     // Cairo expects pixel data in ARGB32 format. We will create a surface from raw data.
     cairo_surface_t *image_surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
     unsigned char *dest = cairo_image_surface_get_data(image_surface);
@@ -603,7 +615,6 @@ bool paint_jpg_to_surface(cairo_surface_t *surface, std::string path, int target
     }
 
     cairo_surface_mark_dirty(image_surface);
-    stbi_image_free(data);
 
     cairo_t *cr = cairo_create(surface);
     cairo_save(cr);
@@ -622,8 +633,6 @@ bool paint_jpg_to_surface(cairo_surface_t *surface, std::string path, int target
 
     cairo_destroy(cr);
     cairo_surface_destroy(image_surface);
-
-    return true;
 }
 
 bool
@@ -984,14 +993,13 @@ static std::string get_extension_from_mime(const std::string& mime) {
     return (it != mimeToExt.end()) ? it->second : ".bin";
 }
 
-bool extract_album_art(const std::string& filePath, const std::string& outputBase) {
+bool extract_album_art_data(const std::string& filePath, std::string *data, std::string *mimeType) {
     TagLib::FileRef ref(filePath.c_str());
     if (!ref.file() || !ref.file()->isValid()) {
-        std::cerr << "Invalid or unsupported file: " << filePath << std::endl;
+        rt_log(RT_WARNING, "Couldn't read the album art of %s: invalid or unsupported file", filePath.c_str());
         return false;
     }
 
-    std::string extension = ".bin";
     TagLib::ByteVector imageData;
     std::string mime;
 
@@ -1062,12 +1070,23 @@ bool extract_album_art(const std::string& filePath, const std::string& outputBas
     }
     
 
-    if (imageData.isEmpty()) {
-        std::cerr << "No album art found in file: " << filePath << std::endl;
+    // Plenty of songs have none, which isn't worth a line in the log
+    if (imageData.isEmpty())
+        return false;
+
+    data->assign(imageData.data(), imageData.size());
+    if (mimeType)
+        *mimeType = mime;
+    return true;
+}
+
+bool extract_album_art(const std::string& filePath, const std::string& outputBase) {
+    std::string imageData;
+    std::string mime;
+    if (!extract_album_art_data(filePath, &imageData, &mime))
         return false;
-    }
 
-    extension = get_extension_from_mime(mime);
+    std::string extension = get_extension_from_mime(mime);
     std::string outputPath = outputBase + extension;
 
     std::ofstream outFile(outputPath, std::ios::binary);
@@ -317,6 +317,9 @@ lighten(ArgbColor color, double amount);
 
 void paint_surface_with_data(cairo_surface_t *surface, unsigned char *data, int width, int height);
 
+// data is RGBA, scaled so that width becomes target_size
+void paint_rgba_to_surface(cairo_surface_t *surface, unsigned char *data, int width, int height, int target_size);
+
 cairo_surface_t *
 accelerated_surface(App *app, AppClient *client_entity, int w, int h);
 
@@ -370,6 +373,9 @@ std::string seconds_to_mmss(int seconds);
 
 bool extract_album_art(const std::string& filePath, const std::string& outputBase);
 
+// Same as above but keeps the encoded image in memory instead of writing it out (false, quietly, if there is none)
+bool extract_album_art_data(const std::string& filePath, std::string *data, std::string *mimeType = nullptr);
+
 float clamp(float val, float min, float max);
 
 std::map<ArgbColor, float> mainColorsInImage(cairo_surface_t* surface);
@@ -15,11 +15,14 @@
 #include "utility.h"
 #include "player.h"
 #include "edit_info.h"
-#define FTS_FUZZY_MATCH_IMPLEMENTATION
-#include "fts_fuzzy_match.h"
+#include "playlist_tab.h"
+#include "library.h"
+#include "search.h"
+#include "search_worker.h"
+#include <unordered_set>
 
 struct AlbumSong : UserData {
-    Option data;
+    TrackId id;
     bool attempted = false;
     std::string time;
     double size = 10 * config->dpi;
@@ -39,6 +42,10 @@ struct AlbumsScrollRootData : UserData {
     int old_y = -1;
     int old_h = 0;
     cairo_surface_t *unknown_album_icon = nullptr;
+    
+    // What's typed in the filter box, and the albums with a song it found (by AlbumId)
+    std::string previous_filter;
+    std::vector<char> filtered;
     cairo_surface_t *volume_icon = nullptr;
     ArgbColor volume_color = ArgbColor(1, 0, 1, 0);
     
@@ -190,9 +197,9 @@ void paint_albums_root(AppClient *client, cairo_t *cr, Container *c) {
     draw_colored_rect(client, ArgbColor(.96, .96, .96, 1), c->real_bounds);
 }
 
-void right_click_album(AppClient *client, std::string full_path, std::string title) {    
+void right_click_album(AppClient *client, AlbumId album) {    
     struct SongRightClickData : UserData {
-        std::string full_path;
+        AlbumId album;
         std::string title;
         cairo_surface_t *surface;
         cairo_surface_t *volume_surface;
@@ -203,9 +210,11 @@ void right_click_album(AppClient *client, std::string full_path, std::string tit
         std::string text;
         cairo_surface_t *surface = nullptr;
         ArgbColor icon_color = ArgbColor(1.000, 0.306, 0.420, 1.0);
+        PlaylistId playlist = NO_PLAYLIST; // for the "Add to" ones, whose text could be anything
     };
+    auto menu_playlists = playlists_for_menu();
     int option_height = 32 * config->dpi;
-    int options = 4;
+    int options = 5 + menu_playlists.size();
     int option_width = 280 * config->dpi;
 
     Settings settings;
@@ -215,14 +224,14 @@ void right_click_album(AppClient *client, std::string full_path, std::string tit
     settings.x = client->bounds->x + client->mouse_initial_x;
     settings.y = client->bounds->y + client->mouse_initial_y;
     settings.w = option_width;
-    settings.h = option_height * options + 8 * config->dpi;
+    settings.h = option_height * options + 16 * config->dpi;
     settings.dialog = true;
     PopupSettings popup_settings;
     popup_settings.name = "right_click_song";
     auto popup = client->create_popup(popup_settings, settings);
     auto data = new SongRightClickData;
-    data->full_path = full_path;
-    data->title = title;
+    data->album = album;
+    data->title = pool_string(catalog_album(album).name);
     popup->user_data = data;
     popup->root->type = ::vbox;
     popup->root->when_paint = [](AppClient *client, cairo_t *, Container *c) {
@@ -231,11 +240,12 @@ void right_click_album(AppClient *client, std::string full_path, std::string tit
         draw_round_rect(client, ArgbColor(.7, .7, .7, 1), c->real_bounds, 0, std::floor(1 * config->dpi));
     };    
     
-    auto add_option = [popup](std::string icon, std::string text) 
+    auto add_option = [popup](std::string icon, std::string text, PlaylistId playlist = NO_PLAYLIST) 
     { 
         auto data = new RightClickOption;
         data->icon = icon;
         data->text = text;
+        data->playlist = playlist;
         auto option = popup->root->child(FILL_SPACE, FILL_SPACE);
         load_icon_full_path(app, popup, &data->surface, asset(icon), 24 * config->dpi);
         dye_surface(data->surface, ArgbColor(.8, 0, 1, 1));
@@ -266,12 +276,16 @@ void right_click_album(AppClient *client, std::string full_path, std::string tit
         option->when_clicked = [](AppClient *client, cairo_t *, Container *c) {
             auto data = (RightClickOption *) c->user_data;
             auto client_data = (SongRightClickData *) client->user_data;
-            if (data->text == "Play Next") {
-                player->album_play_next(client_data->title);
+            if (data->playlist != NO_PLAYLIST) {
+                playlist_add(data->playlist, catalog_album(client_data->album).songs);
+            } else if (data->text == "New Playlist") {
+                new_playlist_with(catalog_album(client_data->album).songs);
+            } else if (data->text == "Play Next") {
+                player->album_play_next(client_data->album);
             } else if (data->text == "Play After All Next") {
-                player->album_play_after_all_next(client_data->title);
+                player->album_play_after_all_next(client_data->album);
             } else if (data->text == "Add to Queue") {
-                player->album_play_last(client_data->title);
+                player->album_play_last(client_data->album);
             } else if (data->text == "Edit Info") {
                 edit_info(EditType::ALBUM_TYPE, client_data->title);
             } else {
@@ -285,14 +299,20 @@ void right_click_album(AppClient *client, std::string full_path, std::string tit
     add_option("corner-up-right.svg", "Play Next");
     add_option("corner-down-right.svg", "Play After All Next");
     add_option("arrow-bar-to-down.svg", "Add to Queue");
-    auto seperator = popup->root->child(FILL_SPACE, 8 * config->dpi);
-    seperator->when_paint = [](AppClient *client, cairo_t *, Container *c) {
+    auto paint_seperator = [](AppClient *client, cairo_t *, Container *c) {
         draw_colored_rect(client, ArgbColor(.7, .7, .7, .4), 
                               Bounds(c->real_bounds.x + 20 * config->dpi,
                                      c->real_bounds.y + 4 * config->dpi,
                                      c->real_bounds.w - 40 * config->dpi, std::floor(1 * config->dpi)));
   
     };
+    auto seperator = popup->root->child(FILL_SPACE, 8 * config->dpi);
+    seperator->when_paint = paint_seperator;
+    add_option("", "New Playlist");
+    for (auto id : menu_playlists)
+        add_option("", "Add to " + playlist(id).name, id);
+    seperator = popup->root->child(FILL_SPACE, 8 * config->dpi);
+    seperator->when_paint = paint_seperator;
     add_option("", "Edit Info");
     //add_option("", "View Art");
     pad = popup->root->child(FILL_SPACE, 4 * config->dpi);
@@ -336,7 +356,7 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
     static int top_height = 94 * config->dpi;
     row->pre_layout = [](AppClient *client, Container *c, const Bounds &bounds) {     
         auto album_data = (AlbumData *) row_target_container(client, c)->user_data;
-        AlbumOption *al_option = &album_songs[album_data->option.album];
+        CatalogAlbum *al_option = &catalog_album(album_data->album);
         int wanted_h = 0;
         wanted_h += top_height + top_height * .6; // Top and bottom 'empty' pads
         
@@ -411,7 +431,7 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
         if (a_data->opening) {
             if (a_data->opening->user_data) {
                 auto data = (AlbumData *) a_data->opening->user_data;      
-                activate_coverlet(client, data->option.album);
+                activate_coverlet(client, data->album);
             }
         }
     };
@@ -432,15 +452,15 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
                                            c->real_bounds.w - size,
                                            c->real_bounds.h));
             
-            auto [f, w, h]  = draw_text_begin(client, 14 * config->dpi, config->font, EXPAND(color), album_data->option.album, true);
+            auto [f, w, h]  = draw_text_begin(client, 14 * config->dpi, config->font, EXPAND(color), pool_string(album_data->option.album), true);
             f->draw_text_end(c->real_bounds.x, c->real_bounds.y + offset - 4 * config->dpi);
             offset += h;
             draw_clip_end(client);
         }
         { // Artist year
-            std::string artist_year = album_data->option.artist;
-            if (!album_data->option.year.empty() && album_data->option.year != "0") {
-                artist_year += " (" + album_data->option.year + ")";
+            std::string artist_year = pool_string(album_data->option.artist);
+            if (album_data->option.year != 0) {
+                artist_year += " (" + std::to_string(album_data->option.year) + ")";
             }
             auto [f, w, h]  = draw_text_begin(client, 12 * config->dpi, config->font, EXPAND(album_data->second_color), artist_year);
             f->draw_text_end(c->real_bounds.x, c->real_bounds.y + offset);
@@ -452,7 +472,7 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
     auto queue_button = top->child(20 * config->dpi, 20 * config->dpi);
     top->pre_layout = [](AppClient *client, Container *c, const Bounds &bounds) {
         auto album_data = (AlbumData *) row_target_container(client, c)->user_data;
-        auto [f, w, h]  = draw_text_begin(client, 14 * config->dpi, config->font, 1, 1, 1, 1, album_data->option.album, true);
+        auto [f, w, h]  = draw_text_begin(client, 14 * config->dpi, config->font, 1, 1, 1, 1, pool_string(album_data->option.album), true);
         f->end();
         
         int init_off = w;
@@ -494,7 +514,7 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
     play_button->when_clicked = [](AppClient *client, cairo_t *cr, Container *c) {
         auto target = row_target_container(client, c);
         auto line_data = (AlbumData *) target->user_data;
-        player->album_play_next(line_data->text);
+        player->album_play_next(line_data->album);
         player->pop_queue();
         //close_album(client, target);
     };
@@ -547,11 +567,11 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
         
     };
     
-    AlbumOption *al_option = &album_songs[album_data->option.album];
-    for (Option track : al_option->songs) {
+    CatalogAlbum *al_option = &catalog_album(album_data->album);
+    for (auto id : al_option->songs) {
         auto t = songs_parent->child(FILL_SPACE, song_height_in_album * config->dpi);
         auto a = new AlbumSong;
-        a->data = track;
+        a->id = id;
         t->user_data = a;
         t->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
             auto album_data = (AlbumData *) row_target_container(client, c)->user_data;
@@ -559,7 +579,8 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
             
             int x_off = 16 * config->dpi;
             
-            bool playing = a->data.full == player->path;
+            auto &track = catalog_track(a->id);
+            bool playing = pool_view(track.path) == player->path;
             bool bold = c->state.mouse_hovering || playing;
             bool hovered = false;
             if (client->previous_x != -1 && client->mouse_current_x > 0) {
@@ -612,8 +633,8 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
             
             { // Track Number
                 int ww = 0;
-                if (a->data.track != "0") {
-                    auto [f, w, h]  = draw_text_begin(client, size, config->font, EXPAND(album_data->second_color), a->data.track, bold, italic);
+                if (track.track != 0) {
+                    auto [f, w, h]  = draw_text_begin(client, size, config->font, EXPAND(album_data->second_color), std::to_string(track.track), bold, italic);
                     f->draw_text_end(c->real_bounds.x + x_off - w, c->real_bounds.y + c->real_bounds.h * .5 - h * .5);
                     x_off += w + 16 * config->dpi;
                     ww = w;
@@ -644,11 +665,7 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
             { // Time
                 if (!a->attempted) {
                     a->attempted = true;
-                    try {
-                        a->time = seconds_to_mmss(std::atoi(a->data.length.c_str()));
-                    } catch (...) {
-                        
-                    }
+                    a->time = seconds_to_mmss(track.length);
                 }
                 if (a->attempted) {
                     auto [f, w, h]  = draw_text_begin(client, size, config->font, EXPAND(album_data->second_color), a->time, bold, italic);
@@ -663,7 +680,7 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
                                                c->real_bounds.y, 
                                                c->real_bounds.w - double_char_width - 14 * config->dpi,
                                                c->real_bounds.h));
-                auto [f, w, h]  = draw_text_begin(client, size, config->font, EXPAND(color), a->data.name, bold, italic);
+                auto [f, w, h]  = draw_text_begin(client, size, config->font, EXPAND(color), pool_string(track.title), bold, italic);
                 f->draw_text_end(c->real_bounds.x + double_char_width + 14 * config->dpi, c->real_bounds.y + c->real_bounds.h * .5 - h * .5);
                 x_off += w + 16 * config->dpi;
                 draw_clip_end(client);
@@ -675,7 +692,7 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
         t->when_clicked = [](AppClient *client, cairo_t *cr, Container *c) {
             auto a = (AlbumSong *) c->user_data;
             if (c->state.mouse_button_pressed == 3) {
-                right_click_song(client, a->data.full, a->data.name);
+                right_click_song(client, a->id);
                 return;
             }
             int from_index = 0;
@@ -685,9 +702,13 @@ static void make_row(AppClient *client, Container *row, Container *line, Contain
                     break;
                 }
             }
-            player->album_play_next(a->data.album, from_index);
+            player->album_play_next(catalog_album_of(a->id), from_index);
             player->pop_queue();
         };
+        t->when_mouse_enters_container = [](AppClient *client, cairo_t *cr, Container *c) {
+            auto a = (AlbumSong *) c->user_data;
+            player->warm(pool_string(catalog_track(a->id).path));
+        };
     }
     
     auto empty = right->child(FILL_SPACE, top_height * .6);
@@ -979,7 +1000,265 @@ void open_album(AppClient *client, Container *c) {
     request_refresh(app, client);
 }
 
-void fill_album_tab(AppClient *client, Container *albums_root, const std::vector<Option> &options) {
+struct PlayButton : SurfaceButton {
+    double scalar = 0.0;
+    double hovering = 0.0;
+};
+
+// Creates the tile for 'album' at the end of the albums content
+static Container *add_album(AppClient *client, ScrollContainer *albums_scroll_root, AlbumId album) {
+    auto line = albums_scroll_root->content->child(::absolute, 100 * config->dpi, 100 * config->dpi);
+    //auto line = new Container(::absolute, FILL_SPACE, FILL_SPACE);
+    auto play = line->child(56 * config->dpi, 56 * config->dpi);
+    play->name = "play";
+    auto play_data = new PlayButton;
+    load_icon_full_path(app, client, &play_data->surface, asset("play.png"), 48 * config->dpi);
+    if (play_data->surface) {
+        dye_surface(play_data->surface, ArgbColor(1, 1, 1, .9));
+    }
+    play->user_data = play_data;
+    static int top_offset = 24 * config->dpi;
+    play->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
+        auto album_data = (AlbumData *) c->parent->user_data;
+        Bounds picture_bounds = c->parent->real_bounds;
+        picture_bounds.w = album_target_width;
+        picture_bounds.h = album_target_width;
+        picture_bounds.x += (c->parent->real_bounds.w - picture_bounds.w) * .5;
+        picture_bounds.y += top_offset;
+        
+        auto data = (PlayButton *) c->user_data;
+        
+        bool animating_bounce = data->scalar != 1.0;
+        if (animating_bounce) {
+            animating_bounce = already_began(client, &data->scalar, 1.0);  
+        }
+        
+        bool other = data->surface && bounds_contains(picture_bounds, client->mouse_current_x, client->mouse_current_y) && c->parent->state.mouse_hovering || animating_bounce;
+        if (other || data->hovering != 0.0) {
+            if (other) {
+                if (!already_began(client, &data->hovering, 1.0)) {
+                    client_create_animation(client->app, client, &data->hovering, client->lifetime, 0, 100, nullptr, 1.0);
+                } 
+            } else {
+                if (!already_began(client, &data->hovering, 0.0)) {
+                    client_create_animation(client->app, client, &data->hovering, client->lifetime, 0, 250, nullptr, 0.0);
+                }
+            }
+            int width = cairo_image_surface_get_height(data->surface);
+            int height = cairo_image_surface_get_height(data->surface);
+       
+            cairo_save(cr);
+            //double bg_fade = fls[data->hover_scalar * (fls.size() - 1)];
+            float add = (0.2 * album_data->hover_scalar);
+            float scale = fls[data->scalar * (fls.size() - 1)] + add;
+            if (bounds_contains(c->real_bounds, client->mouse_current_x, client->mouse_current_y)) {
+                //scale *= 1.2;
+            }
+            width *= scale;
+            height *= scale;
+            cairo_scale(cr, scale, scale);
+            float shrink = 1.0 / scale;
+
+            cairo_set_source_surface(cr, data->surface, 
+                                         (c->real_bounds.x + c->real_bounds.w * .5 - width * .4) * shrink,
+                                         (c->real_bounds.y + c->real_bounds.h * .5 - height * .5) * shrink);
+            cairo_paint_with_alpha(cr, data->hovering); 
+            cairo_restore(cr);
+        }
+    };
+    play->when_clicked = [](AppClient *client, cairo_t *, Container *c) {
+        //c->parent->when_clicked(client, client->cr, c->parent);
+        //c->parent->when_clicked(client, client->cr, c->parent);
+        auto line_data = (AlbumData *) c->parent->user_data;
+        player->album_play_next(line_data->album);
+        player->pop_queue();
+        
+        open_album(client, c->parent);
+        
+        auto data = (PlayButton *) c->user_data;
+        data->scalar = 0.0;
+        client_create_animation(client->app, client, &data->scalar, client->lifetime, 0, (double) fls.size() * 12.6 , nullptr, 1.0);
+    };
+    line->pre_layout = [](AppClient *client, Container *c, const Bounds &b) {                
+        Bounds picture_bounds = c->real_bounds;
+        picture_bounds.w = album_target_width;
+        picture_bounds.h = album_target_width;
+        picture_bounds.x += (c->real_bounds.w - picture_bounds.w) * .5;
+        picture_bounds.y += top_offset;
+
+        auto play = c->children[0];
+        play->real_bounds.x = picture_bounds.x + picture_bounds.w * .5 - play->wanted_bounds.w * .5;
+        play->real_bounds.y = picture_bounds.y + picture_bounds.h * .5 - play->wanted_bounds.h * .5;
+        play->real_bounds.w = play->wanted_bounds.w;
+        play->real_bounds.h = play->wanted_bounds.h;
+    };
+    
+    auto albums = (AlbumsScrollRootData *) albums_scroll_root->user_data;
+    albums->containers.push_back(line);
+    
+    auto data = new AlbumData;
+    data->text = pool_string(catalog_album(album).name);
+    data->album = album;
+    data->option = catalog_track(catalog_album(album).songs[0]);
+    line->user_data = data;
+
+    line->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
+        auto data = (AlbumData *) c->user_data;
+        if (data->selected) {
+            if (!already_began(client, &data->hover_scalar, 1.0)) {
+                client_create_animation(client->app, client, &data->hover_scalar, client->lifetime, 0, 300, getEasingFunction(EaseInSine), 1.0);
+            } 
+        } else {
+            if (!already_began(client, &data->hover_scalar, 0.0)) {
+                client_create_animation(client->app, client, &data->hover_scalar, client->lifetime, 0, 300, nullptr, 0.0);
+            } 
+        }
+
+        Bounds picture_bounds = c->real_bounds;
+        picture_bounds.w = album_target_width;
+        picture_bounds.h = album_target_width;
+        picture_bounds.x += (c->real_bounds.w - picture_bounds.w) * .5;
+        picture_bounds.y += top_offset;
+
+        draw_colored_rect(client, ArgbColor(.96, .96, .96, 1), c->real_bounds);
+        int width = album_target_width;
+        if (data->surface) {
+            cairo_save(cr);
+            int width = cairo_image_surface_get_height(data->surface);
+            int height = cairo_image_surface_get_height(data->surface);
+            float scale_amount = 0.05 * data->hover_scalar;
+            float scale = 1.0 + scale_amount;
+            cairo_scale(client->cr, scale, scale);
+            float shrink = 1.0 / scale;
+            
+            float x = std::round(c->real_bounds.x + c->real_bounds.w * .5 - width * .5 - ((width * scale - width) * .5)) * shrink;
+            float y = std::round(c->real_bounds.y + top_offset - ((width * scale - width)) * .5) * shrink;
+            
+            {
+                auto a_data = (AlbumsScrollRootData *) container_by_name("albums_root", client->root)->user_data;
+                cairo_set_source_surface(cr, a_data->shadow_surface, x - shadow_size, y - shadow_size);
+                cairo_paint(cr);
+            }
+            
+            cairo_set_source_surface(cr, data->surface,x,y);
+            cairo_paint(cr);
+            
+            //draw_margins_rect(client, ArgbColor(.7, .7, .7, .4), Bounds(x, y, width, width), std::round(1 * config->dpi), 0);
+            
+            cairo_restore(cr);
+        } else {
+            draw_round_rect(client, ArgbColor(0.878, 0.898, 0.914, 1.0), picture_bounds, 3 * config->dpi);
+            draw_round_rect(client, ArgbColor(.6, .6, .6, .8), picture_bounds, 3 * config->dpi, std::floor(1 * config->dpi));
+            
+            auto a_data = (AlbumsScrollRootData *) container_by_name("albums_root", client->root)->user_data;
+            
+            if (a_data->unknown_album_icon) {
+                int width = cairo_image_surface_get_height(a_data->unknown_album_icon);
+                int height = cairo_image_surface_get_height(a_data->unknown_album_icon);
+                cairo_set_source_surface(cr, a_data->unknown_album_icon,
+                                         c->real_bounds.x + c->real_bounds.w * .5 - width * .5,
+                        //c->real_bounds.y + c->real_bounds.h * .5 - height * .5);
+                                         c->real_bounds.y + top_offset + album_target_width * .5 - height * .5);
+                cairo_paint(cr);
+            }
+        }
+        int over = c->real_bounds.w - width;
+        int offset = 0;
+        
+        if (data->surface) {
+            int width = cairo_image_surface_get_height(data->surface);
+            float scale_amount = 0.05 * data->hover_scalar;
+            float scale = 1.0 + scale_amount;
+            double off =  ((width * scale - width)) * .5;
+            draw_clip_begin(client, Bounds(c->real_bounds.x + over * .5 - off,
+                                                               c->real_bounds.y, album_target_width * scale, c->real_bounds.h));
+
+        } else {
+            draw_clip_begin(client, Bounds(c->real_bounds.x + over * .5,
+                                                               c->real_bounds.y, album_target_width, c->real_bounds.h));
+        }
+        
+        {
+            double off = 0;
+            float scale_amount = 0.05 * data->hover_scalar;
+            float scale = 1.0 + scale_amount;
+            if (data->surface) {
+                int width = cairo_image_surface_get_height(data->surface);
+                off =  ((width * scale - width)) * .5;
+            }
+
+            
+            ArgbColor color = ArgbColor(0, 0, 0, 1);
+            auto [f, w, h] = draw_text_begin(client, 11 * config->dpi, config->font, EXPAND(color), pool_string(data->option.album), true);
+            f->draw_text_end((c->real_bounds.x + over * .5 - off), (c->real_bounds.y + top_offset + 8 * config->dpi + album_target_width + off));
+            offset += h;
+        }
+        //if (!data->selected) {
+        {
+            double off = 0;
+            if (data->surface) {
+                int width = cairo_image_surface_get_height(data->surface);
+                float scale_amount = 0.05 * data->hover_scalar;
+                float scale = 1.0 + scale_amount;
+                off =  ((width * scale - width)) * .5;
+            }
+
+
+            auto [f, w, h] = draw_text_begin(client, 10 * config->dpi, config->font, EXPAND(ArgbColor(.3, .3, .3, 1.0 - data->hover_scalar)), pool_string(data->option.artist));
+            f->draw_text_end(c->real_bounds.x + over * .5 - off, c->real_bounds.y + top_offset + 8 * config->dpi + album_target_width + h + off);
+            offset += h;
+        }
+        //}
+        draw_clip_end(client);
+    };
+    
+    line->when_clicked = [](AppClient *client, cairo_t *, Container *c) {
+        if (auto play = container_by_name("play", c)) {
+            if (play->state.mouse_hovering) {
+                return;
+            }
+        }
+        if (c->state.mouse_button_pressed == 3) {
+            auto data = (AlbumData *) c->user_data;
+            right_click_album(client, data->album);
+            return;   
+        }
+        
+        auto album_root = (ScrollContainer *) container_by_name("albums_root", client->root);
+        auto a_data = (AlbumsScrollRootData *) album_root->user_data;
+        bool was = ((AlbumData *) c->user_data)->selected;
+        
+        if (!was) {
+            open_album(client, c);
+        } else {
+            close_album(client, c);
+        }
+       
+        return;
+    };
+    
+    return line;
+}
+
+static void albums_search_done(AppClient *client, const std::string &query, const std::vector<SearchHit> &hits,
+                               const SearchStats &) {
+    auto albums_root = container_by_name("albums_root", client->root);
+    if (!albums_root)
+        return;
+    auto a_data = (AlbumsScrollRootData *) albums_root->user_data;
+    if (query != a_data->previous_filter)
+        return;
+    a_data->filtered.assign(catalog_album_count(), false);
+    for (auto &hit: hits) {
+        AlbumId album = catalog_album_of(hit.id);
+        if (album != NO_ALBUM)
+            a_data->filtered[album] = true;
+    }
+    client_layout(app, client);
+    request_refresh(app, client);
+}
+
+void fill_album_tab(AppClient *client, Container *albums_root) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
@@ -1040,19 +1319,15 @@ void fill_album_tab(AppClient *client, Container *albums_root, const std::vector
         for (auto c: data->containers) {
             auto data = (AlbumData *) c->user_data;
             if (!data->surface && !data->attempted) {
-                for (auto art : cached_art) {
-                    if (art->name == sanitize_file_name(data->text)) {
-                        if (have_time) {
-                            data->surface = accelerated_surface(app, client, art->width, art->height);
-                            paint_surface_with_data(data->surface, art->data, art->width, art->height);
-                            
-                            data->large_album_art = accelerated_surface(app, client, art->width * 2, art->height * 2);
-                            paint_surface_with_data(data->large_album_art, art->large_data, art->width * 2, art->height * 2);
-                            fade_out_edges_2(data->large_album_art, 16 * config->dpi);
-                            //data->surface = blur_surface_edges_only(data->surface, 8.0 * config->dpi);
-                            break;
-                        }
-                    }
+                auto art = album_art(data->album);
+                if (art && have_time) {
+                    data->surface = accelerated_surface(app, client, art->width, art->height);
+                    paint_surface_with_data(data->surface, art->data, art->width, art->height);
+                    
+                    data->large_album_art = accelerated_surface(app, client, art->width * 2, art->height * 2);
+                    paint_surface_with_data(data->large_album_art, art->large_data, art->width * 2, art->height * 2);
+                    fade_out_edges_2(data->large_album_art, 16 * config->dpi);
+                    //data->surface = blur_surface_edges_only(data->surface, 8.0 * config->dpi);
                 }
             }
             have_time = (get_current_time_in_ms() - client->app->current) < 5;
@@ -1064,265 +1339,10 @@ void fill_album_tab(AppClient *client, Container *albums_root, const std::vector
     };
     albums_scroll_root->user_data = new AlbumsScrollRootData;
     
-    std::vector<std::string> albums_added;
-    for (auto o: options) {
-        if (o.album.empty()) {
-            AlbumOption *al = &album_songs["Unknown"];
-            o.album = "Unknown";
-            al->songs.push_back(o);
-        } else {
-            AlbumOption *al = &album_songs[o.album];
-            al->songs.push_back(o);
-        }
-        bool already_added = false;
-        for (auto a: albums_added) {
-            if (o.album == a) {
-                already_added = true;
-                break;
-            }
-        }
-        if (already_added)
-            continue;
-        albums_added.push_back(o.album);
-        
-        struct PlayButton : SurfaceButton {
-            double scalar = 0.0;
-            double hovering = 0.0;
-        };
-        
-        auto add_album = [o, client, albums_scroll_root](std::string album) {
-            auto line = albums_scroll_root->content->child(::absolute, 100 * config->dpi, 100 * config->dpi);
-            //auto line = new Container(::absolute, FILL_SPACE, FILL_SPACE);
-            auto play = line->child(56 * config->dpi, 56 * config->dpi);
-            play->name = "play";
-            auto play_data = new PlayButton;
-            load_icon_full_path(app, client, &play_data->surface, asset("play.png"), 48 * config->dpi);
-            if (play_data->surface) {
-                dye_surface(play_data->surface, ArgbColor(1, 1, 1, .9));
-            }
-            play->user_data = play_data;
-            static int top_offset = 24 * config->dpi;
-            play->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
-                auto album_data = (AlbumData *) c->parent->user_data;
-                Bounds picture_bounds = c->parent->real_bounds;
-                picture_bounds.w = album_target_width;
-                picture_bounds.h = album_target_width;
-                picture_bounds.x += (c->parent->real_bounds.w - picture_bounds.w) * .5;
-                picture_bounds.y += top_offset;
-                
-                auto data = (PlayButton *) c->user_data;
-                
-                bool animating_bounce = data->scalar != 1.0;
-                if (animating_bounce) {
-                    animating_bounce = already_began(client, &data->scalar, 1.0);  
-                }
-                
-                bool other = data->surface && bounds_contains(picture_bounds, client->mouse_current_x, client->mouse_current_y) && c->parent->state.mouse_hovering || animating_bounce;
-                if (other || data->hovering != 0.0) {
-                    if (other) {
-                        if (!already_began(client, &data->hovering, 1.0)) {
-                            client_create_animation(client->app, client, &data->hovering, client->lifetime, 0, 100, nullptr, 1.0);
-                        } 
-                    } else {
-                        if (!already_began(client, &data->hovering, 0.0)) {
-                            client_create_animation(client->app, client, &data->hovering, client->lifetime, 0, 250, nullptr, 0.0);
-                        }
-                    }
-                    int width = cairo_image_surface_get_height(data->surface);
-                    int height = cairo_image_surface_get_height(data->surface);
-               
-                    cairo_save(cr);
-                    //double bg_fade = fls[data->hover_scalar * (fls.size() - 1)];
-                    float add = (0.2 * album_data->hover_scalar);
-                    float scale = fls[data->scalar * (fls.size() - 1)] + add;
-                    if (bounds_contains(c->real_bounds, client->mouse_current_x, client->mouse_current_y)) {
-                        //scale *= 1.2;
-                    }
-                    width *= scale;
-                    height *= scale;
-                    cairo_scale(cr, scale, scale);
-                    float shrink = 1.0 / scale;
-
-                    cairo_set_source_surface(cr, data->surface, 
-                                                 (c->real_bounds.x + c->real_bounds.w * .5 - width * .4) * shrink,
-                                                 (c->real_bounds.y + c->real_bounds.h * .5 - height * .5) * shrink);
-                    cairo_paint_with_alpha(cr, data->hovering); 
-                    cairo_restore(cr);
-                }
-            };
-            play->when_clicked = [](AppClient *client, cairo_t *, Container *c) {
-                //c->parent->when_clicked(client, client->cr, c->parent);
-                //c->parent->when_clicked(client, client->cr, c->parent);
-                auto line_data = (AlbumData *) c->parent->user_data;
-                player->album_play_next(line_data->text);
-                player->pop_queue();
-                
-                open_album(client, c->parent);
-                
-                auto data = (PlayButton *) c->user_data;
-                data->scalar = 0.0;
-                client_create_animation(client->app, client, &data->scalar, client->lifetime, 0, (double) fls.size() * 12.6 , nullptr, 1.0);
-            };
-            line->pre_layout = [](AppClient *client, Container *c, const Bounds &b) {                
-                Bounds picture_bounds = c->real_bounds;
-                picture_bounds.w = album_target_width;
-                picture_bounds.h = album_target_width;
-                picture_bounds.x += (c->real_bounds.w - picture_bounds.w) * .5;
-                picture_bounds.y += top_offset;
- 
-                auto play = c->children[0];
-                play->real_bounds.x = picture_bounds.x + picture_bounds.w * .5 - play->wanted_bounds.w * .5;
-                play->real_bounds.y = picture_bounds.y + picture_bounds.h * .5 - play->wanted_bounds.h * .5;
-                play->real_bounds.w = play->wanted_bounds.w;
-                play->real_bounds.h = play->wanted_bounds.h;
-            };
-            
-            auto albums = (AlbumsScrollRootData *) albums_scroll_root->user_data;
-            albums->containers.push_back(line);
-            
-            auto data = new AlbumData;
-            data->text = album;
-            data->option = o;
-            line->user_data = data;
-
-            line->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
-                auto data = (AlbumData *) c->user_data;
-                if (data->selected) {
-                    if (!already_began(client, &data->hover_scalar, 1.0)) {
-                        client_create_animation(client->app, client, &data->hover_scalar, client->lifetime, 0, 300, getEasingFunction(EaseInSine), 1.0);
-                    } 
-                } else {
-                    if (!already_began(client, &data->hover_scalar, 0.0)) {
-                        client_create_animation(client->app, client, &data->hover_scalar, client->lifetime, 0, 300, nullptr, 0.0);
-                    } 
-                }
-
-                Bounds picture_bounds = c->real_bounds;
-                picture_bounds.w = album_target_width;
-                picture_bounds.h = album_target_width;
-                picture_bounds.x += (c->real_bounds.w - picture_bounds.w) * .5;
-                picture_bounds.y += top_offset;
- 
-                draw_colored_rect(client, ArgbColor(.96, .96, .96, 1), c->real_bounds);
-                int width = album_target_width;
-                if (data->surface) {
-                    cairo_save(cr);
-                    int width = cairo_image_surface_get_height(data->surface);
-                    int height = cairo_image_surface_get_height(data->surface);
-                    float scale_amount = 0.05 * data->hover_scalar;
-                    float scale = 1.0 + scale_amount;
-                    cairo_scale(client->cr, scale, scale);
-                    float shrink = 1.0 / scale;
-                    
-                    float x = std::round(c->real_bounds.x + c->real_bounds.w * .5 - width * .5 - ((width * scale - width) * .5)) * shrink;
-                    float y = std::round(c->real_bounds.y + top_offset - ((width * scale - width)) * .5) * shrink;
-                    
-                    {
-                        auto a_data = (AlbumsScrollRootData *) container_by_name("albums_root", client->root)->user_data;
-                        cairo_set_source_surface(cr, a_data->shadow_surface, x - shadow_size, y - shadow_size);
-                        cairo_paint(cr);
-                    }
-                    
-                    cairo_set_source_surface(cr, data->surface,x,y);
-                    cairo_paint(cr);
-                    
-                    //draw_margins_rect(client, ArgbColor(.7, .7, .7, .4), Bounds(x, y, width, width), std::round(1 * config->dpi), 0);
-                    
-                    cairo_restore(cr);
-                } else {
-                    draw_round_rect(client, ArgbColor(0.878, 0.898, 0.914, 1.0), picture_bounds, 3 * config->dpi);
-                    draw_round_rect(client, ArgbColor(.6, .6, .6, .8), picture_bounds, 3 * config->dpi, std::floor(1 * config->dpi));
-                    
-                    auto a_data = (AlbumsScrollRootData *) container_by_name("albums_root", client->root)->user_data;
-                    
-                    if (a_data->unknown_album_icon) {
-                        int width = cairo_image_surface_get_height(a_data->unknown_album_icon);
-                        int height = cairo_image_surface_get_height(a_data->unknown_album_icon);
-                        cairo_set_source_surface(cr, a_data->unknown_album_icon,
-                                                 c->real_bounds.x + c->real_bounds.w * .5 - width * .5,
-                                //c->real_bounds.y + c->real_bounds.h * .5 - height * .5);
-                                                 c->real_bounds.y + top_offset + album_target_width * .5 - height * .5);
-                        cairo_paint(cr);
-                    }
-                }
-                int over = c->real_bounds.w - width;
-                int offset = 0;
-                
-                if (data->surface) {
-                    int width = cairo_image_surface_get_height(data->surface);
-                    float scale_amount = 0.05 * data->hover_scalar;
-                    float scale = 1.0 + scale_amount;
-                    double off =  ((width * scale - width)) * .5;
-                    draw_clip_begin(client, Bounds(c->real_bounds.x + over * .5 - off,
-                                                                       c->real_bounds.y, album_target_width * scale, c->real_bounds.h));
- 
-                } else {
-                    draw_clip_begin(client, Bounds(c->real_bounds.x + over * .5,
-                                                                       c->real_bounds.y, album_target_width, c->real_bounds.h));
-                }
-                
-                {
-                    double off = 0;
-                    float scale_amount = 0.05 * data->hover_scalar;
-                    float scale = 1.0 + scale_amount;
-                    if (data->surface) {
-                        int width = cairo_image_surface_get_height(data->surface);
-                        off =  ((width * scale - width)) * .5;
-                    }
-
-                    
-                    ArgbColor color = ArgbColor(0, 0, 0, 1);
-                    auto [f, w, h] = draw_text_begin(client, 11 * config->dpi, config->font, EXPAND(color), data->option.album, true);
-                    f->draw_text_end((c->real_bounds.x + over * .5 - off), (c->real_bounds.y + top_offset + 8 * config->dpi + album_target_width + off));
-                    offset += h;
-                }
-                //if (!data->selected) {
-                {
-                    double off = 0;
-                    if (data->surface) {
-                        int width = cairo_image_surface_get_height(data->surface);
-                        float scale_amount = 0.05 * data->hover_scalar;
-                        float scale = 1.0 + scale_amount;
-                        off =  ((width * scale - width)) * .5;
-                    }
-
-
-                    auto [f, w, h] = draw_text_begin(client, 10 * config->dpi, config->font, EXPAND(ArgbColor(.3, .3, .3, 1.0 - data->hover_scalar)), data->option.artist);
-                    f->draw_text_end(c->real_bounds.x + over * .5 - off, c->real_bounds.y + top_offset + 8 * config->dpi + album_target_width + h + off);
-                    offset += h;
-                }
-                //}
-                draw_clip_end(client);
-            };
-            
-            line->when_clicked = [](AppClient *client, cairo_t *, Container *c) {
-                if (auto play = container_by_name("play", c)) {
-                    if (play->state.mouse_hovering) {
-                        return;
-                    }
-                }
-                if (c->state.mouse_button_pressed == 3) {
-                    auto data = (AlbumData *) c->user_data;
-                    right_click_album(client, data->option.album, data->option.album);
-                    return;   
-                }
-                
-                auto album_root = (ScrollContainer *) container_by_name("albums_root", client->root);
-                auto a_data = (AlbumsScrollRootData *) album_root->user_data;
-                bool was = ((AlbumData *) c->user_data)->selected;
-                
-                if (!was) {
-                    open_album(client, c);
-                } else {
-                    close_album(client, c);
-                }
-               
-                return;
-            };
-        };
-        
-        add_album(o.album);
-    }
+    // Already in order (the album index the catalog was loaded from is sorted by name)
+    for (AlbumId a = 0; a < catalog_album_count(); a++)
+        if (!catalog_album(a).songs.empty())
+            add_album(client, albums_scroll_root, a);
     
     albums_scroll_root->content->type = ::absolute;
     albums_scroll_root->content->pre_layout = [](AppClient *client, Container *c, const Bounds &b) {
@@ -1330,16 +1350,26 @@ void fill_album_tab(AppClient *client, Container *albums_root, const std::vector
 
         if (auto filter_textarea = container_by_name("filter_textarea", client->root)) {
             auto data = (TextAreaData *) filter_textarea->user_data;
+            auto a_data = (AlbumsScrollRootData *) c->parent->user_data;
             if (!data->state->text.empty()) {
+                // Plain words only look at album names here, but year:, genre: and the rest work like on songs
+                if (data->state->text != a_data->previous_filter) {
+                    a_data->previous_filter = data->state->text;
+                    // The albums shown change once the search thread is done (see albums_search_done)
+                    search_library_async(app, client, a_data->previous_filter, albums_search_done, SEARCH_ALBUM);
+                }
                 for (auto d: c->children) {
                     auto al = (AlbumData *) d->user_data;
                     if (al) {
-                        d->exists = fts::fuzzy_match_simple(data->state->text.c_str(), al->option.album.c_str());
+                        d->exists = al->album < a_data->filtered.size() && a_data->filtered[al->album];
                     } else {
                         d->exists = false;
                     }
                 }
             } else {
+                if (!a_data->previous_filter.empty())
+                    search_cancel();
+                a_data->previous_filter.clear();
                 for (auto d: c->children) {
                     d->exists = true;
                 }
@@ -1544,6 +1574,84 @@ void fill_album_tab(AppClient *client, Container *albums_root, const std::vector
     return;
 }
 
+// Unknown (songs without an album) goes last, like in the songs tab
+static bool album_comes_before(const std::string &a, const std::string &b) {
+    if (a == "Unknown")
+        return false;
+    if (b == "Unknown")
+        return true;
+    return a < b;
+}
+
+void album_tab_apply_changes(AppClient *client, const CatalogChanges &changes) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto albums_scroll_root = (ScrollContainer *) container_by_name("albums_root", client->root);
+    if (!albums_scroll_root)
+        return;
+    auto a_data = (AlbumsScrollRootData *) albums_scroll_root->user_data;
+    auto content = albums_scroll_root->content;
+    a_data->previous_filter.clear(); // So the filter runs again with the new songs
+    
+    for (auto album: changes.albums) {
+        auto &songs = catalog_album(album).songs;
+        
+        int index = -1;
+        for (int i = 0; i < a_data->containers.size(); i++) {
+            if (((AlbumData *) a_data->containers[i]->user_data)->album == album) {
+                index = i;
+                break;
+            }
+        }
+        
+        if (index != -1) {
+            auto tile = a_data->containers[index];
+            auto data = (AlbumData *) tile->user_data;
+            if (!songs.empty()) {
+                data->option = catalog_track(songs[0]);
+                continue;
+            }
+            // An open (or animating) album keeps its tile until the next start
+            if (data->selected || tile == a_data->opening || tile == a_data->closing)
+                continue;
+            a_data->containers.erase(a_data->containers.begin() + index);
+            for (int i = 0; i < content->children.size(); i++) {
+                if (content->children[i] == tile) {
+                    content->children.erase(content->children.begin() + i);
+                    break;
+                }
+            }
+            delete tile;
+        } else if (!songs.empty()) {
+            auto tile = add_album(client, albums_scroll_root, album);
+            auto name = ((AlbumData *) tile->user_data)->text;
+            content->children.pop_back();
+            a_data->containers.pop_back();
+            
+            int at = 0;
+            while (at < a_data->containers.size() &&
+                   album_comes_before(((AlbumData *) a_data->containers[at]->user_data)->text, name))
+                at++;
+            if (at < a_data->containers.size()) {
+                auto next = a_data->containers[at];
+                for (int i = 0; i < content->children.size(); i++) {
+                    if (content->children[i] == next) {
+                        content->children.insert(content->children.begin() + i, tile);
+                        break;
+                    }
+                }
+            } else {
+                content->children.push_back(tile);
+            }
+            a_data->containers.insert(a_data->containers.begin() + at, tile);
+        }
+    }
+    
+    client_layout(app, client);
+    request_refresh(app, client);
+}
+
 /*
 */
 
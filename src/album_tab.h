@@ -7,7 +7,11 @@
 #include "main.h"
 #include <vector>
 
-void fill_album_tab(AppClient *client, Container *albums_root, const std::vector<Option> &options);
+// Makes a tile for every album in the catalog (fill_songs_tab loads it)
+void fill_album_tab(AppClient *client, Container *albums_root);
+
+// Moves the songs the library watcher saw change between albums, adding or dropping album tiles as needed
+void album_tab_apply_changes(AppClient *client, const CatalogChanges &changes);
 
 void fade_out_edges_2(cairo_surface_t *surface, int pixels);
 
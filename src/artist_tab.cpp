@@ -0,0 +1,253 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "artist_tab.h"
+#include "config.h"
+#include "drawer.h"
+#include "components.h"
+#include "player.h"
+#include "search.h"
+#include "search_worker.h"
+#include <algorithm>
+
+struct ArtistRow : UserData {
+    ArtistId artist = NO_ARTIST;
+    cairo_surface_t *cover = nullptr; // made from the cover album's art once it's loaded
+    int cover_size = 0;
+    bool selected = false;
+    long last_time_clicked = 0;
+
+    ~ArtistRow() {
+        if (cover) {
+            cairo_surface_destroy(cover);
+        }
+    }
+};
+
+struct ArtistsData : UserData {
+    std::string previous_filter;
+    std::vector<bool> filtered; // by ArtistId, whether the filter found any of their songs
+};
+
+// "2 hr 41 min", or "41 min" under an hour
+static std::string duration_text(uint32_t seconds) {
+    uint32_t minutes = (seconds + 30) / 60;
+    if (minutes < 60)
+        return std::to_string(minutes) + " min";
+    return std::to_string(minutes / 60) + " hr " + std::to_string(minutes % 60) + " min";
+}
+
+static std::string counted(size_t count, const char *one, const char *many) {
+    return std::to_string(count) + " " + (count == 1 ? one : many);
+}
+
+// By the collation key of the name, with "Unknown" last
+static bool artist_comes_before(ArtistId a, ArtistId b) {
+    auto &x = catalog_artist(a);
+    auto &y = catalog_artist(b);
+    if (x.key == 0 || y.key == 0)
+        return y.key == 0 && x.key != 0;
+    if (x.key != y.key)
+        return pool_view(x.key) < pool_view(y.key);
+    return pool_view(x.name) < pool_view(y.name);
+}
+
+static void paint_artist_row(AppClient *client, cairo_t *cr, Container *c) {
+    auto row = (ArtistRow *) c->user_data;
+    auto &artist = catalog_artist(row->artist);
+    if (row->selected) {
+        draw_colored_rect(client, ArgbColor(.545, .655, .788, 1), c->real_bounds);
+    } else if (c->state.mouse_hovering) {
+        draw_colored_rect(client, ArgbColor(.945, .953, .973, 1), c->real_bounds);
+    }
+
+    int pad = 8 * config->dpi;
+    int size = c->real_bounds.h - pad * 2;
+    Bounds cover(c->real_bounds.x + pad * 2, c->real_bounds.y + pad, size, size);
+    if (!row->cover) {
+        if (auto art = album_art(artist.cover)) {
+            row->cover = accelerated_surface(app, client, art->width, art->height);
+            paint_surface_with_data(row->cover, art->data, art->width, art->height);
+            row->cover_size = art->width;
+        }
+    }
+    if (row->cover && row->cover_size > 0) {
+        cairo_save(cr);
+        cairo_translate(cr, cover.x, cover.y);
+        double scale = cover.w / row->cover_size;
+        cairo_scale(cr, scale, scale);
+        cairo_set_source_surface(cr, row->cover, 0, 0);
+        cairo_paint(cr);
+        cairo_restore(cr);
+    } else {
+        draw_colored_rect(client, ArgbColor(.88, .88, .88, 1), cover);
+    }
+
+    std::string stats = counted(artist.albums.size(), "album", "albums") + "  ·  " +
+                        counted(artist.songs.size(), "song", "songs") + "  ·  " + duration_text(artist.length);
+    int text_x = cover.x + cover.w + pad * 2;
+    auto text_bounds = c->real_bounds;
+    text_bounds.w -= text_x - c->real_bounds.x + pad;
+    text_bounds.x = text_x;
+    draw_clip_begin(client, text_bounds);
+    {
+        auto [f, w, h] = draw_text_begin(client, 11 * config->dpi, config->font, EXPAND(ArgbColor(0, 0, 0, 1)), pool_string(artist.name));
+        f->draw_text_end(text_x, c->real_bounds.y + c->real_bounds.h / 2 - h);
+    }
+    {
+        auto [f, w, h] = draw_text_begin(client, 9 * config->dpi, config->font, EXPAND(ArgbColor(.44, .44, .44, 1)), stats);
+        f->draw_text_end(text_x, c->real_bounds.y + c->real_bounds.h / 2 + 2 * config->dpi);
+    }
+    draw_clip_end(client);
+}
+
+static Container *make_artist_row(Container *content, ArtistId artist) {
+    auto row = content->child(FILL_SPACE, 56 * config->dpi);
+    auto data = new ArtistRow;
+    data->artist = artist;
+    row->user_data = data;
+    row->when_paint = paint_artist_row;
+    row->when_clicked = [](AppClient *client, cairo_t *cr, Container *c) {
+        auto data = (ArtistRow *) c->user_data;
+        for (auto child: c->parent->children)
+            ((ArtistRow *) child->user_data)->selected = false;
+        data->selected = true;
+        if (client->app->current - data->last_time_clicked < 500)
+            play_selected_artist(client);
+        data->last_time_clicked = client->app->current;
+        request_refresh(app, client);
+    };
+    return row;
+}
+
+void play_selected_artist(AppClient *client) {
+    auto content = container_by_name("artists_content", client->root);
+    if (!content)
+        return;
+    for (auto child: content->children) {
+        auto data = (ArtistRow *) child->user_data;
+        if (child->exists && data->selected) {
+            player->artist_play_next(data->artist);
+            player->pop_queue();
+            return;
+        }
+    }
+}
+
+static void artists_search_done(AppClient *client, const std::string &query, const std::vector<SearchHit> &hits,
+                                const SearchStats &) {
+    auto artists_scroll = container_by_name("artists_root", client->root);
+    if (!artists_scroll)
+        return;
+    auto data = (ArtistsData *) artists_scroll->user_data;
+    if (query != data->previous_filter)
+        return;
+    data->filtered.assign(catalog_artist_count(), false);
+    for (auto &hit: hits) {
+        ArtistId artist = catalog_artist_of(hit.id);
+        if (artist != NO_ARTIST)
+            data->filtered[artist] = true;
+    }
+    client_layout(app, client);
+    request_refresh(app, client);
+}
+
+void fill_artist_tab(AppClient *client, Container *artists_root) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    artists_root->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
+        draw_colored_rect(client, ArgbColor(1, 1, 1, 1), c->real_bounds);
+    };
+
+    ScrollPaneSettings scroll_settings(config->dpi);
+    scroll_settings.right_inline_track = true;
+    auto artists_scroll = make_newscrollpane_as_child(artists_root, scroll_settings);
+    artists_scroll->name = "artists_root";
+    artists_scroll->user_data = new ArtistsData;
+    auto content = artists_scroll->content;
+    content->name = "artists_content";
+
+    std::vector<ArtistId> artists;
+    for (ArtistId a = 0; a < catalog_artist_count(); a++)
+        if (!catalog_artist(a).songs.empty())
+            artists.push_back(a);
+    std::sort(artists.begin(), artists.end(), artist_comes_before);
+    for (auto a: artists)
+        make_artist_row(content, a);
+
+    // Plain words only look at artist names here, but year:, genre: and the rest work like on songs
+    content->pre_layout = [](AppClient *client, Container *c, const Bounds &b) {
+        auto filter_textarea = container_by_name("filter_textarea", client->root);
+        if (!filter_textarea)
+            return;
+        auto text = ((TextAreaData *) filter_textarea->user_data)->state->text;
+        auto data = (ArtistsData *) c->parent->user_data;
+        if (text.empty()) {
+            if (!data->previous_filter.empty())
+                search_cancel();
+            data->previous_filter.clear();
+            for (auto row: c->children)
+                row->exists = true;
+            return;
+        }
+        if (text != data->previous_filter) {
+            data->previous_filter = text;
+            // The rows shown change once the search thread is done (see artists_search_done)
+            search_library_async(app, client, text, artists_search_done, SEARCH_ARTIST);
+        }
+        for (auto row: c->children) {
+            auto artist = ((ArtistRow *) row->user_data)->artist;
+            row->exists = artist < data->filtered.size() && data->filtered[artist];
+        }
+    };
+}
+
+void artist_tab_apply_changes(AppClient *client, const CatalogChanges &changes) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto artists_scroll = (ScrollContainer *) container_by_name("artists_root", client->root);
+    if (!artists_scroll)
+        return;
+    ((ArtistsData *) artists_scroll->user_data)->previous_filter.clear(); // So the filter runs again
+    auto content = artists_scroll->content;
+
+    for (auto artist: changes.artists) {
+        bool has_songs = !catalog_artist(artist).songs.empty();
+        int index = -1;
+        for (int i = 0; i < content->children.size(); i++) {
+            if (((ArtistRow *) content->children[i]->user_data)->artist == artist) {
+                index = i;
+                break;
+            }
+        }
+        if (index != -1) {
+            auto row = (ArtistRow *) content->children[index]->user_data;
+            if (has_songs) {
+                // Their biggest album might be a different one now
+                if (row->cover)
+                    cairo_surface_destroy(row->cover);
+                row->cover = nullptr;
+                continue;
+            }
+            delete content->children[index];
+            content->children.erase(content->children.begin() + index);
+        } else if (has_songs) {
+            auto row = make_artist_row(content, artist);
+            content->children.pop_back();
+            auto at = std::lower_bound(content->children.begin(), content->children.end(), artist,
+                                       [](Container *c, ArtistId a) {
+                                           return artist_comes_before(((ArtistRow *) c->user_data)->artist, a);
+                                       });
+            content->children.insert(at, row);
+        }
+    }
+
+    client_layout(app, client);
+    request_refresh(app, client);
+}
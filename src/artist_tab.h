@@ -0,0 +1,19 @@
+/* date = October 19th 2026 11:40 pm */
+
+#ifndef ARTIST_TAB_H
+#define ARTIST_TAB_H
+
+#include "container.h"
+#include "main.h"
+
+// A row for every artist in the catalog, with their album and song counts, how long they play for and a cover,
+// all of it read off the catalog's per-artist totals (fill_songs_tab loads it)
+void fill_artist_tab(AppClient *client, Container *artists_root);
+
+// Adds the rows of artists the library watcher saw show up, and drops the ones left without songs
+void artist_tab_apply_changes(AppClient *client, const CatalogChanges &changes);
+
+// Puts all of the selected artist's songs up next and starts playing them
+void play_selected_artist(AppClient *client);
+
+#endif //ARTIST_TAB_H
@@ -0,0 +1,303 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "catalog.h"
+#include "facets.h"
+#include "library.h"
+#include "search.h"
+#include <algorithm>
+#include <mutex>
+#include <shared_mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+struct Catalog {
+    std::vector<Track> tracks; // by TrackId
+    std::vector<AlbumId> album_of; // by TrackId
+    std::vector<CatalogAlbum> albums; // by AlbumId
+    std::vector<ArtistId> artist_of; // by TrackId
+    std::vector<CatalogArtist> artists; // by ArtistId
+    std::unordered_map<StringId, TrackId> track_of_path;
+    std::unordered_map<StringId, AlbumId> album_of_name;
+    std::unordered_map<StringId, ArtistId> artist_of_name;
+};
+
+static Catalog catalog;
+// Held exclusively while the main thread changes the tracks or the paths, and shared by the other threads reading them
+static std::shared_mutex catalog_mutex;
+
+static AlbumId album_named(StringId name) {
+    static StringId unknown = intern("Unknown");
+    if (name == 0)
+        name = unknown;
+    auto slot = catalog.album_of_name.try_emplace(name, catalog.albums.size());
+    if (slot.second) {
+        catalog.albums.emplace_back();
+        catalog.albums.back().name = name;
+    }
+    return slot.first->second;
+}
+
+static ArtistId artist_named(const Track &track) {
+    static StringId unknown = intern("Unknown");
+    StringId name = track.artist == 0 ? unknown : track.artist;
+    auto slot = catalog.artist_of_name.try_emplace(name, catalog.artists.size());
+    if (slot.second) {
+        catalog.artists.emplace_back();
+        catalog.artists.back().name = name;
+        catalog.artists.back().key = track.artist_key;
+    }
+    return slot.first->second;
+}
+
+// Counts the song towards its album on the artist (the songs themselves are put in order by the caller)
+static void count_album(CatalogArtist *artist, AlbumId album, int change) {
+    auto &albums = artist->albums;
+    auto it = std::lower_bound(albums.begin(), albums.end(), std::make_pair(album, 0u));
+    if (it == albums.end() || it->first != album)
+        it = albums.insert(it, {album, 0});
+    it->second += change;
+    if (it->second == 0)
+        albums.erase(it);
+}
+
+static void summarize_artist(CatalogArtist *artist) {
+    artist->length = 0;
+    for (auto id: artist->songs)
+        artist->length += catalog.tracks[id].length;
+    artist->cover = NO_ALBUM;
+    uint32_t most = 0;
+    for (auto &album: artist->albums) {
+        if (album.second > most) {
+            artist->cover = album.first;
+            most = album.second;
+        }
+    }
+}
+
+static void summarize(CatalogAlbum *album) {
+    album->length = 0;
+    album->year = 0;
+    album->art = album->songs.empty() ? NO_TRACK : album->songs[0];
+    bool found_art = false;
+    for (auto id: album->songs) {
+        auto &t = catalog.tracks[id];
+        album->length += t.length;
+        if (album->year == 0)
+            album->year = t.year;
+        if (!found_art && t.has_art) {
+            album->art = id;
+            found_art = true;
+        }
+    }
+}
+
+void catalog_load(const std::vector<Track> &tracks, const std::vector<AlbumEntry> &index) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::unique_lock<std::shared_mutex> lock(catalog_mutex);
+    catalog = Catalog();
+    search_index_clear();
+    facets_clear();
+    catalog.tracks = tracks;
+    catalog.album_of.assign(tracks.size(), NO_ALBUM);
+    catalog.artist_of.assign(tracks.size(), NO_ARTIST);
+    catalog.track_of_path.reserve(tracks.size());
+    for (TrackId id = 0; id < tracks.size(); id++)
+        catalog.track_of_path[tracks[id].path] = id;
+
+    catalog.albums.reserve(index.size());
+    catalog.album_of_name.reserve(index.size());
+    for (auto &entry: index) {
+        if (entry.songs.empty())
+            continue;
+        AlbumId a = album_named(intern(entry.name));
+        auto &album = catalog.albums[a];
+        bool shared = !album.songs.empty(); // An album really called "Unknown" shares with the songs without one
+        for (auto s: entry.songs) {
+            album.songs.push_back(s);
+            catalog.album_of[s] = a;
+        }
+        if (shared) {
+            summarize(&album);
+        } else {
+            album.length = entry.length;
+            album.year = entry.year;
+            album.art = entry.art;
+        }
+    }
+    // The index is in songs tab order already, so every artist's songs come out in order too
+    for (auto &album: catalog.albums) {
+        for (auto id: album.songs) {
+            ArtistId a = artist_named(catalog.tracks[id]);
+            catalog.artists[a].songs.push_back(id);
+            catalog.artist_of[id] = a;
+        }
+    }
+    for (auto &artist: catalog.artists) {
+        for (auto id: artist.songs)
+            count_album(&artist, catalog.album_of[id], 1);
+        summarize_artist(&artist);
+    }
+    for (TrackId id = 0; id < tracks.size(); id++)
+        if (catalog.album_of[id] != NO_ALBUM) {
+            search_index_add(id);
+            facets_add(id);
+        }
+}
+
+// Takes the song out of its album and artist (and the search index and the facets), and returns which album that
+// was ('artist' gets which artist)
+static AlbumId take_out(TrackId id, ArtistId *artist) {
+    AlbumId a = catalog.album_of[id];
+    if (a == NO_ALBUM)
+        return NO_ALBUM;
+    search_index_remove(id);
+    facets_remove(id);
+    auto &songs = catalog.albums[a].songs;
+    songs.erase(std::find(songs.begin(), songs.end(), id));
+    catalog.album_of[id] = NO_ALBUM;
+
+    *artist = catalog.artist_of[id];
+    auto &by = catalog.artists[*artist];
+    by.songs.erase(std::find(by.songs.begin(), by.songs.end(), id));
+    count_album(&by, a, -1);
+    catalog.artist_of[id] = NO_ARTIST;
+    return a;
+}
+
+CatalogChanges catalog_apply_changes(const std::vector<Option> &changed, const std::vector<std::string> &removed) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::unique_lock<std::shared_mutex> lock(catalog_mutex);
+    CatalogChanges changes;
+    std::unordered_set<AlbumId> touched;
+    std::unordered_set<ArtistId> touched_artists;
+    for (auto &path: removed) {
+        auto it = catalog.track_of_path.find(intern(path));
+        if (it == catalog.track_of_path.end())
+            continue;
+        TrackId id = it->second;
+        ArtistId artist;
+        AlbumId a = take_out(id, &artist);
+        if (a == NO_ALBUM)
+            continue;
+        touched.insert(a);
+        touched_artists.insert(artist);
+        changes.removed.push_back(id);
+    }
+    for (auto &o: changed) {
+        Track track = make_track(o);
+        auto slot = catalog.track_of_path.try_emplace(track.path, catalog.tracks.size());
+        TrackId id = slot.first->second;
+        if (slot.second) {
+            catalog.tracks.push_back(track);
+            catalog.album_of.push_back(NO_ALBUM);
+            catalog.artist_of.push_back(NO_ARTIST);
+        } else {
+            ArtistId old_artist;
+            AlbumId old = take_out(id, &old_artist);
+            if (old != NO_ALBUM) {
+                touched.insert(old);
+                touched_artists.insert(old_artist);
+                changes.removed.push_back(id);
+            }
+            catalog.tracks[id] = track;
+        }
+
+        AlbumId a = album_named(track.album);
+        auto &songs = catalog.albums[a].songs;
+        auto position = std::upper_bound(songs.begin(), songs.end(), id, [](TrackId x, TrackId y) {
+            auto &tx = catalog.tracks[x];
+            auto &ty = catalog.tracks[y];
+            if (tx.disc == ty.disc)
+                return tx.track < ty.track;
+            return tx.disc < ty.disc;
+        });
+        songs.insert(position, id);
+        catalog.album_of[id] = a;
+
+        ArtistId artist = artist_named(track);
+        auto &by = catalog.artists[artist].songs;
+        by.insert(std::upper_bound(by.begin(), by.end(), id, [](TrackId x, TrackId y) {
+            auto &tx = catalog.tracks[x];
+            auto &ty = catalog.tracks[y];
+            if (comes_before(tx, ty))
+                return true;
+            return !comes_before(ty, tx) && x < y;
+        }), id);
+        count_album(&catalog.artists[artist], a, 1);
+        catalog.artist_of[id] = artist;
+        touched_artists.insert(artist);
+        search_index_add(id);
+        facets_add(id);
+        touched.insert(a);
+        changes.added.push_back(id);
+    }
+    for (auto a: touched) {
+        summarize(&catalog.albums[a]);
+        changes.albums.push_back(a);
+    }
+    for (auto a: touched_artists) {
+        summarize_artist(&catalog.artists[a]);
+        changes.artists.push_back(a);
+    }
+    return changes;
+}
+
+TrackId catalog_find(StringId path) {
+    std::shared_lock<std::shared_mutex> lock(catalog_mutex);
+    auto it = catalog.track_of_path.find(path);
+    return it == catalog.track_of_path.end() ? NO_TRACK : it->second;
+}
+
+AlbumId catalog_find_album(StringId name) {
+    auto it = catalog.album_of_name.find(name);
+    return it == catalog.album_of_name.end() ? NO_ALBUM : it->second;
+}
+
+size_t catalog_track_count() {
+    return catalog.tracks.size();
+}
+
+const Track &catalog_track(TrackId id) {
+    return catalog.tracks[id];
+}
+
+bool catalog_track_copy(TrackId id, Track *track) {
+    std::shared_lock<std::shared_mutex> lock(catalog_mutex);
+    if (id >= catalog.tracks.size())
+        return false;
+    *track = catalog.tracks[id];
+    return true;
+}
+
+AlbumId catalog_album_of(TrackId id) {
+    return id < catalog.album_of.size() ? catalog.album_of[id] : NO_ALBUM;
+}
+
+CatalogAlbum &catalog_album(AlbumId id) {
+    return catalog.albums[id];
+}
+
+size_t catalog_album_count() {
+    return catalog.albums.size();
+}
+
+ArtistId catalog_artist_of(TrackId id) {
+    return id < catalog.artist_of.size() ? catalog.artist_of[id] : NO_ARTIST;
+}
+
+const CatalogArtist &catalog_artist(ArtistId id) {
+    return catalog.artists[id];
+}
+
+size_t catalog_artist_count() {
+    return catalog.artists.size();
+}
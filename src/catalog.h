@@ -0,0 +1,87 @@
+/* date = October 19th 2026 7:40 pm */
+
+#ifndef CATALOG_H
+#define CATALOG_H
+
+#include "track.h"
+#include <string>
+#include <vector>
+
+// Every song, album and artist the tabs, the queue and the player know about, under small dense ids. A song keeps its id
+// for as long as the program runs (even if it's removed and comes back), so ids can be held on to and compared
+// instead of paths, and looking one up is an index into a vector. Only changed from the main thread, and only read from
+// it too, apart from catalog_find and catalog_track_copy.
+typedef uint32_t TrackId;
+typedef uint32_t AlbumId;
+typedef uint32_t ArtistId;
+
+#define NO_TRACK ((TrackId) -1)
+#define NO_ALBUM ((AlbumId) -1)
+#define NO_ARTIST ((ArtistId) -1)
+
+struct CachedArt;
+
+struct CatalogAlbum {
+    StringId name = 0; // "Unknown" for the songs without an album
+    std::vector<TrackId> songs; // by disc, then track (empty once they're all gone, the id stays)
+    uint32_t length = 0; // seconds, all the songs together
+    uint16_t year = 0;
+    TrackId art = NO_TRACK; // the song the cover is taken from (the first one with embedded art if any has it)
+
+    // Filled in by album_art once the cover has been loaded
+    std::string art_name;
+    CachedArt *cached_art = nullptr;
+};
+
+// What the artists tab shows of an artist, kept up to date as songs come and go so nothing gets counted while painting
+struct CatalogArtist {
+    StringId name = 0; // "Unknown" for the songs without one
+    StringId key = 0; // the collation key of the name, 0 for "Unknown" (what the artists tab sorts by)
+    std::vector<TrackId> songs; // in songs tab order (comes_before), empty once they're all gone (the id stays)
+    std::vector<std::pair<AlbumId, uint32_t>> albums; // by AlbumId, each with how many of the songs are on it
+    uint32_t length = 0; // seconds, all the songs together
+    AlbumId cover = NO_ALBUM; // the album with the most of their songs, whose cover stands for them
+};
+
+struct CatalogChanges {
+    std::vector<TrackId> added; // new songs, and the ones whose tags changed
+    std::vector<TrackId> removed; // the ones that went away, and the ones whose tags changed
+    std::vector<AlbumId> albums; // albums that gained, lost, or had a song change
+    std::vector<ArtistId> artists; // the same for artists
+};
+
+// Starts over with the songs loaded at startup: 'tracks' in cache order, 'index' the cache's albums of them
+void catalog_load(const std::vector<Track> &tracks, const std::vector<AlbumEntry> &index);
+
+// Puts what the library scan or watcher saw into the catalog, and says what moved
+CatalogChanges catalog_apply_changes(const std::vector<Option> &changed, const std::vector<std::string> &removed);
+
+// NO_TRACK if the path was never in the library (safe to call from any thread)
+TrackId catalog_find(StringId path);
+
+// Copies the song out for threads other than the main one, false if there's no such id
+bool catalog_track_copy(TrackId id, Track *track);
+
+// NO_ALBUM if there's no album called that ("Unknown" holds the songs without one)
+AlbumId catalog_find_album(StringId name);
+
+// Ids go from 0 up to this (removed songs included)
+size_t catalog_track_count();
+
+const Track &catalog_track(TrackId id);
+
+// NO_ALBUM once the song has been removed
+AlbumId catalog_album_of(TrackId id);
+
+CatalogAlbum &catalog_album(AlbumId id);
+
+size_t catalog_album_count();
+
+// NO_ARTIST once the song has been removed
+ArtistId catalog_artist_of(TrackId id);
+
+const CatalogArtist &catalog_artist(ArtistId id);
+
+size_t catalog_artist_count();
+
+#endif //CATALOG_H
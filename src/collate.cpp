@@ -0,0 +1,184 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "collate.h"
+
+// The letter each of U+00C0 to U+00FF folds to. '*' is one that becomes more than one letter (see spelled_out),
+// '#' one that's kept (× and ÷).
+static const char latin1[] = "aaaaaa*ceeeeiiii" "dnooooo#ouuuuy**" "aaaaaa*ceeeeiiii" "dnooooo#ouuuuy*y";
+
+// The same for U+0100 to U+017F
+static const char latin_extended_a[] = "aaaaaaccccccccdd" "ddeeeeeeeeeegggg" "gggghhhhiiiiiiii" "ii**jjkkklllllll"
+                                       "lllnnnnnnnnnoooo" "oo**rrrrrrssssss" "ssttttttuuuuuuuu" "uuuuwwyyyzzzzzzs";
+
+// U+0180 to U+024F (Latin Extended-B), letters with hooks and strokes going to the letter under them
+static const char latin_extended_b[] = "bbbb###cc#ddd###" "#ffg###ikkl##nno" "oo##pp#####ttttu" "u#vyyzz#########"
+                                       "####*********aai" "ioouuuuuuuuuu#aa" "aa##ggggkkoooo##" "j***gg##nnaa##oo"
+                                       "aaaaeeeeiiiioooo" "rrrruuuusstt##hh" "nd##zzaaeeoooooo" "ooyylnt###acclts"
+                                       "z##b##eejj#qrryy";
+
+// U+1E00 to U+1EFF (Latin Extended Additional), which has all of Vietnamese
+static const char latin_extended_additional[] = "aabbbbbbccdddddd" "ddddeeeeeeeeeeff" "gghhhhhhhhhhiiii"
+                                                "kkkkkkllllllllmm" "mmmmnnnnnnnnoooo" "oooopppprrrrrrrr"
+                                                "sssssssssstttttt" "ttuuuuuuuuuuvvvv" "wwwwwwwwwwxxxxyy"
+                                                "zzzzzzhtwyasss*#" "aaaaaaaaaaaaaaaa" "aaaaaaaaeeeeeeee"
+                                                "eeeeeeeeiiiioooo" "oooooooooooooooo" "oooouuuuuuuuuuuu"
+                                                "uuyyyyyyyy####yy";
+
+static const char *spelled_out(uint32_t c) {
+    switch (c) {
+        case 0xC6: case 0xE6: return "ae";
+        case 0xDE: case 0xFE: return "th";
+        case 0xDF: case 0x1E9E: return "ss";
+        case 0x132: case 0x133: return "ij";
+        case 0x152: case 0x153: return "oe";
+        case 0x1C4: case 0x1C5: case 0x1C6: case 0x1F1: case 0x1F2: case 0x1F3: return "dz";
+        case 0x1C7: case 0x1C8: case 0x1C9: return "lj";
+        case 0x1CA: case 0x1CB: case 0x1CC: return "nj";
+        case 0xFB00: return "ff"; // the ligatures
+        case 0xFB01: return "fi";
+        case 0xFB02: return "fl";
+        case 0xFB03: return "ffi";
+        case 0xFB04: return "ffl";
+        case 0xFB05: case 0xFB06: return "st";
+        default: return nullptr;
+    }
+}
+
+// Typographic punctuation that's typed as plain ASCII, so "don't" finds "Don’t" and "a-ha" finds "a‐ha"
+static uint32_t fold_punctuation(uint32_t c) {
+    switch (c) {
+        case 0xA0: case 0x2007: case 0x202F: return ' '; // no-break spaces
+        case 0x2010: case 0x2011: case 0x2012: case 0x2013: case 0x2014: case 0x2015: case 0x2212: return '-';
+        case 0x2018: case 0x2019: case 0x201B: case 0x2032: return '\'';
+        case 0x201C: case 0x201D: case 0x201F: case 0x2033: return '"';
+        default: return c;
+    }
+}
+
+// The lowercase of a Greek or Cyrillic letter, with the accent or breve taken off
+static uint32_t fold_greek_cyrillic(uint32_t c) {
+    if ((c >= 0x391 && c <= 0x3A9) || (c >= 0x410 && c <= 0x42F))
+        c += 0x20;
+    else if (c >= 0x400 && c <= 0x40F)
+        c += 0x50;
+    switch (c) {
+        case 0x386: case 0x3AC: return 0x3B1; // ά
+        case 0x388: case 0x3AD: return 0x3B5; // έ
+        case 0x389: case 0x3AE: return 0x3B7; // ή
+        case 0x38A: case 0x3AA: case 0x3AF: case 0x3CA: case 0x390: return 0x3B9; // ί ϊ ΐ
+        case 0x38C: case 0x3CC: return 0x3BF; // ό
+        case 0x38E: case 0x3AB: case 0x3CD: case 0x3CB: case 0x3B0: return 0x3C5; // ύ ϋ ΰ
+        case 0x38F: case 0x3CE: return 0x3C9; // ώ
+        case 0x3C2: return 0x3C3; // final sigma
+        case 0x450: case 0x451: return 0x435; // ѐ ё
+        case 0x453: return 0x433; // ѓ
+        case 0x457: return 0x456; // ї
+        case 0x45C: return 0x43A; // ќ
+        case 0x439: case 0x45D: return 0x438; // й ѝ
+        case 0x45E: return 0x443; // ў
+        default: return c;
+    }
+}
+
+static void append_utf8(std::string *out, uint32_t c) {
+    if (c < 0x80) {
+        out->push_back(c);
+    } else if (c < 0x800) {
+        out->push_back(0xC0 | c >> 6);
+        out->push_back(0x80 | (c & 0x3F));
+    } else if (c < 0x10000) {
+        out->push_back(0xE0 | c >> 12);
+        out->push_back(0x80 | (c >> 6 & 0x3F));
+        out->push_back(0x80 | (c & 0x3F));
+    } else {
+        out->push_back(0xF0 | c >> 18);
+        out->push_back(0x80 | (c >> 12 & 0x3F));
+        out->push_back(0x80 | (c >> 6 & 0x3F));
+        out->push_back(0x80 | (c & 0x3F));
+    }
+}
+
+// The code point starting at s[*i] (moving *i past it), or -1 for a byte that doesn't start a valid one
+static int32_t next_code_point(std::string_view s, size_t *i) {
+    uint8_t b = s[*i];
+    int length;
+    uint32_t c;
+    if (b < 0x80) {
+        (*i)++;
+        return b;
+    } else if ((b & 0xE0) == 0xC0) {
+        length = 2;
+        c = b & 0x1F;
+    } else if ((b & 0xF0) == 0xE0) {
+        length = 3;
+        c = b & 0x0F;
+    } else if ((b & 0xF8) == 0xF0) {
+        length = 4;
+        c = b & 0x07;
+    } else {
+        return -1;
+    }
+    if (*i + length > s.size())
+        return -1;
+    for (int k = 1; k < length; k++) {
+        uint8_t next = s[*i + k];
+        if ((next & 0xC0) != 0x80)
+            return -1;
+        c = c << 6 | (next & 0x3F);
+    }
+    *i += length;
+    return c;
+}
+
+std::string collation_key(std::string_view s) {
+    std::string key;
+    key.reserve(s.size());
+    size_t i = 0;
+    while (i < s.size()) {
+        int32_t c = next_code_point(s, &i);
+        if (c < 0) {
+            key.push_back(s[i++]);
+            continue;
+        }
+        if (c >= 0xFF01 && c <= 0xFF5E) // full-width ASCII
+            c -= 0xFF01 - 0x21;
+        else if (c == 0x3000) // and the full-width space
+            c = ' ';
+        else
+            c = fold_punctuation(c);
+        if (c < 0x80) {
+            key.push_back(c >= 'A' && c <= 'Z' ? c + 'a' - 'A' : c);
+        } else if (c >= 0x300 && c <= 0x36F) {
+            // A combining accent, from text that came already decomposed
+        } else if ((c >= 0xC0 && c <= 0x24F) || (c >= 0x1E00 && c <= 0x1EFF)) {
+            char letter = c < 0x100 ? latin1[c - 0xC0] :
+                          c < 0x180 ? latin_extended_a[c - 0x100] :
+                          c < 0x250 ? latin_extended_b[c - 0x180] : latin_extended_additional[c - 0x1E00];
+            if (letter == '*')
+                key += spelled_out(c);
+            else if (letter == '#')
+                append_utf8(&key, c);
+            else
+                key.push_back(letter);
+        } else if (c >= 0x386 && c <= 0x45F) {
+            append_utf8(&key, fold_greek_cyrillic(c));
+        } else if (c >= 0xFB00 && c <= 0xFB06) {
+            key += spelled_out(c);
+        } else {
+            append_utf8(&key, c);
+        }
+    }
+    return key;
+}
+
+bool is_collation_key(std::string_view s) {
+    for (unsigned char c: s)
+        if (c >= 0x80 || (c >= 'A' && c <= 'Z'))
+            return false;
+    return true;
+}
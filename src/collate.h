@@ -0,0 +1,19 @@
+/* date = October 19th 2026 10:50 pm */
+
+#ifndef COLLATE_H
+#define COLLATE_H
+
+#include <string>
+#include <string_view>
+
+// What a tag is searched and sorted by: lowercased, with accents taken off letters (é and e, ß and ss, Ё and е, ệ
+// and e), ligatures and full-width forms turned into ASCII, curly quotes and dashes made plain, and loose combining
+// marks dropped, so comparing two keys byte by byte puts "Björk" between "Bjork" and "Blur", "ÉTÉ" with "ete", and
+// a search for "bjork" finds "BJÖRK". Covers Latin (up to Latin Extended-B, and Latin Extended Additional), Greek
+// and Cyrillic, anything else is kept as it is.
+std::string collation_key(std::string_view s);
+
+// Whether 's' is its own collation key (plain ASCII with no capitals), which most tags are
+bool is_collation_key(std::string_view s);
+
+#endif //COLLATE_H
@@ -0,0 +1,405 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "facets.h"
+#include <algorithm>
+#include <unordered_map>
+
+#define NO_SLOT ((uint32_t) -1)
+
+typedef std::vector<uint64_t> Bitset; // a bit per TrackId, missing words are all zero
+
+// The songs that have one value: sorted ids while there are few of them, a bit per song in the catalog once the
+// ids would take more room than that (four bytes each against an eighth of a byte per song)
+struct TrackSet {
+    std::vector<TrackId> ids;
+    Bitset bits; // in use once it isn't empty
+    uint32_t count = 0;
+};
+
+struct FacetIndex {
+    // By slot (values are never taken out, a value whose songs are all gone just counts zero)
+    std::vector<uint32_t> keys;
+    std::vector<TrackSet> sets;
+    std::vector<char> selected;
+    std::unordered_map<uint32_t, uint32_t> slot_of_key;
+    std::vector<uint32_t> slot_of_track; // by TrackId, NO_SLOT if it isn't in
+
+    uint64_t picks_version = 0; // bumped when the selection changes
+    // The songs of the selected values, and whether there are any (if not, the facet lets everything through)
+    Bitset allowed;
+    bool restricts = false;
+    uint64_t allowed_stamp = 0;
+
+    // Worked out when they're asked for after a change to the songs or to another facet's selection
+    std::vector<uint32_t> counts; // by slot
+    uint64_t counted_stamp = 0;
+};
+
+static FacetIndex facets[FACET_COUNT];
+static Bitset live; // the songs in the catalog's albums
+static uint64_t songs_version = 1; // bumped when a song goes in or out
+static uint64_t version = 1; // bumped on any change
+
+// What the selection lets through, worked out when it's asked for after a change
+static Bitset selection; // live, AND every facet that restricts
+static bool selecting = false;
+static uint64_t selection_stamp = 0;
+
+// Something worked out from the songs and the selections of some facets is stamped with the sum of their versions.
+// They only ever go up, so the sum stays the same exactly as long as none of them changes.
+static uint64_t stamp_of(int only, int except) {
+    uint64_t stamp = songs_version;
+    for (int f = 0; f < FACET_COUNT; f++)
+        if ((only == -1 || f == only) && f != except)
+            stamp += facets[f].picks_version;
+    return stamp;
+}
+
+static void set_bit(Bitset *bits, TrackId id) {
+    if (id / 64 >= bits->size())
+        bits->resize(id / 64 + 1, 0);
+    (*bits)[id / 64] |= 1ull << (id % 64);
+}
+
+static void clear_bit(Bitset *bits, TrackId id) {
+    if (id / 64 < bits->size())
+        (*bits)[id / 64] &= ~(1ull << (id % 64));
+}
+
+static bool has_bit(const Bitset &bits, TrackId id) {
+    return id / 64 < bits.size() && (bits[id / 64] >> (id % 64)) & 1;
+}
+
+// The loops over whole bitsets go through plain pointers, so they stay tight in a build without optimizations too
+
+static void and_into(Bitset *into, const Bitset &other) {
+    size_t shared = std::min(into->size(), other.size());
+    uint64_t *a = into->data();
+    const uint64_t *b = other.data();
+    for (size_t i = 0; i < shared; i++)
+        a[i] &= b[i];
+    into->resize(shared);
+}
+
+static size_t popcount(const Bitset &bits) {
+    size_t count = 0;
+    const uint64_t *words = bits.data();
+    for (size_t i = 0; i < bits.size(); i++)
+        count += __builtin_popcountll(words[i]);
+    return count;
+}
+
+static void set_add(TrackSet *set, TrackId id, size_t universe) {
+    set->count++;
+    if (!set->bits.empty()) {
+        set_bit(&set->bits, id);
+        return;
+    }
+    // The catalog adds songs in id order when it loads, so this is nearly always an append
+    if (set->ids.empty() || set->ids.back() < id) {
+        set->ids.push_back(id);
+    } else {
+        set->ids.insert(std::lower_bound(set->ids.begin(), set->ids.end(), id), id);
+    }
+    if (set->ids.size() > std::max<size_t>(64, universe / 32)) {
+        for (auto i: set->ids)
+            set_bit(&set->bits, i);
+        set->ids = std::vector<TrackId>();
+    }
+}
+
+static void set_remove(TrackSet *set, TrackId id) {
+    set->count--;
+    if (!set->bits.empty()) {
+        clear_bit(&set->bits, id);
+        return;
+    }
+    auto it = std::lower_bound(set->ids.begin(), set->ids.end(), id);
+    if (it != set->ids.end() && *it == id)
+        set->ids.erase(it);
+}
+
+static void set_or_into(const TrackSet &set, Bitset *into) {
+    if (set.bits.empty()) {
+        for (auto id: set.ids)
+            set_bit(into, id);
+        return;
+    }
+    if (into->size() < set.bits.size())
+        into->resize(set.bits.size(), 0);
+    uint64_t *a = into->data();
+    const uint64_t *b = set.bits.data();
+    for (size_t i = 0; i < set.bits.size(); i++)
+        a[i] |= b[i];
+}
+
+// How many of the set's songs are in 'bits'
+static uint32_t set_count_in(const TrackSet &set, const Bitset &bits) {
+    uint32_t count = 0;
+    const uint64_t *b = bits.data();
+    if (set.bits.empty()) {
+        const TrackId *ids = set.ids.data();
+        for (size_t i = 0; i < set.ids.size(); i++)
+            if (ids[i] / 64 < bits.size())
+                count += b[ids[i] / 64] >> (ids[i] % 64) & 1;
+        return count;
+    }
+    const uint64_t *a = set.bits.data();
+    size_t shared = std::min(set.bits.size(), bits.size());
+    for (size_t i = 0; i < shared; i++)
+        count += __builtin_popcountll(a[i] & b[i]);
+    return count;
+}
+
+static StringId format_of(StringId path) {
+    // There are only ever a handful, so they're looked up here before going to the string pool
+    static std::vector<std::pair<std::string, StringId>> formats;
+    auto p = pool_view(path);
+    auto dot = p.rfind('.');
+    if (dot == std::string_view::npos || p.find('/', dot) != std::string_view::npos)
+        return 0;
+    std::string extension(p.substr(dot + 1));
+    for (auto &c: extension)
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+    for (auto &format: formats)
+        if (format.first == extension)
+            return format.second;
+    formats.emplace_back(extension, intern(extension));
+    return formats.back().second;
+}
+
+static uint32_t key_of(Facet facet, const Track &t) {
+    switch (facet) {
+        case FACET_GENRE:
+            return t.genre;
+        case FACET_DECADE:
+            return t.year / 10 * 10;
+        case FACET_ARTIST:
+            return t.artist;
+        case FACET_FORMAT:
+            return format_of(t.path);
+        default:
+            return 0;
+    }
+}
+
+static void update_selection() {
+    uint64_t stamp = stamp_of(-1, -1);
+    if (selection_stamp == stamp)
+        return;
+    selection_stamp = stamp;
+    selecting = false;
+    selection = live;
+    for (int f = 0; f < FACET_COUNT; f++) {
+        auto &index = facets[f];
+        uint64_t allowed_stamp = stamp_of(f, -1);
+        if (index.allowed_stamp != allowed_stamp) {
+            index.allowed_stamp = allowed_stamp;
+            index.allowed.assign(live.size(), 0);
+            index.restricts = false;
+            for (uint32_t slot = 0; slot < index.keys.size(); slot++) {
+                if (!index.selected[slot])
+                    continue;
+                set_or_into(index.sets[slot], &index.allowed);
+                index.restricts = true;
+            }
+        }
+        if (index.restricts) {
+            and_into(&selection, index.allowed);
+            selecting = true;
+        }
+    }
+}
+
+static void count_values(Facet facet) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    // A value's count doesn't depend on its own facet's selection, only on the others'
+    auto &index = facets[facet];
+    uint64_t stamp = stamp_of(-1, facet);
+    if (index.counted_stamp == stamp)
+        return;
+    index.counted_stamp = stamp;
+    update_selection();
+    index.counts.assign(index.keys.size(), 0);
+
+    Bitset base = live;
+    bool others = false;
+    for (int f = 0; f < FACET_COUNT; f++) {
+        if (f == facet || !facets[f].restricts)
+            continue;
+        and_into(&base, facets[f].allowed);
+        others = true;
+    }
+    if (!others) {
+        for (uint32_t slot = 0; slot < index.keys.size(); slot++)
+            index.counts[slot] = index.sets[slot].count;
+        return;
+    }
+
+    // Whichever is less work: intersecting every value with what's let through, or going through the songs that
+    // are and counting each one towards its value (a narrow selection makes that next to nothing)
+    size_t intersect_work = 0;
+    for (auto &set: index.sets)
+        intersect_work += set.bits.empty() ? set.ids.size() : set.bits.size();
+    size_t left = popcount(base);
+    if (base.size() + left < intersect_work) {
+        uint32_t *counts = index.counts.data();
+        const uint32_t *slots = index.slot_of_track.data();
+        for (size_t i = 0; i < base.size(); i++)
+            for (uint64_t word = base[i]; word; word &= word - 1)
+                counts[slots[i * 64 + __builtin_ctzll(word)]]++;
+    } else {
+        for (uint32_t slot = 0; slot < index.keys.size(); slot++)
+            index.counts[slot] = set_count_in(index.sets[slot], base);
+    }
+}
+
+std::vector<FacetValue> facet_values(Facet facet, size_t most) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    count_values(facet);
+    auto &index = facets[facet];
+    std::vector<FacetValue> values;
+    values.reserve(index.keys.size());
+    for (uint32_t slot = 0; slot < index.keys.size(); slot++) {
+        if (index.counts[slot] == 0 && !index.selected[slot])
+            continue;
+        FacetValue value;
+        value.key = index.keys[slot];
+        value.count = index.counts[slot];
+        value.selected = index.selected[slot];
+        values.push_back(value);
+    }
+    // There can be tens of thousands of artists, so only the ones that make the cut get sorted by name
+    if (values.size() > most) {
+        auto makes_the_cut = [](const FacetValue &a, const FacetValue &b) {
+            if (a.selected != b.selected)
+                return a.selected;
+            if (a.count != b.count)
+                return a.count > b.count;
+            return a.key < b.key;
+        };
+        std::nth_element(values.begin(), values.begin() + most, values.end(), makes_the_cut);
+        values.resize(most);
+    }
+    if (facet == FACET_DECADE) {
+        // Oldest first reads better than biggest first
+        std::sort(values.begin(), values.end(), [](const FacetValue &a, const FacetValue &b) {
+            return a.key < b.key;
+        });
+    } else {
+        std::sort(values.begin(), values.end(), [](const FacetValue &a, const FacetValue &b) {
+            if (a.count != b.count)
+                return a.count > b.count;
+            return pool_view(a.key) < pool_view(b.key);
+        });
+    }
+    return values;
+}
+
+std::string facet_value_name(Facet facet, uint32_t key) {
+    if (key == 0)
+        return "Unknown";
+    if (facet == FACET_DECADE)
+        return std::to_string(key) + "s";
+    auto name = pool_string(key);
+    if (facet == FACET_FORMAT)
+        for (auto &c: name)
+            if (c >= 'a' && c <= 'z')
+                c -= 'a' - 'A';
+    return name;
+}
+
+const char *facet_title(Facet facet) {
+    static const char *titles[FACET_COUNT] = {"Genre", "Decade", "Artist", "Format"};
+    return facet < FACET_COUNT ? titles[facet] : "";
+}
+
+void facet_toggle(Facet facet, uint32_t key) {
+    auto &index = facets[facet];
+    auto it = index.slot_of_key.find(key);
+    if (it == index.slot_of_key.end())
+        return;
+    index.selected[it->second] = !index.selected[it->second];
+    index.picks_version++;
+    version++;
+}
+
+void facet_clear_selection() {
+    for (auto &index: facets) {
+        std::fill(index.selected.begin(), index.selected.end(), false);
+        index.picks_version++;
+    }
+    version++;
+}
+
+bool facets_selecting() {
+    update_selection();
+    return selecting;
+}
+
+bool facet_selection_has(TrackId id) {
+    update_selection();
+    return !selecting || has_bit(selection, id);
+}
+
+uint64_t facets_version() {
+    return version;
+}
+
+void facets_add(TrackId id) {
+    if (has_bit(live, id))
+        facets_remove(id);
+    auto &t = catalog_track(id);
+    size_t universe = catalog_track_count();
+    for (int f = 0; f < FACET_COUNT; f++) {
+        auto &index = facets[f];
+        uint32_t key = key_of((Facet) f, t);
+        auto slot = index.slot_of_key.try_emplace(key, index.keys.size());
+        if (slot.second) {
+            index.keys.push_back(key);
+            index.sets.emplace_back();
+            index.selected.push_back(false);
+        }
+        if (id >= index.slot_of_track.size())
+            index.slot_of_track.resize(std::max<size_t>(id + 1, universe), NO_SLOT);
+        index.slot_of_track[id] = slot.first->second;
+        set_add(&index.sets[slot.first->second], id, universe);
+    }
+    set_bit(&live, id);
+    songs_version++;
+    version++;
+}
+
+void facets_remove(TrackId id) {
+    if (!has_bit(live, id))
+        return;
+    for (auto &index: facets) {
+        set_remove(&index.sets[index.slot_of_track[id]], id);
+        index.slot_of_track[id] = NO_SLOT;
+    }
+    clear_bit(&live, id);
+    songs_version++;
+    version++;
+}
+
+void facets_clear() {
+    for (auto &index: facets) {
+        // Stamps have to keep going up
+        uint64_t picks_version = index.picks_version;
+        index = FacetIndex();
+        index.picks_version = picks_version;
+    }
+    live.clear();
+    songs_version++;
+    version++;
+}
@@ -0,0 +1,63 @@
+/* date = October 19th 2026 10:15 pm */
+
+#ifndef FACETS_H
+#define FACETS_H
+
+#include "catalog.h"
+#include <string>
+#include <vector>
+
+// The songs tab's sidebar: the library split up by genre, decade, artist and file format, each value keeping the
+// set of songs that have it (a sorted array of ids while it's small, a bitset over every id once that's smaller).
+// Picking values narrows the songs down: values of the same facet are OR'ed, facets are AND'ed, and each count says
+// how many songs that value has among what the other facets let through. The catalog keeps the sets up to date as
+// songs come and go, so nothing ever walks the albums or the rows to count. Only touched from the main thread.
+
+enum Facet {
+    FACET_GENRE,
+    FACET_DECADE,
+    FACET_ARTIST,
+    FACET_FORMAT,
+    FACET_COUNT,
+};
+
+struct FacetValue {
+    // The StringId of the genre or artist, the first year of the decade, the StringId of the lowercased file
+    // extension. 0 is for the songs that don't have one.
+    uint32_t key = 0;
+    uint32_t count = 0;
+    bool selected = false;
+};
+
+// How many values of a facet the sidebar lists
+#define FACET_SIDEBAR_VALUES 50
+
+// The 'most' values of 'facet' with the most songs among what the other facets let through, and the selected ones
+// even if they have none, biggest first (decades oldest first)
+std::vector<FacetValue> facet_values(Facet facet, size_t most);
+
+std::string facet_value_name(Facet facet, uint32_t key);
+
+const char *facet_title(Facet facet);
+
+void facet_toggle(Facet facet, uint32_t key);
+
+void facet_clear_selection();
+
+// Whether anything is picked at all
+bool facets_selecting();
+
+// Whether the song is let through by what's picked (every song is when nothing is)
+bool facet_selection_has(TrackId id);
+
+// Bumped whenever a count or the selection might have changed
+uint64_t facets_version();
+
+// Kept up to date by the catalog, like the search index
+void facets_add(TrackId id);
+
+void facets_remove(TrackId id);
+
+void facets_clear();
+
+#endif //FACETS_H
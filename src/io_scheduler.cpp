@@ -0,0 +1,137 @@
+
+#include "io_scheduler.h"
+#include <algorithm>
+#include <cmath>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Not in glibc's headers
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+// Reads are timed in windows of at least this many before the limit moves
+#define MIN_WINDOW 8
+
+void lower_thread_priority() {
+    pid_t tid = syscall(SYS_gettid);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, tid, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+    setpriority(PRIO_PROCESS, tid, 10);
+}
+
+IoScheduler::IoScheduler(int max_in_flight) : max_in_flight(std::max(1, max_in_flight)) {
+    for (int i = 0; i < this->max_in_flight; i++)
+        workers.emplace_back([this] { worker(); });
+}
+
+IoScheduler::~IoScheduler() {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        stop = true;
+    }
+    condition.notify_all();
+    for (auto &w: workers)
+        w.join();
+}
+
+void IoScheduler::submit(dev_t device, uint64_t inode, std::function<void()> work) {
+    {
+        std::lock_guard<std::mutex> guard(mutex);
+        devices[device].waiting.emplace(inode, std::move(work));
+    }
+    condition.notify_one();
+}
+
+bool IoScheduler::next(dev_t *device, std::function<void()> *work) {
+    auto it = devices.upper_bound(last_device);
+    for (size_t i = 0; i < devices.size(); i++, ++it) {
+        if (it == devices.end())
+            it = devices.begin();
+        auto &d = it->second;
+        if (d.waiting.empty() || d.in_flight >= (int) d.limit)
+            continue;
+        
+        // Carry on upwards from the last inode, and only go back to the start once the top is reached
+        auto job = d.waiting.lower_bound(d.last_inode);
+        if (job == d.waiting.end())
+            job = d.waiting.begin();
+        d.last_inode = job->first;
+        *work = std::move(job->second);
+        d.waiting.erase(job);
+        d.in_flight++;
+        if (!d.started) {
+            d.started = true;
+            d.first_start = std::chrono::steady_clock::now();
+        }
+        *device = it->first;
+        last_device = it->first;
+        return true;
+    }
+    return false;
+}
+
+void IoScheduler::finished(dev_t device, double latency) {
+    auto &d = devices[device];
+    d.in_flight--;
+    d.completed++;
+    d.total_latency += latency;
+    d.last_end = std::chrono::steady_clock::now();
+    d.window_count++;
+    d.window_latency += latency;
+    if (d.window_count < std::max(MIN_WINDOW, (int) d.limit * 2))
+        return;
+
+    // Reads taking twice as long as they can means they're queueing inside the device, so the limit shrinks
+    // towards what it actually serves at once (plus a little queue so it never sits idle)
+    double average = d.window_latency / d.window_count;
+    if (d.min_latency == 0 || average < d.min_latency)
+        d.min_latency = average;
+    double gradient = std::clamp(d.min_latency / average, 0.5, 1.0);
+    double target = d.limit * gradient + std::sqrt(d.limit);
+    d.limit = std::clamp(d.limit * 0.8 + target * 0.2, 1.0, (double) max_in_flight);
+    d.window_count = 0;
+    d.window_latency = 0;
+}
+
+void IoScheduler::worker() {
+    lower_thread_priority();
+    while (true) {
+        dev_t device;
+        std::function<void()> work;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!next(&device, &work)) {
+                bool waiting = false;
+                for (auto &d: devices)
+                    waiting = waiting || !d.second.waiting.empty();
+                if (stop && !waiting)
+                    return;
+                condition.wait(lock);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        work();
+        double latency = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            finished(device, latency);
+        }
+        condition.notify_all();
+    }
+}
+
+std::vector<IoScheduler::DeviceStats> IoScheduler::stats() {
+    std::lock_guard<std::mutex> guard(mutex);
+    std::vector<DeviceStats> result;
+    for (auto &[device, d]: devices) {
+        if (d.completed == 0)
+            continue;
+        double seconds = std::chrono::duration<double>(d.last_end - d.first_start).count();
+        result.push_back({device, d.completed, (int) d.limit,
+                          seconds > 0 ? d.completed / seconds : 0, d.total_latency / d.completed * 1000});
+    }
+    return result;
+}
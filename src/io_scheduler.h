@@ -0,0 +1,76 @@
+/* date = October 19th 2026 5:40 pm */
+
+#ifndef IO_SCHEDULER_H
+#define IO_SCHEDULER_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+// Reads files with however many in flight each device keeps up with. A USB disk or NFS share slows down
+// (every read waits longer) when it's given more than a couple at once, while an SSD just gets faster until
+// the CPU runs out, so the limit of every device follows how long its reads take compared to the fastest
+// they've been. Waiting work is handed out in inode order so a spinning disk mostly moves in one direction.
+class IoScheduler {
+public:
+    struct DeviceStats {
+        dev_t device;
+        long completed;
+        int limit; // where it ended up
+        double files_per_second;
+        double average_ms;
+    };
+
+    explicit IoScheduler(int max_in_flight);
+
+    // Waits for everything that was submitted
+    ~IoScheduler();
+
+    void submit(dev_t device, uint64_t inode, std::function<void()> work);
+
+    std::vector<DeviceStats> stats();
+
+private:
+    struct Device {
+        std::multimap<uint64_t, std::function<void()>> waiting; // by inode
+        uint64_t last_inode = 0;
+        int in_flight = 0;
+        double limit = 2;
+        long completed = 0;
+        double total_latency = 0;
+        std::chrono::steady_clock::time_point first_start;
+        std::chrono::steady_clock::time_point last_end;
+        bool started = false;
+
+        // The window the limit is re-thought after
+        int window_count = 0;
+        double window_latency = 0;
+        double min_latency = 0;
+    };
+
+    void worker();
+
+    // With the mutex held
+    bool next(dev_t *device, std::function<void()> *work);
+
+    void finished(dev_t device, double latency);
+
+    std::vector<std::thread> workers;
+    std::map<dev_t, Device> devices;
+    dev_t last_device = 0; // devices take turns
+    std::mutex mutex;
+    std::condition_variable condition;
+    int max_in_flight;
+    bool stop = false;
+};
+
+// Idle I/O class and a higher nice value for the calling thread, so the audio threads always come first
+void lower_thread_priority();
+
+#endif //IO_SCHEDULER_H
@@ -0,0 +1,687 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "library.h"
+#include "library_cache.h"
+#include "catalog.h"
+#include "collate.h"
+#include "rt_log.h"
+#include "io_scheduler.h"
+#include "walker.h"
+#include <filesystem>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <taglib/fileref.h>
+#include <taglib/tag.h>
+#include <taglib/mpegfile.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/flacfile.h>
+#include <taglib/xiphcomment.h>
+#include <taglib/mp4file.h>
+#include <taglib/mp4tag.h>
+#include <taglib/tfilestream.h>
+#include <taglib/tpropertymap.h>
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <condition_variable>
+
+// What the files of the catalog's songs looked like, by TrackId (a zero path for the ones not in the library anymore)
+static std::mutex stamps_mutex;
+static std::vector<SongStamp> cached_stamps;
+static bool stamps_dirty = false; // since the cache was last written
+
+// The scanner's form of a song, out of its interned one
+static Option option_of(const Track &t, const SongStamp &stamp) {
+    Option o;
+    o.full = pool_string(t.path);
+    o.name = pool_string(t.title);
+    o.artist = pool_string(t.artist);
+    o.album = pool_string(t.album);
+    o.genre = pool_string(t.genre);
+    o.year = std::to_string(t.year);
+    o.length = std::to_string(t.length);
+    o.track = std::to_string(t.track);
+    o.disc = std::to_string(t.disc);
+    if (t.title_key != t.title)
+        o.title_key = pool_string(t.title_key);
+    if (t.artist_key != t.artist)
+        o.artist_key = pool_string(t.artist_key);
+    if (t.album_key != t.album)
+        o.album_key = pool_string(t.album_key);
+    if (t.genre_key != t.genre)
+        o.genre_key = pool_string(t.genre_key);
+    o.size = stamp.size;
+    o.mtime = stamp.mtime;
+    o.inode = stamp.inode;
+    o.has_art = stamp.has_art;
+    return o;
+}
+
+bool cached_song(const std::string &path, Option *option) {
+    StringId id = pool_find(path);
+    if (id == 0)
+        return false;
+    TrackId track_id = catalog_find(id);
+    SongStamp stamp;
+    {
+        std::lock_guard<std::mutex> guard(stamps_mutex);
+        if (track_id >= cached_stamps.size() || cached_stamps[track_id].path == 0)
+            return false;
+        stamp = cached_stamps[track_id];
+    }
+    Track track;
+    if (!catalog_track_copy(track_id, &track))
+        return false;
+    *option = option_of(track, stamp);
+    return true;
+}
+
+void set_cached_songs(const std::vector<SongStamp> &loaded) {
+    std::lock_guard<std::mutex> guard(stamps_mutex);
+    cached_stamps = loaded;
+    stamps_dirty = false;
+}
+
+static void fill_collation_key(const std::string &s, std::string *key) {
+    if (is_collation_key(s))
+        key->clear();
+    else
+        *key = collation_key(s);
+}
+
+static void fill_collation_keys(Option *o) {
+    fill_collation_key(o->name, &o->title_key);
+    fill_collation_key(o->artist, &o->artist_key);
+    fill_collation_key(o->album, &o->album_key);
+    fill_collation_key(o->genre, &o->genre_key);
+}
+
+// Adds the albums of 'options', which were appended to the tracks from 'first' on, for caches that didn't have them (or
+// not in order)
+static void index_loaded_albums(const std::vector<Option> &options, size_t first, std::vector<AlbumEntry> *albums) {
+    for (auto &a: index_albums(options)) {
+        for (auto &s: a.songs)
+            s += first;
+        a.art += first;
+        albums->push_back(std::move(a));
+    }
+}
+
+static SongStamp stamp_of(const Option &o, StringId path) {
+    SongStamp stamp;
+    stamp.path = path;
+    stamp.size = o.size;
+    stamp.mtime = o.mtime;
+    stamp.inode = o.inode;
+    stamp.has_art = o.has_art;
+    return stamp;
+}
+
+static void append_options(const std::vector<Option> &options, std::vector<Track> &tracks,
+                           std::vector<SongStamp> &stamps) {
+    tracks.reserve(tracks.size() + options.size());
+    stamps.reserve(stamps.size() + options.size());
+    for (auto &o: options) {
+        tracks.push_back(make_track(o));
+        stamps.push_back(stamp_of(o, tracks.back().path));
+    }
+}
+
+// Caches from before the collation keys (or the album index) are read into Options, which get their keys worked out
+// and their albums put in the order comes_before wants. They're rewritten in the current layout at the next save.
+static void load_old_cache(const MappedCache &cache, std::vector<Option> &options) {
+    options.reserve(cache.count());
+    for (uint32_t i = 0; i < cache.count(); i++) {
+        auto &r = cache.record(i);
+        Option o;
+        o.full = cache.string(r.path);
+        o.name = cache.string(r.title);
+        o.artist = cache.string(r.artist);
+        o.album = cache.string(r.album);
+        o.genre = cache.string(r.genre);
+        o.year = cache.string(r.year);
+        o.length = cache.string(r.length);
+        o.track = cache.string(r.track);
+        o.disc = cache.string(r.disc);
+        o.size = r.size;
+        o.mtime = r.mtime;
+        o.inode = r.inode;
+        o.has_art = r.flags & CACHE_HAS_ART;
+        fill_collation_keys(&o);
+        options.push_back(std::move(o));
+    }
+}
+
+// The numbers are kept as text in the cache (the way the scanner has them)
+static uint32_t number_of(std::string_view s) {
+    uint32_t n = 0;
+    std::from_chars(s.data(), s.data() + s.size(), n);
+    return n;
+}
+
+static StringId key_id(std::string_view key, StringId text) {
+    return key.empty() ? text : intern(key);
+}
+
+void load_from_cache(std::string cache_path, std::vector<Track> &tracks, std::vector<SongStamp> &stamps,
+                     std::vector<AlbumEntry> *albums) {
+#ifdef TRACY_ENABLE
+    ZoneScopedN("From cache");
+#endif
+    size_t first = tracks.size();
+    if (is_text_library_cache(cache_path)) {
+        std::vector<Option> options;
+        read_text_library_cache(cache_path, options);
+        for (auto &o: options)
+            fill_collation_keys(&o);
+        if (write_library_cache(cache_path, options))
+            rt_log(RT_INFO, "Migrated %zu songs from the text cache to the binary one", options.size());
+        append_options(options, tracks, stamps);
+        if (albums)
+            index_loaded_albums(options, first, albums);
+        return;
+    }
+    
+    MappedCache cache;
+    if (!map_library_cache(cache_path, &cache))
+        return;
+    if (!cache.has_keys() || !cache.albums) {
+        std::vector<Option> options;
+        load_old_cache(cache, options);
+        append_options(options, tracks, stamps);
+        if (albums)
+            index_loaded_albums(options, first, albums);
+        unmap_library_cache(&cache);
+        return;
+    }
+    
+    // Every string goes from the mapped file into the pool as is, without being copied anywhere on the way
+    tracks.reserve(tracks.size() + cache.count());
+    stamps.reserve(stamps.size() + cache.count());
+    for (uint32_t i = 0; i < cache.count(); i++) {
+        auto &r = cache.record(i);
+        Track t;
+        t.path = intern(cache.string(r.path));
+        t.title = intern(cache.string(r.title));
+        t.artist = intern(cache.string(r.artist));
+        t.album = intern(cache.string(r.album));
+        t.genre = intern(cache.string(r.genre));
+        t.year = number_of(cache.string(r.year));
+        t.length = number_of(cache.string(r.length));
+        t.track = number_of(cache.string(r.track));
+        t.disc = number_of(cache.string(r.disc));
+        t.has_art = r.flags & CACHE_HAS_ART;
+        t.title_key = key_id(cache.string(r.title_key), t.title);
+        t.artist_key = key_id(cache.string(r.artist_key), t.artist);
+        t.album_key = key_id(cache.string(r.album_key), t.album);
+        t.genre_key = key_id(cache.string(r.genre_key), t.genre);
+        tracks.push_back(t);
+        
+        SongStamp stamp;
+        stamp.path = t.path;
+        stamp.size = r.size;
+        stamp.mtime = r.mtime;
+        stamp.inode = r.inode;
+        stamp.has_art = t.has_art;
+        stamps.push_back(stamp);
+    }
+    if (albums) {
+        albums->reserve(albums->size() + cache.album_count());
+        for (uint32_t i = 0; i < cache.album_count(); i++) {
+            auto &c = cache.albums[i];
+            AlbumEntry a;
+            a.name = cache.string(c.name);
+            a.songs.reserve(c.song_count);
+            for (uint32_t s = 0; s < c.song_count; s++)
+                a.songs.push_back(first + cache.album_songs[c.first_song + s]);
+            a.length = c.length;
+            a.year = c.year;
+            a.art = c.art == -1 ? -1 : first + c.art;
+            albums->push_back(std::move(a));
+        }
+    }
+    unmap_library_cache(&cache);
+}
+
+static std::atomic<long> tag_opens{0};
+static std::atomic<long> tag_reads{0};
+static std::atomic<long> tag_seeks{0};
+static std::atomic<long> tag_bytes{0};
+
+// Counts what TagLib asks of each file, so we can see what a scan costs in I/O
+class CountingStream : public TagLib::FileStream {
+public:
+    explicit CountingStream(const char *path) : TagLib::FileStream(path, true) {
+        tag_opens++;
+    }
+    
+    TagLib::ByteVector readBlock(unsigned long length) override {
+        tag_reads++;
+        auto data = TagLib::FileStream::readBlock(length);
+        tag_bytes += data.size();
+        return data;
+    }
+    
+    void seek(long offset, Position p = Beginning) override {
+        tag_seeks++;
+        TagLib::FileStream::seek(offset, p);
+    }
+};
+
+TagIoStats tag_io_stats() {
+    return {tag_opens.load(), tag_reads.load(), tag_seeks.load(), tag_bytes.load()};
+}
+
+static bool has_embedded_art(TagLib::File *file) {
+    if (auto flac = dynamic_cast<TagLib::FLAC::File *>(file)) {
+        if (!flac->pictureList().isEmpty())
+            return true;
+        return flac->hasID3v2Tag() && !flac->ID3v2Tag()->frameListMap()["APIC"].isEmpty();
+    }
+    if (auto mpeg = dynamic_cast<TagLib::MPEG::File *>(file))
+        return mpeg->hasID3v2Tag() && !mpeg->ID3v2Tag()->frameListMap()["APIC"].isEmpty();
+    if (auto mp4 = dynamic_cast<TagLib::MP4::File *>(file))
+        return mp4->tag() && mp4->tag()->contains("covr");
+    if (auto xiph = dynamic_cast<TagLib::Ogg::XiphComment *>(file->tag()))
+        return !xiph->pictureList().isEmpty();
+    return false;
+}
+
+// Everything comes out of a single open of the file: TagLib picks the format, and the disc number and art are
+// read from the same parsed tags
+static Option read_tags(const std::string &full_path) {
+    Option o;
+    CountingStream stream(full_path.c_str());
+    if (!stream.isOpen())
+        return o;
+    TagLib::FileRef tag_file(&stream);
+    if (tag_file.isNull()) {
+       return o;   
+    }
+    TagLib::Tag *tag = tag_file.tag();
+    if (tag) {
+        o.full = full_path;
+        o.name = tag->title().to8Bit(true);  // Convert to std::string
+        if (o.name.empty()) {
+            o.name = std::filesystem::path(full_path).filename().string();
+        }
+        o.artist = tag->artist().to8Bit(true);  // Convert to std::string
+        o.album = tag->album().to8Bit(true);  // Convert to std::string
+        o.genre = tag->genre().to8Bit(true);  // Convert to std::string
+        o.year = std::to_string((int) tag->year());  // Convert to std::string
+        o.track = std::to_string((int) tag->track());  // Convert to std::string
+        
+        // ID3 TPOS, Xiph DISCNUMBER and MP4 disk all show up as DISCNUMBER ("1" or "1/2")
+        auto properties = tag_file.file()->properties();
+        auto disc = properties.find("DISCNUMBER");
+        int disc_number = 0;
+        if (disc != properties.end() && !disc->second.isEmpty())
+            disc_number = std::atoi(disc->second.front().toCString());
+        o.disc = std::to_string(disc_number);
+        o.has_art = has_embedded_art(tag_file.file());
+    }
+    
+    TagLib::AudioProperties *properties = tag_file.audioProperties();
+    if (properties) {
+       o.length = std::to_string(properties->length());
+    }
+    fill_collation_keys(&o);
+    return o;
+}
+
+// A save can still be writing when the next one starts, and the cache is written whole
+static std::mutex write_cache_mutex;
+
+static bool has_audio_extension(const std::string &path) {
+    static std::unordered_set<std::string> extensions = [] {
+        std::unordered_set<std::string> result;
+        for (auto &e: TagLib::FileRef::defaultFileExtensions())
+            result.insert(e.to8Bit());
+        return result;
+    }();
+    auto dot = path.find_last_of('.');
+    if (dot == std::string::npos)
+        return false;
+    std::string extension = path.substr(dot + 1);
+    for (auto &c: extension)
+        c = std::tolower((unsigned char) c);
+    return extensions.count(extension) > 0;
+}
+
+Track make_track(const Option &o) {
+    Track t;
+    t.path = intern(o.full);
+    t.title = intern(o.name);
+    t.artist = intern(o.artist);
+    t.album = intern(o.album);
+    t.genre = intern(o.genre);
+    t.year = std::atoi(o.year.c_str());
+    t.track = std::atoi(o.track.c_str());
+    t.disc = std::atoi(o.disc.c_str());
+    t.length = std::atoi(o.length.c_str());
+    t.has_art = o.has_art;
+    t.title_key = key_id(o.title_key, t.title);
+    t.artist_key = key_id(o.artist_key, t.artist);
+    t.album_key = key_id(o.album_key, t.album);
+    t.genre_key = key_id(o.genre_key, t.genre);
+    return t;
+}
+
+bool comes_before(const Track &a, const Track &b) {
+    if (a.album == 0) {
+        return false;
+    }
+    if (b.album == 0) {
+        return true;
+    }
+    if (a.album == b.album) {
+        if (a.disc == b.disc) {
+            return a.track < b.track;
+        } else {
+            return a.disc < b.disc;
+        }
+    } else if (a.album_key != b.album_key) {
+        return pool_view(a.album_key) < pool_view(b.album_key);
+    } else {
+        return pool_view(a.album) < pool_view(b.album);
+    }
+}
+
+bool is_audio_file(const std::string &path) {
+    return has_audio_extension(path);
+}
+
+Option read_song(const std::string &path) {
+    struct stat st{};
+    if (!has_audio_extension(path) || stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+        return Option();
+    
+    Option o;
+    if (cached_song(path, &o) && o.size == (uint64_t) st.st_size && o.inode == st.st_ino &&
+        o.mtime == (int64_t) st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec) {
+        return o;
+    }
+    o = read_tags(path);
+    o.size = st.st_size;
+    o.mtime = (int64_t) st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+    o.inode = st.st_ino;
+    return o;
+}
+
+std::vector<std::string> cached_songs_under(const std::string &directory) {
+    std::string prefix = directory;
+    if (prefix.empty() || prefix.back() != '/')
+        prefix += '/';
+    std::vector<std::string> paths;
+    std::lock_guard<std::mutex> guard(stamps_mutex);
+    for (auto &stamp: cached_stamps) {
+        auto path = pool_view(stamp.path);
+        if (stamp.path != 0 && path.compare(0, prefix.size(), prefix) == 0)
+            paths.emplace_back(path);
+    }
+    return paths;
+}
+
+static void write_cached_songs(const std::string &cache_path) {
+    // The newest songs are taken once it's our turn, so whichever write finishes last has them all
+    std::lock_guard<std::mutex> write_guard(write_cache_mutex);
+    std::vector<Option> options;
+    {
+        std::lock_guard<std::mutex> guard(stamps_mutex);
+        if (!stamps_dirty)
+            return;
+        stamps_dirty = false;
+        options.reserve(cached_stamps.size());
+        Track track;
+        for (TrackId id = 0; id < cached_stamps.size(); id++)
+            if (cached_stamps[id].path != 0 && catalog_track_copy(id, &track))
+                options.push_back(option_of(track, cached_stamps[id]));
+    }
+    write_library_cache(cache_path, options);
+}
+
+void library_apply_changes(const std::vector<Option> &changed, const std::vector<std::string> &removed) {
+    std::vector<std::pair<TrackId, SongStamp>> updates;
+    for (auto &path: removed) {
+        TrackId id = catalog_find(pool_find(path));
+        if (id != NO_TRACK)
+            updates.push_back({id, SongStamp()});
+    }
+    for (auto &o: changed) {
+        StringId path = pool_find(o.full);
+        TrackId id = catalog_find(path);
+        if (id != NO_TRACK)
+            updates.push_back({id, {path, o.size, o.mtime, o.inode, o.has_art}});
+    }
+    if (updates.empty())
+        return;
+    std::lock_guard<std::mutex> guard(stamps_mutex);
+    for (auto &update: updates) {
+        if (update.first >= cached_stamps.size())
+            cached_stamps.resize(update.first + 1);
+        cached_stamps[update.first] = update.second;
+    }
+    stamps_dirty = true;
+}
+
+void library_save(const std::string &cache_path) {
+    write_cached_songs(cache_path);
+}
+
+// Songs are handed over at least this often while tags are being read, so rows show up as they're found
+#define SCAN_BATCH_MS 250
+#define SCAN_BATCH_SIZE 2000
+// A first scan that gets interrupted resumes from the last checkpoint instead of starting over
+#define SCAN_CHECKPOINT_MS 5000
+
+static std::atomic<long> scan_found{0};
+static std::atomic<long> scan_done{0};
+static std::atomic<bool> scan_running{false};
+
+ScanProgress library_scan_progress() {
+    return {scan_found.load(), scan_done.load(), scan_running.load()};
+}
+
+void library_checkpoint(const std::string &cache_path) {
+    static auto last_save = std::chrono::steady_clock::time_point();
+    {
+        std::lock_guard<std::mutex> guard(stamps_mutex);
+        if (!stamps_dirty)
+            return;
+    }
+    auto now = std::chrono::steady_clock::now();
+    if (scan_running && now - last_save < std::chrono::milliseconds(SCAN_CHECKPOINT_MS))
+        return;
+    last_save = now;
+    std::thread([cache_path] { write_cached_songs(cache_path); }).detach();
+}
+
+struct FileStamp {
+    uint64_t size;
+    int64_t mtime;
+    uint64_t inode;
+};
+
+// Files whose size, mtime and inode match the cached songs are kept without reading their tags again
+static void scan_thread(std::string path_to_search, ScanCallback on_batch, ScanStats *stats) {
+    auto start = std::chrono::steady_clock::now();
+    auto io_before = tag_io_stats();
+
+    // The paths point into the string pool, which never lets go of them
+    std::unordered_map<std::string_view, FileStamp> known;
+    {
+        std::lock_guard<std::mutex> guard(stamps_mutex);
+        known.reserve(cached_stamps.size());
+        for (auto &stamp: cached_stamps)
+            if (stamp.path != 0)
+                known[pool_view(stamp.path)] = {stamp.size, stamp.mtime, stamp.inode};
+    }
+    
+    // Finished songs, filled in by the scheduler's threads (declared first so they outlive them)
+    std::mutex finished_mutex;
+    std::condition_variable finished_cv;
+    std::vector<Option> finished;
+    // Files whose tags couldn't be read (truncated, corrupted), which are handed on as removed so an old copy of the
+    // song doesn't stay in the library with a stamp that has it read again on every scan
+    std::vector<std::string> unreadable;
+    long submitted = 0; // and not yet taken out of 'finished' or 'unreadable'
+    bool walk_done = false;
+    
+    unsigned int threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 8;
+    IoScheduler scheduler(threads);
+    
+    // Called from the walking threads with a directory's songs at a time
+    std::mutex known_mutex;
+    std::atomic<long> files_stated{0};
+    std::atomic<long> files_tagged{0};
+    auto on_files = [&](std::vector<WalkEntry> &files) {
+        files_stated += files.size();
+        std::vector<WalkEntry *> changed;
+        {
+            std::lock_guard<std::mutex> guard(known_mutex);
+            for (auto &f: files) {
+                auto it = known.find(f.path);
+                if (it != known.end()) {
+                    auto &stamp = it->second;
+                    bool unchanged = stamp.size == f.size && stamp.mtime == f.mtime && stamp.inode == f.inode;
+                    known.erase(it);
+                    if (unchanged)
+                        continue;
+                }
+                changed.push_back(&f);
+            }
+        }
+        if (changed.empty())
+            return;
+        
+        files_tagged += changed.size();
+        scan_found += changed.size();
+        {
+            std::lock_guard<std::mutex> guard(finished_mutex);
+            submitted += changed.size();
+        }
+        for (auto f: changed) {
+            scheduler.submit(f->device, f->inode, [&, f = *f] {
+                Option o = read_tags(f.path);
+                o.size = f.size;
+                o.mtime = f.mtime;
+                o.inode = f.inode;
+                {
+                    std::lock_guard<std::mutex> guard(finished_mutex);
+                    if (o.full.empty())
+                        unreadable.push_back(f.path);
+                    else
+                        finished.push_back(std::move(o));
+                }
+                finished_cv.notify_one();
+            });
+        }
+    };
+    
+    // The walk fans out over its own threads, and tags are read as soon as a directory's songs are known
+    std::thread walker([&] {
+        walk_library(path_to_search, std::clamp((int) threads, 4, 16), on_files);
+        {
+            std::lock_guard<std::mutex> guard(finished_mutex);
+            walk_done = true;
+        }
+        finished_cv.notify_one();
+    });
+    
+    // Hands on whatever finished (waiting up to a batch's worth of time for it), false once nothing is left
+    auto drain = [&]() {
+        std::vector<Option> batch;
+        std::vector<std::string> failed;
+        bool more;
+        {
+            std::unique_lock<std::mutex> lock(finished_mutex);
+            finished_cv.wait_for(lock, std::chrono::milliseconds(SCAN_BATCH_MS), [&] {
+                long ready = finished.size() + unreadable.size();
+                return ready >= SCAN_BATCH_SIZE || (walk_done && ready == submitted);
+            });
+            batch.swap(finished);
+            failed.swap(unreadable);
+            submitted -= batch.size() + failed.size();
+            more = !walk_done || submitted > 0;
+        }
+        scan_done += batch.size() + failed.size();
+        if (!batch.empty() || !failed.empty())
+            on_batch(batch, failed);
+        return more;
+    };
+    try {
+        while (drain());
+    } catch (...) {
+        // The walk still points at everything in here, so it has to be through before the exception unwinds it
+        walker.join();
+        throw;
+    }
+    walker.join();
+    stats->files_stated = files_stated;
+    stats->files_tagged = files_tagged;
+    
+    for (auto &d: scheduler.stats()) {
+        rt_log(RT_INFO, "Library scan: device %u:%u read %ld files at %.0f/s, %.1f ms each, settled on %d at once",
+               major(d.device), minor(d.device), d.completed, d.files_per_second, d.average_ms, d.limit);
+    }
+    
+    // Whatever is left in 'known' wasn't found on disk anymore
+    std::vector<std::string> removed;
+    for (auto &k: known)
+        removed.emplace_back(k.first);
+    stats->files_removed = removed.size();
+    if (!removed.empty())
+        on_batch({}, removed);
+    
+    auto io_after = tag_io_stats();
+    stats->files_opened = io_after.opens - io_before.opens;
+    stats->reads = io_after.reads - io_before.reads;
+    stats->seeks = io_after.seeks - io_before.seeks;
+    stats->bytes_read = io_after.bytes - io_before.bytes;
+    stats->wall_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+static std::string album_art_directory() {
+    char *home = getenv("HOME");
+    std::string lfp_album_art(home);
+    lfp_album_art += "/.cache";
+    mkdir(lfp_album_art.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    lfp_album_art += "/lfp_album_art";
+    mkdir(lfp_album_art.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    return lfp_album_art;
+}
+
+void scan_library(std::string path_to_search, ScanCallback on_batch) {
+    if (scan_running.exchange(true))
+        return;
+    album_art_directory();
+    scan_found = 0;
+    scan_done = 0;
+    
+    std::thread t([path_to_search, on_batch]() {
+        lower_thread_priority();
+        ScanStats stats;
+        try {
+            scan_thread(path_to_search, on_batch, &stats);
+            rt_log(RT_INFO, "Library scan: %ld files stat'ed, %ld tagged, %ld removed in %ld ms (%ld opens, %ld reads, %ld seeks, %ld KB)",
+                   stats.files_stated, stats.files_tagged, stats.files_removed, stats.wall_ms,
+                   stats.files_opened, stats.reads, stats.seeks, stats.bytes_read / 1024);
+        } catch (const std::exception &e) {
+            // What was found so far is still good, the next start picks up from there
+            rt_log(RT_ERROR, "Library scan failed: %s", e.what());
+        }
+        scan_running = false;
+        on_batch({}, {}); // So the progress can be taken down
+    });
+    t.detach();
+}
@@ -0,0 +1,88 @@
+/* date = October 19th 2026 12:20 pm */
+
+#ifndef LIBRARY_H
+#define LIBRARY_H
+
+#include "track.h"
+#include <string>
+#include <vector>
+
+struct ScanStats {
+    long files_stated = 0;
+    long files_tagged = 0; // new or changed files which had their tags read
+    long files_removed = 0;
+    long wall_ms = 0;
+    
+    // What reading the tags cost (every file should be opened once)
+    long files_opened = 0;
+    long reads = 0;
+    long seeks = 0;
+    long bytes_read = 0;
+};
+
+// Running totals over everything TagLib has read since startup
+struct TagIoStats {
+    long opens;
+    long reads;
+    long seeks;
+    long bytes;
+};
+
+TagIoStats tag_io_stats();
+
+// Appends the cached songs to 'tracks' (their strings interned straight out of the mapped file) and what their files
+// looked like to 'stamps', and their albums to 'albums' (indices into 'tracks') if asked for
+void load_from_cache(std::string cache_path, std::vector<Track> &tracks, std::vector<SongStamp> &stamps,
+                     std::vector<AlbumEntry> *albums = nullptr);
+
+typedef void (*ScanCallback)(const std::vector<Option> &changed, const std::vector<std::string> &removed);
+
+// Walks 'path_to_search' in the background, only reading tags of files that are new or changed compared to
+// the cached songs, and dropping the ones that disappeared. Songs are handed to 'on_batch' (on the scan thread)
+// a few hundred milliseconds' worth at a time, for the main thread to put into the catalog and library_apply_changes
+// (whose checkpoints let a first scan that gets interrupted resume where it stopped). 'on_batch' is called one last
+// time with nothing when it's done.
+void scan_library(std::string path_to_search, ScanCallback on_batch);
+
+struct ScanProgress {
+    long found; // files that needed their tags read
+    long done;
+    bool running;
+};
+
+ScanProgress library_scan_progress();
+
+// Tags of a library song as read from the cache (safe to call from any thread)
+bool cached_song(const std::string &path, Option *option);
+
+// What the files of the songs just given to catalog_load looked like, by TrackId
+void set_cached_songs(const std::vector<SongStamp> &stamps);
+
+// Whether the extension is one TagLib knows how to read
+bool is_audio_file(const std::string &path);
+
+// Stats and tags one song, re-using the cached tags when the file didn't change ('full' is empty if it isn't a song)
+Option read_song(const std::string &path);
+
+// Paths of the cached songs inside 'directory' (at any depth)
+std::vector<std::string> cached_songs_under(const std::string &directory);
+
+// Records what the files of songs the catalog just took in (or let go of) look like. Main thread only, right after
+// catalog_apply_changes.
+void library_apply_changes(const std::vector<Option> &changed, const std::vector<std::string> &removed);
+
+// Rewrites the cache on a thread of its own if songs changed since it was last written (at most every few seconds
+// while a scan is running). Main thread only.
+void library_checkpoint(const std::string &cache_path);
+
+// Rewrites the cache right away if songs changed since it was last written
+void library_save(const std::string &cache_path);
+
+// Interns the strings of a scanned song into the compact form the views keep
+Track make_track(const Option &o);
+
+// Songs tab order: by album name (its collation key, then the name itself, with the songs without one last), then
+// disc, then track
+bool comes_before(const Track &a, const Track &b);
+
+#endif //LIBRARY_H
@@ -0,0 +1,279 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "library_cache.h"
+#include "rt_log.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
+
+static bool valid_string(const MappedCache *cache, uint32_t offset) {
+    auto size = cache->header->strings_size;
+    if (offset % 4 != 0 || (uint64_t) offset + sizeof(uint32_t) + 1 > size)
+        return false;
+    uint32_t length = *(const uint32_t *) (cache->strings + offset);
+    return (uint64_t) offset + sizeof(uint32_t) + length + 1 <= size &&
+           cache->strings[offset + sizeof(uint32_t) + length] == '\0';
+}
+
+bool map_library_cache(const std::string &path, MappedCache *cache) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    *cache = MappedCache();
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return false;
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t) sizeof(CacheHeader)) {
+        close(fd);
+        return false;
+    }
+    void *base = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return false;
+    madvise(base, st.st_size, MADV_WILLNEED);
+
+    cache->base = base;
+    cache->length = st.st_size;
+    cache->header = (const CacheHeader *) base;
+    auto h = cache->header;
+    bool has_albums = h->version >= 4;
+    bool has_keys = h->version >= 5;
+    bool ok = memcmp(h->magic, LIBRARY_CACHE_MAGIC, 4) == 0 &&
+              h->version >= 3 && h->version <= LIBRARY_CACHE_VERSION &&
+              h->record_size == (has_keys ? sizeof(CacheRecord) : LIBRARY_CACHE_V4_RECORD_SIZE) &&
+              h->records_offset >= (has_albums ? sizeof(CacheHeader) : LIBRARY_CACHE_V3_HEADER_SIZE) &&
+              h->records_offset % alignof(CacheRecord) == 0 &&
+              h->records_offset + (uint64_t) h->record_count * h->record_size <= cache->length &&
+              h->strings_offset % 4 == 0 &&
+              h->strings_offset + h->strings_size <= cache->length;
+    if (ok && has_albums) {
+        ok = h->albums_offset % alignof(CacheAlbum) == 0 &&
+             h->albums_offset + (uint64_t) h->album_count * sizeof(CacheAlbum) <= cache->length &&
+             h->album_songs_offset % 4 == 0 &&
+             h->album_songs_offset + (uint64_t) h->album_song_count * sizeof(uint32_t) <= cache->length;
+    }
+    if (ok) {
+        cache->records = (const char *) base + h->records_offset;
+        cache->strings = (const char *) base + h->strings_offset;
+        for (uint32_t i = 0; ok && i < h->record_count; i++) {
+            auto &r = cache->record(i);
+            ok = valid_string(cache, r.path) && valid_string(cache, r.title) && valid_string(cache, r.artist) &&
+                 valid_string(cache, r.album) && valid_string(cache, r.genre) && valid_string(cache, r.year) &&
+                 valid_string(cache, r.length) && valid_string(cache, r.track) && valid_string(cache, r.disc);
+            if (ok && has_keys)
+                ok = valid_string(cache, r.title_key) && valid_string(cache, r.artist_key) &&
+                     valid_string(cache, r.album_key) && valid_string(cache, r.genre_key);
+        }
+    }
+    if (ok && has_albums) {
+        cache->albums = (const CacheAlbum *) ((const char *) base + h->albums_offset);
+        cache->album_songs = (const uint32_t *) ((const char *) base + h->album_songs_offset);
+        for (uint32_t i = 0; ok && i < h->album_count; i++) {
+            auto &a = cache->albums[i];
+            ok = valid_string(cache, a.name) &&
+                 (uint64_t) a.first_song + a.song_count <= h->album_song_count &&
+                 a.art >= -1 && a.art < (int64_t) h->record_count;
+        }
+        for (uint32_t i = 0; ok && i < h->album_song_count; i++)
+            ok = cache->album_songs[i] < h->record_count;
+    }
+    if (!ok) {
+        if (memcmp(h->magic, LIBRARY_CACHE_MAGIC, 4) == 0)
+            rt_log(RT_WARNING, "Library cache %s is damaged or from another version, ignoring it", path.c_str());
+        unmap_library_cache(cache);
+        return false;
+    }
+    return true;
+}
+
+void unmap_library_cache(MappedCache *cache) {
+    if (cache->base)
+        munmap(cache->base, cache->length);
+    *cache = MappedCache();
+}
+
+bool is_text_library_cache(const std::string &path) {
+    char magic[4] = {};
+    std::ifstream file(path, std::ios::binary);
+    if (!file.read(magic, sizeof(magic)))
+        return file.gcount() > 0;
+    return memcmp(magic, LIBRARY_CACHE_MAGIC, 4) != 0;
+}
+
+void read_text_library_cache(const std::string &path, std::vector<Option> &options) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::ifstream file(path);
+    std::string line;
+    Option o;
+    // Only the start of the line is looked at, so a title with "Album:" in it doesn't get mistaken for a field
+    auto field = [&line](const char *prefix, std::string *value) {
+        size_t length = strlen(prefix);
+        if (line.compare(0, length, prefix) != 0)
+            return false;
+        *value = line.substr(length);
+        return true;
+    };
+    while (std::getline(file, line)) {
+        std::string number;
+        if (field("Path: ", &o.full) || field("Title: ", &o.name) || field("Artist: ", &o.artist) ||
+            field("Album: ", &o.album) || field("Genre: ", &o.genre) || field("Year: ", &o.year) ||
+            field("Length: ", &o.length) || field("Track: ", &o.track)) {
+            continue;
+        } else if (field("Size: ", &number)) {
+            o.size = std::strtoull(number.c_str(), nullptr, 10);
+        } else if (field("Mtime: ", &number)) {
+            o.mtime = std::strtoll(number.c_str(), nullptr, 10);
+        } else if (field("Inode: ", &number)) {
+            o.inode = std::strtoull(number.c_str(), nullptr, 10);
+        } else if (field("Disc: ", &o.disc)) { // Ends the entry
+            options.push_back(o);
+            o = Option();
+        }
+    }
+}
+
+std::vector<AlbumEntry> index_albums(const std::vector<Option> &options) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::vector<AlbumEntry> albums;
+    std::unordered_map<std::string_view, uint32_t> album_of_name;
+    std::vector<std::pair<int, int>> disc_and_track(options.size());
+    for (uint32_t i = 0; i < options.size(); i++) {
+        auto &o = options[i];
+        if (o.full.empty())
+            continue;
+        disc_and_track[i] = {std::atoi(o.disc.c_str()), std::atoi(o.track.c_str())};
+        auto slot = album_of_name.try_emplace(o.album, albums.size());
+        if (slot.second) {
+            albums.emplace_back();
+            albums.back().name = o.album;
+        }
+        albums[slot.first->second].songs.push_back(i);
+    }
+    
+    for (auto &a: albums) {
+        std::stable_sort(a.songs.begin(), a.songs.end(), [&disc_and_track](uint32_t x, uint32_t y) {
+            return disc_and_track[x] < disc_and_track[y];
+        });
+        for (auto s: a.songs) {
+            auto &o = options[s];
+            a.length += std::atoi(o.length.c_str());
+            if (a.year == 0)
+                a.year = std::atoi(o.year.c_str());
+            if (a.art == -1 && o.has_art)
+                a.art = s;
+        }
+        if (a.art == -1)
+            a.art = a.songs[0];
+    }
+    // By collation key like comes_before, then by the name itself for the albums only the case or accents tell apart
+    auto key_of = [&options](const AlbumEntry &a) -> const std::string & {
+        auto &o = options[a.songs[0]];
+        return o.album_key.empty() ? o.album : o.album_key;
+    };
+    std::sort(albums.begin(), albums.end(), [&key_of](const AlbumEntry &a, const AlbumEntry &b) {
+        if (a.name.empty() || b.name.empty())
+            return b.name.empty() && !a.name.empty();
+        int order = key_of(a).compare(key_of(b));
+        return order != 0 ? order < 0 : a.name < b.name;
+    });
+    return albums;
+}
+
+bool write_library_cache(const std::string &path, const std::vector<Option> &options) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    StringTable table;
+    std::vector<CacheRecord> records;
+    records.reserve(options.size());
+    std::vector<uint32_t> record_of(options.size());
+    for (uint32_t i = 0; i < options.size(); i++) {
+        auto &o = options[i];
+        if (o.full.empty())
+            continue;
+        record_of[i] = records.size();
+        CacheRecord r{};
+        r.path = table.add(o.full);
+        r.title = table.add(o.name);
+        r.artist = table.add(o.artist);
+        r.album = table.add(o.album);
+        r.genre = table.add(o.genre);
+        r.year = table.add(o.year);
+        r.length = table.add(o.length);
+        r.track = table.add(o.track);
+        r.disc = table.add(o.disc);
+        r.title_key = table.add(o.title_key);
+        r.artist_key = table.add(o.artist_key);
+        r.album_key = table.add(o.album_key);
+        r.genre_key = table.add(o.genre_key);
+        r.size = o.size;
+        r.mtime = o.mtime;
+        r.inode = o.inode;
+        r.flags = o.has_art ? CACHE_HAS_ART : 0;
+        records.push_back(r);
+    }
+    
+    std::vector<CacheAlbum> albums;
+    std::vector<uint32_t> album_songs;
+    album_songs.reserve(records.size());
+    for (auto &a: index_albums(options)) {
+        CacheAlbum c{};
+        c.name = table.add(a.name);
+        c.first_song = album_songs.size();
+        c.song_count = a.songs.size();
+        c.length = a.length;
+        c.year = a.year;
+        c.art = record_of[a.art];
+        for (auto s: a.songs)
+            album_songs.push_back(record_of[s]);
+        albums.push_back(c);
+    }
+
+    CacheHeader header{};
+    memcpy(header.magic, LIBRARY_CACHE_MAGIC, 4);
+    header.version = LIBRARY_CACHE_VERSION;
+    header.record_size = sizeof(CacheRecord);
+    header.record_count = records.size();
+    header.records_offset = sizeof(CacheHeader);
+    header.album_count = albums.size();
+    header.album_song_count = album_songs.size();
+    header.albums_offset = header.records_offset + records.size() * sizeof(CacheRecord);
+    header.album_songs_offset = header.albums_offset + albums.size() * sizeof(CacheAlbum);
+    header.strings_offset = header.album_songs_offset + album_songs.size() * sizeof(uint32_t);
+    header.strings_size = table.bytes.size();
+
+    std::string temp_path = path + ".tmp";
+    FILE *file = fopen(temp_path.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(records.data(), sizeof(CacheRecord), records.size(), file) == records.size() &&
+              fwrite(albums.data(), sizeof(CacheAlbum), albums.size(), file) == albums.size() &&
+              fwrite(album_songs.data(), sizeof(uint32_t), album_songs.size(), file) == album_songs.size() &&
+              fwrite(table.bytes.data(), 1, table.bytes.size(), file) == table.bytes.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        rt_log(RT_ERROR, "Couldn't write the library cache to %s", path.c_str());
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,147 @@
+/* date = October 19th 2026 3:10 pm */
+
+#ifndef LIBRARY_CACHE_H
+#define LIBRARY_CACHE_H
+
+#include "track.h"
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// The library cache on disk (native byte order, it never leaves the machine):
+//
+//   CacheHeader
+//   CacheRecord[record_count]
+//   CacheAlbum[album_count]
+//   uint32_t[album_song_count]: the records of every album, one album after the other
+//   string table: for every string, a uint32_t length then the bytes then a '\0'
+//
+// Records point at strings by their offset into the string table, and equal strings (artists, albums,
+// genres, years) are only stored once. The file is mmap'ed and read in place.
+
+#define LIBRARY_CACHE_MAGIC "LFPC"
+// 1 and 2 were the old "Path: " text format, 3 didn't have the albums, 4 didn't have the collation keys
+#define LIBRARY_CACHE_VERSION 5
+
+#define CACHE_HAS_ART (1 << 0)
+
+struct CacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t record_size; // sizeof(CacheRecord) when written, a mismatch means a different layout
+    uint32_t record_count;
+    uint64_t records_offset;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+    
+    // Version 4 and up
+    uint32_t album_count;
+    uint32_t album_song_count;
+    uint64_t albums_offset;
+    uint64_t album_songs_offset;
+};
+
+// The header version 3 wrote, which is still read (its albums are worked out when it's loaded)
+#define LIBRARY_CACHE_V3_HEADER_SIZE 40
+
+struct CacheRecord {
+    uint32_t path;
+    uint32_t title;
+    uint32_t artist;
+    uint32_t album;
+    uint32_t genre;
+    uint32_t year;
+    uint32_t length;
+    uint32_t track;
+    uint32_t disc;
+    uint32_t flags; // CACHE_*
+    uint64_t size;
+    int64_t mtime;
+    uint64_t inode;
+    
+    // Version 5 and up: the collation keys (see Option), an empty string when it's the text itself
+    uint32_t title_key;
+    uint32_t artist_key;
+    uint32_t album_key;
+    uint32_t genre_key;
+};
+
+// The record versions 3 and 4 wrote, which are still read (their keys are worked out when they're loaded)
+#define LIBRARY_CACHE_V4_RECORD_SIZE 64
+
+struct CacheAlbum {
+    uint32_t name;
+    uint32_t first_song; // into the album songs
+    uint32_t song_count;
+    uint32_t length; // seconds
+    uint32_t year;
+    int32_t art; // record, or -1
+};
+
+// Builds the string table, storing each string once (the playlists file uses the same layout)
+struct StringTable {
+    std::string bytes;
+    std::unordered_map<std::string, uint32_t> offsets;
+
+    uint32_t add(const std::string &s) {
+        auto it = offsets.find(s);
+        if (it != offsets.end())
+            return it->second;
+        uint32_t offset = bytes.size();
+        uint32_t length = s.size();
+        bytes.append((const char *) &length, sizeof(length));
+        bytes.append(s);
+        bytes.push_back('\0');
+        while (bytes.size() % 4 != 0)
+            bytes.push_back('\0');
+        offsets[s] = offset;
+        return offset;
+    }
+};
+
+struct MappedCache {
+    void *base = nullptr;
+    size_t length = 0;
+    const CacheHeader *header = nullptr;
+    const char *records = nullptr; // header->record_size apart, see record()
+    const char *strings = nullptr;
+    const CacheAlbum *albums = nullptr; // null for a version 3 cache
+    const uint32_t *album_songs = nullptr;
+
+    uint32_t count() const { return header ? header->record_count : 0; }
+
+    uint32_t album_count() const { return albums ? header->album_count : 0; }
+
+    // Whether the records have their collation keys (only read the key fields of one if so)
+    bool has_keys() const { return header && header->version >= 5; }
+
+    const CacheRecord &record(uint32_t i) const {
+        return *(const CacheRecord *) (records + (size_t) i * header->record_size);
+    }
+
+    std::string_view string(uint32_t offset) const {
+        return std::string_view(strings + offset + sizeof(uint32_t), *(const uint32_t *) (strings + offset));
+    }
+};
+
+// Maps and validates a binary cache (false if it's missing, from an older version, or damaged)
+bool map_library_cache(const std::string &path, MappedCache *cache);
+
+void unmap_library_cache(MappedCache *cache);
+
+// Whether 'path' is in the old text format, and so needs migrating
+bool is_text_library_cache(const std::string &path);
+
+// Reads the old text format (both the first version, and the second one with size/mtime/inode)
+void read_text_library_cache(const std::string &path, std::vector<Option> &options);
+
+// Groups the songs into albums by hashing their album names: albums by name with the songs without one last
+// (the songs tab order), songs by disc then track. Songs without a path are left out.
+std::vector<AlbumEntry> index_albums(const std::vector<Option> &options);
+
+// Writes the songs and their album index to 'path'.tmp, then renames over 'path'
+bool write_library_cache(const std::string &path, const std::vector<Option> &options);
+
+#endif //LIBRARY_CACHE_H
@@ -5,6 +5,9 @@
 #include "dpi.h"
 #include "drawer.h"
 #include "album_tab.h"
+#include "artist_tab.h"
+#include "playlist_tab.h"
+#include "playlist_file.h"
 #include "songs_tab.h"
 #include "queue.h"
 #include "stb_image.h"
@@ -13,6 +16,10 @@
 #include "player.h"
 #include "edit_info.h"
 #include "ThreadPool.h"
+#include "rt_log.h"
+#include "watcher.h"
+#include "library.h"
+#include "io_scheduler.h"
 #include <thread>
 #include <filesystem>
 #include <fstream>
@@ -68,8 +75,27 @@ long converting_start = 1;
 
 void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uint32 frameCount);
 
-std::vector<CachedArt *> cached_art;
-std::unordered_map<std::string, AlbumOption> album_songs;
+// Filled in from the art caching threads
+static std::mutex cached_art_mutex;
+static std::unordered_map<std::string, CachedArt *> cached_art;
+
+CachedArt *cached_art_named(const std::string &art_name) {
+    std::lock_guard<std::mutex> guard(cached_art_mutex);
+    auto it = cached_art.find(art_name);
+    return it == cached_art.end() ? nullptr : it->second;
+}
+
+CachedArt *album_art(AlbumId album) {
+    if (album == NO_ALBUM)
+        return nullptr;
+    auto &a = catalog_album(album);
+    if (!a.cached_art) {
+        if (a.art_name.empty())
+            a.art_name = sanitize_file_name(pool_string(a.name));
+        a.cached_art = cached_art_named(a.art_name);
+    }
+    return a.cached_art;
+}
 
 
 static void load_image(const std::string& mp3Path, const std::string& imagePath) {
@@ -301,7 +327,7 @@ struct CenterData : UserData {
     }
 };
 
-void activate_coverlet(AppClient *client, std::string album_name) {
+void activate_coverlet(AppClient *client, AlbumId album) {
     Container *coverlet;
     Container *root;
     if (client->root->children[0]->name == "coverlet") {
@@ -324,12 +350,10 @@ void activate_coverlet(AppClient *client, std::string album_name) {
     if (data->surface) {
         cairo_surface_destroy(data->surface);
     }
-    for (auto art : cached_art) {
-        if (art->name == sanitize_file_name(album_name)) {
-            data->surface = accelerated_surface(app, client, art->width * 2, art->height * 2);
-            paint_surface_with_data(data->surface, art->large_data, art->width * 2, art->height * 2);
-            //fade_out_edges_2(data->surface, 16 * config->dpi);
-        }
+    if (auto art = album_art(album)) {
+        data->surface = accelerated_surface(app, client, art->width * 2, art->height * 2);
+        paint_surface_with_data(data->surface, art->large_data, art->width * 2, art->height * 2);
+        //fade_out_edges_2(data->surface, 16 * config->dpi);
     }
 }
 
@@ -409,7 +433,9 @@ static void paint_center(AppClient *client, Container *c) {
             }
             if (data->surface == nullptr && !player->path.empty()) {
                 data->cached_path = player->path;
-                load_icon_full_path(app, client, &data->surface, player->cover, c->real_bounds.h - 20 * config->dpi);
+                std::lock_guard<std::mutex> guard(player->cover_mutex);
+                if (player->cover)
+                    data->surface = cairo_surface_reference(player->cover);
             }
             int font_size = 11 * config->dpi;
             int pad_size = 11 * config->dpi;
@@ -568,19 +594,7 @@ static void paint_center(AppClient *client, Container *c) {
         if (data->surface && client->mouse_current_x < c->real_bounds.x + c->real_bounds.h * 1.1) {
             auto data = (CenterData *) c->user_data;
             if (data->surface && client->mouse_current_x < c->real_bounds.x + c->real_bounds.h * 1.1) {
-                auto path = player->path;
-                std::string album_name;
-                for (auto a : album_songs) {
-                    for (auto option : a.second.songs) {
-                        if (option.full == path) {
-                            album_name = a.first;
-                            goto out;
-                        }
-                    }
-                }
-                out:
- 
-                activate_coverlet(client, album_name);
+                activate_coverlet(client, catalog_album_of(catalog_find(intern(player->path))));
                 //app_timeout_create(app, client, 20, [](App *app, AppClient *client, Timeout *timeout, void *userdata) {
                 //                     }, nullptr, "activate_coverlet");
             }
@@ -605,8 +619,6 @@ static void paint_textarea_border(AppClient *client, cairo_t *cr, Container *con
             data->state->cursor = 0;
             data->state->selection_x = -1;
             for (auto child: container->children[0]->children) {
-                auto data = (ListOption *) child->user_data;
-                //data->selected = false;
                 child->exists = true;
             }    
         }
@@ -766,86 +778,6 @@ static void set_volume_throttled(AppClient *client, float scalar) {
                            }, data, "throttle_volume");
 }
 
- static void active_next(AppClient *client) {
-    if (auto songs_content = container_by_name("songs_content", client->root)) {
-        for (int i = 0; i < songs_content->children.size(); i++) {
-            auto child = songs_content->children[i];
-            if (child->exists) {
-                auto data = (ListOption *) child->user_data;
-                if (data->selected) {
-                    data->selected = false;
-                    
-                    bool set = false;
-                    for (int s = i + 1; s < songs_content->children.size(); s++) {
-                        child = songs_content->children[s];
-                        if (child->exists) {
-                            auto data = (ListOption *) child->user_data;
-                            set = true;
-                            data->selected = true;
-                            //limited_play_track(client, data->label->text);
-                            break;
-                        }
-                    }
-                    if (!set) { // wrap around end to start
-                        for (int i = 0; i < songs_content->children.size(); i++) {
-                            auto child = songs_content->children[i];
-                            if (child->exists) {
-                                auto data = (ListOption *) child->user_data;
-                                data->selected = true;
-                                //limited_play_track(client, data->label->text);
-                                break;
-                            }
-                        }
-                    }
-                    
-                    break;
-                }
-            }
-        }    
-    }
-    put_selected_on_screen(client);   
-}
-
-static void active_previous(AppClient *client) {
-    if (auto songs_content = container_by_name("songs_content", client->root)) {
-        for (int i = 0; i < songs_content->children.size(); i++) {
-            auto child = songs_content->children[i];
-            if (child->exists) {
-                auto data = (ListOption *) child->user_data;
-                if (data->selected) {
-                    data->selected = false;
-                    
-                    bool set = false;
-                    for (int s = i - 1; s >= 0; s--) {
-                        child = songs_content->children[s];
-                        if (child->exists) {
-                            auto data = (ListOption *) child->user_data;
-                            set = true;
-                            data->selected = true;
-                            //limited_play_track(client, data->label->text);
-                            break;
-                        }
-                    }
-                    if (!set) { // wrap around end to start
-                        for (int i = songs_content->children.size() - 1; i >= 0; i--) {
-                            auto child = songs_content->children[i];
-                            if (child->exists) {
-                                auto data = (ListOption *) child->user_data;
-                                data->selected = true;
-                                //limited_play_track(client, data->label->text);
-                                break;
-                            }
-                        }
-                    }
-                    
-                    break;
-                }
-            }
-        }    
-    }
-    put_selected_on_screen(client);
-}
-
 static void paint_queue_button(AppClient *client, cairo_t *cr, Container *c) {
     auto data = (SurfaceButton *) c->user_data;
     if (!data->attempted) {
@@ -868,20 +800,6 @@ static void paint_queue_button(AppClient *client, cairo_t *cr, Container *c) {
     }
 }
 
-static std::string get_selected_track(AppClient *client) {
-    if (auto songs_content = container_by_name("songs_content", client->root)) {
-        for (auto child: songs_content->children) {
-            if (child->exists) {
-                auto data = (ListOption *) child->user_data;
-                if (data->selected) {
-                    return data->label->text;
-                }
-            }
-        }
-    }
-    return "";
-}
-
 int dist_of_col_at_position(SortOption col, int try_pos, std::vector<SortOption> &cols, int target) {
     for (int i = 0; i < cols.size(); i++) {
         if (cols[i].name == col.name) {
@@ -902,10 +820,9 @@ int dist_of_col_at_position(SortOption col, int try_pos, std::vector<SortOption>
     return 0;   
 }
 
-void right_click_song(AppClient *client, std::string full_path, std::string title) {    
+void right_click_song(AppClient *client, TrackId track) {    
     struct SongRightClickData : UserData {
-        std::string full_path;
-        std::string title;
+        TrackId track;
     };
 
     struct RightClickOption : UserData {
@@ -913,6 +830,7 @@ void right_click_song(AppClient *client, std::string full_path, std::string titl
         std::string text;
         cairo_surface_t *surface = nullptr;
         ArgbColor icon_color = ArgbColor(1.000, 0.306, 0.420, 1.0);
+        PlaylistId playlist = NO_PLAYLIST; // for the "Add to" ones, whose text could be anything
     };
     int option_height = 32 * config->dpi;
     int options = 4;
@@ -931,8 +849,7 @@ void right_click_song(AppClient *client, std::string full_path, std::string titl
     popup_settings.name = "right_click_song";
     auto popup = client->create_popup(popup_settings, settings);
     auto data = new SongRightClickData;
-    data->full_path = full_path;
-    data->title = title;
+    data->track = track;
     popup->user_data = data;
     popup->root->type = ::vbox;
     popup->root->when_paint = [](AppClient *client, cairo_t *, Container *c) {
@@ -944,16 +861,20 @@ void right_click_song(AppClient *client, std::string full_path, std::string titl
     popup->root->type = ::hbox;
     auto left = popup->root->child(option_width, FILL_SPACE);
     auto right = popup->root->child(FILL_SPACE, FILL_SPACE);
+    right->type = ::vbox;
     right->when_paint = [](AppClient *client, cairo_t *, Container *c) {
-        draw_colored_rect(client, ArgbColor(.8, .8, .8, 1), c->real_bounds);
+        draw_colored_rect(client, ArgbColor(.7, .7, .7, .4),
+                          Bounds(c->real_bounds.x, c->real_bounds.y + 8 * config->dpi,
+                                 std::floor(1 * config->dpi), c->real_bounds.h - 16 * config->dpi));
     };    
     
-    auto add_option = [popup, left](std::string icon, std::string text) 
+    auto add_option = [popup](Container *column, std::string icon, std::string text, PlaylistId playlist = NO_PLAYLIST) 
     { 
         auto data = new RightClickOption;
         data->icon = icon;
         data->text = text;
-        auto option = left->child(FILL_SPACE, FILL_SPACE);
+        data->playlist = playlist;
+        auto option = column->child(FILL_SPACE, FILL_SPACE);
         load_icon_full_path(app, popup, &data->surface, asset(icon), 24 * config->dpi);
         dye_surface(data->surface, ArgbColor(.8, 0, 1, 1));
         dye_surface(data->surface, data->icon_color);
@@ -983,14 +904,18 @@ void right_click_song(AppClient *client, std::string full_path, std::string titl
         option->when_clicked = [](AppClient *client, cairo_t *, Container *c) {
             auto data = (RightClickOption *) c->user_data;
             auto client_data = (SongRightClickData *) client->user_data;
-            if (data->text == "Play Next") {
-                player->play_next(client_data->full_path);
+            if (data->playlist != NO_PLAYLIST) {
+                playlist_add(data->playlist, {client_data->track});
+            } else if (data->text == "New Playlist") {
+                new_playlist_with({client_data->track});
+            } else if (data->text == "Play Next") {
+                player->play_next(client_data->track);
             } else if (data->text == "Play After All Next") {
-                player->play_after_all_next(client_data->full_path);
+                player->play_after_all_next(client_data->track);
             } else if (data->text == "Add to Queue") {
-                player->play_last(client_data->full_path);
+                player->play_last(client_data->track);
             } else if (data->text == "Edit Info") {
-                edit_info(EditType::SONG_TYPE, client_data->title);
+                edit_info(EditType::SONG_TYPE, pool_string(catalog_track(client_data->track).title));
             } else {
                 //activate_coverlet(client);
             }
@@ -999,25 +924,38 @@ void right_click_song(AppClient *client, std::string full_path, std::string titl
     };
     
     auto pad = left->child(FILL_SPACE, 4 * config->dpi);
-    add_option("corner-up-right.svg", "Play Next");
-    add_option("corner-down-right.svg", "Play After All Next");
-    add_option("arrow-bar-to-down.svg", "Add to Queue");
-    auto seperator = left->child(FILL_SPACE, 8 * config->dpi);
-    seperator->when_paint = [](AppClient *client, cairo_t *, Container *c) {
+    add_option(left, "corner-up-right.svg", "Play Next");
+    add_option(left, "corner-down-right.svg", "Play After All Next");
+    add_option(left, "arrow-bar-to-down.svg", "Add to Queue");
+    auto paint_seperator = [](AppClient *client, cairo_t *, Container *c) {
         draw_colored_rect(client, ArgbColor(.7, .7, .7, .4), 
                               Bounds(c->real_bounds.x + 20 * config->dpi,
                                      c->real_bounds.y + 4 * config->dpi,
                                      c->real_bounds.w - 40 * config->dpi, std::floor(1 * config->dpi)));
   
     };
-    add_option("", "Edit Info");
+    auto seperator = left->child(FILL_SPACE, 8 * config->dpi);
+    seperator->when_paint = paint_seperator;
+    add_option(left, "", "Edit Info");
     //add_option("", "View Art");
     pad = left->child(FILL_SPACE, 4 * config->dpi);
     
+    // The playlists, lined up with the rows on the left (the empty ones just take up the space)
+    pad = right->child(FILL_SPACE, 4 * config->dpi);
+    add_option(right, "", "New Playlist");
+    seperator = right->child(FILL_SPACE, 8 * config->dpi);
+    seperator->when_paint = paint_seperator;
+    auto menu_playlists = playlists_for_menu();
+    for (auto id : menu_playlists)
+        add_option(right, "", "Add to " + playlist(id).name, id);
+    for (size_t i = menu_playlists.size() + 1; i < (size_t) options; i++)
+        right->child(FILL_SPACE, FILL_SPACE);
+    pad = right->child(FILL_SPACE, 4 * config->dpi);
+    
     /*
     popup->root->when_clicked = [](AppClient *client, cairo_t *, Container *c) {
         auto data = (SongRightClickData *) client->user_data;
-        player->play_track(data->full_path);
+        player->play_track(pool_string(catalog_track(data->track).path));
     };    
     */ 
        
@@ -1077,11 +1015,11 @@ static void fill_root(AppClient *client) {
             }
         }
         if (direction == XKB_KEY_DOWN && keysym == XK_Down) {
-            active_next(client);
+            select_next_song(client);
         }
         
         if (direction == XKB_KEY_DOWN && keysym == XK_Up) {
-            active_previous(client);
+            select_previous_song(client);
         }
         
         if (auto filter_textarea = container_by_name("filter_textarea", client->root)) {
@@ -1105,7 +1043,9 @@ static void fill_root(AppClient *client) {
         }
 
         if (direction == XKB_KEY_DOWN && keysym == XK_Return) {
-            player->play_track(get_selected_track(client));
+            auto track = selected_song(client);
+            if (track != NO_TRACK)
+                player->play_track(pool_string(catalog_track(track).path));
         }
         
         if (direction == XKB_KEY_DOWN && keysym == XK_Left) {
@@ -1117,20 +1057,20 @@ static void fill_root(AppClient *client) {
         }
         
         if (direction == XKB_KEY_DOWN && keysym == XK_a) {
-            auto track = get_selected_track(client);
-            if (!track.empty())
+            auto track = selected_song(client);
+            if (track != NO_TRACK)
                 player->play_next(track);
         }
 
         if (direction == XKB_KEY_DOWN && keysym == XK_s) {
-            auto track = get_selected_track(client);
-            if (!track.empty())
+            auto track = selected_song(client);
+            if (track != NO_TRACK)
                 player->play_after_all_next(track);
         }
 
         if (direction == XKB_KEY_DOWN && keysym == XK_d) {
-            auto track = get_selected_track(client);
-            if (!track.empty())
+            auto track = selected_song(client);
+            if (track != NO_TRACK)
                 player->play_last(track);
         }
 
@@ -1139,11 +1079,11 @@ static void fill_root(AppClient *client) {
         }
 
         if (direction == XKB_KEY_DOWN && keysym == XK_n) {
-            active_next(client);
+            select_next_song(client);
         }
          
         if (direction == XKB_KEY_DOWN && keysym == XK_p) {
-            active_previous(client);
+            select_previous_song(client);
         }
         if (direction == XKB_KEY_DOWN && (keysym == XK_space)) {
             player->toggle();
@@ -1215,8 +1155,8 @@ static void fill_root(AppClient *client) {
     };
     left->when_clicked = [](AppClient *client, cairo_t *cr, Container *c) {
         player->set_position(0);
-        //active_previous(client);
-        //player->play_track(get_selected_track(client));
+        //select_previous_song(client);
+        //player->play_track(selected_song(client));
     };
     
     auto play = left_section->child(55 * config->dpi, FILL_SPACE);
@@ -1266,8 +1206,8 @@ static void fill_root(AppClient *client) {
     };
     right->when_clicked = [](AppClient *client, cairo_t *cr, Container *c) {
         player->pop_queue();
-        //active_next(client);
-        //player->play_track(get_selected_track(client));
+        //select_next_song(client);
+        //player->play_track(selected_song(client));
     };
     
     left_section->child(36 * config->dpi, FILL_SPACE);
@@ -1402,20 +1342,26 @@ static void fill_root(AppClient *client) {
     
             if (keysym == XK_Return) {
                 if (active_tab == 0) { // On songs page
-                    player->play_track(get_selected_track(client));
+                    auto track = selected_song(client);
+                    if (track != NO_TRACK)
+                        player->play_track(pool_string(catalog_track(track).path));
                 } else if (active_tab == 1) { // On albums page
                     if (auto c = (ScrollContainer *) container_by_name("albums_root", client->root)) {
                         for (auto child  : c->content->children) {
                             if (child->exists) {
                                 auto al = (AlbumData *) child->user_data;
                                 if (al) {
-                                    player->album_play_next(al->option.album);
+                                    player->album_play_next(al->album);
                                     player->pop_queue();
                                 }
                                 break;
                             }
                         }
                     }
+                } else if (active_tab == 2) { // On artists page
+                    play_selected_artist(client);
+                } else if (active_tab == 3) { // On playlists page
+                    play_selected_playlist(client);
                 }
             }
         }
@@ -1444,6 +1390,15 @@ static void fill_root(AppClient *client) {
          draw_colored_rect(client, ArgbColor(.812, .812, .812, 0.4), b);
        b.y -= thickness;
         draw_colored_rect(client, ArgbColor(.729, .729, .729, 0.4), b);
+        
+        auto progress = library_scan_progress();
+        if (progress.running && progress.found > 0) {
+            int size = 9 * config->dpi;
+            std::string text = "Scanning library " + std::to_string(progress.done) + " / " + std::to_string(progress.found);
+            int pad = 12 * config->dpi;
+            draw_text(client, size, config->font, EXPAND(ArgbColor(.4, .4, .4, 1)), text, c->real_bounds, 5,
+                      c->real_bounds.w - get_text_width(client, size, text) - pad);
+        }
     };
     int total_pad = 24 * config->dpi;
     int size = 10 * config->dpi;
@@ -1480,21 +1435,16 @@ static void fill_root(AppClient *client) {
     auto content = root->child(FILL_SPACE, FILL_SPACE);
     
     auto songs_root = content->child(FILL_SPACE, FILL_SPACE);
-    std::vector<Option> options;
-    fill_songs_tab(client, songs_root, options);
+    fill_songs_tab(client, songs_root);
     
     auto albums_root = content->child(FILL_SPACE, FILL_SPACE);
-    fill_album_tab(client, albums_root, options);
+    fill_album_tab(client, albums_root);
     
     auto artists_root = content->child(FILL_SPACE, FILL_SPACE);
-    artists_root->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
-        draw_colored_rect(client, ArgbColor(1, 0, 1, 1), c->real_bounds);
-    };
+    fill_artist_tab(client, artists_root);
 
     auto playlists_root = content->child(FILL_SPACE, FILL_SPACE);
-    playlists_root->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
-        draw_colored_rect(client, ArgbColor(1, 0, 0, 1), c->real_bounds);
-    };
+    fill_playlist_tab(client, playlists_root);
 
     content->pre_layout = [](AppClient *, Container *c, const Bounds &) {
         for (auto c: c->children)
@@ -1525,8 +1475,68 @@ bool customCompare(const std::string &a, const std::string &b) {
 }
 
 
+void update_album_art() {
+    // Album names and the songs to take their covers from, taken here since the catalog is main thread only. Only
+    // albums with a song whose tags had a picture in them when scanned, so we don't open every file for nothing.
+    std::vector<std::pair<std::string, std::string>> albums;
+    for (AlbumId a = 0; a < catalog_album_count(); a++) {
+        auto &album = catalog_album(a);
+        if (!album.songs.empty() && catalog_track(album.art).has_art)
+            albums.emplace_back(pool_string(album.name), pool_string(catalog_track(album.art).path));
+    }
+    std::thread art_thread([albums] {
+        lower_thread_priority();
+        char *home = getenv("HOME");
+        std::string lfp_album_art(home);
+        lfp_album_art += "/.cache";
+        lfp_album_art += "/lfp_album_art";
+        
+        for (auto &q: albums) {
+            std::string art = lfp_album_art + "/" + sanitize_file_name(q.first);
+            if (!std::filesystem::exists(art + ".jpg"))
+                extract_album_art(q.second, art);
+            if (std::filesystem::exists(art + ".jpg")) {
+                std::string small = art + "_small.jpg";
+                std::string large = art + "_large.jpg";
+                auto path = art + ".jpg";
+                int width, height, channels;
+                unsigned char *data = stbi_load(path.c_str(), &width, &height, &channels, 4); // force RGBA
+                if (!data)
+                    continue;
+                defer(free(data));
+                int target_width = album_target_width;
+                int target_height = target_width;
+                if (!std::filesystem::exists(small)) {
+                    auto *resized_image = stbir_resize_uint8_linear(data, width, height, 0, NULL, target_width,
+                                                                    target_height, 0, STBIR_RGBA);
+                    // Save resized image (as PNG for example)
+                    if (!stbi_write_png(small.c_str(), target_width, target_height, 4, resized_image,
+                                        0)) {
+                        rt_log(RT_WARNING, "Failed to write album art %s", small.c_str());
+                    }
+                }
+                
+                if (!std::filesystem::exists(large)) {
+                    auto *large_image = stbir_resize_uint8_linear(data, width, height, 0, NULL, target_width * 2,
+                                                                  target_height * 2, 0, STBIR_RGBA);
+                    // Save resized image (as PNG for example)
+                    if (!stbi_write_png(large.c_str(), target_width * 2, target_height * 2, 4, large_image,
+                                        0)) {
+                        rt_log(RT_WARNING, "Failed to write album art %s", large.c_str());
+                    }
+                }
+            }
+            
+        }
+        
+        cache_art();
+    });
+    art_thread.detach();
+}
+
 void cache_art() {
     std::thread t([]() {
+        lower_thread_priority();
         //std::this_thread::sleep_for(std::chrono::milliseconds(200));
         char *home = getenv("HOME");
         std::string lfp_album_art(home);
@@ -1539,13 +1549,7 @@ void cache_art() {
             if (fs::exists(lfp_album_art) && fs::is_directory(lfp_album_art)) {
                 for (const auto &entry: fs::recursive_directory_iterator(lfp_album_art)) {
                     std::string art_name = entry.path().stem().string();
-                    bool already_cached = false;
-                    for (auto art_option: cached_art) {
-                        if (art_option->name == art_name) {
-                            already_cached = true;
-                        }
-                    }
-                    if (!already_cached) {
+                    if (!cached_art_named(art_name)) {
                         albums.push_back(art_name);
                     }
                     continue;
@@ -1559,34 +1563,36 @@ void cache_art() {
         unsigned int threads = std::thread::hardware_concurrency();
         if (threads == 0)
             threads = 8;
-        ThreadPool pool(threads);
-        std::vector<std::future<void> > results;
+        // How many covers load at once follows how fast the cache directory's disk keeps up
+        struct stat art_stat{};
+        stat(lfp_album_art.c_str(), &art_stat);
+        IoScheduler scheduler(threads);
         
-        for (auto a: albums) {
-            results.emplace_back(
-                    pool.enqueue([a, lfp_album_art] {
-                        int width, height, channels;
-                        auto small_path = lfp_album_art + "/" + a + "_small.jpg";
-                        auto large_path = lfp_album_art + "/" + a + "_large.jpg";
-                        unsigned char *large_data = stbi_load(large_path.c_str(), &width, &height, &channels,
-                                                              4); // force RGBA
-                        unsigned char *small_data = stbi_load(small_path.c_str(), &width, &height, &channels,
-                                                              4); // force RGBA
-                        if (!small_data || !large_data)
-                            return;
-                        
-                        int target_width = width;
-                        int target_height = height;
-                        
-                        auto art = new CachedArt;
-                        art->name = a;
-                        art->data = small_data;
-                        art->large_data = large_data;
-                        art->width = target_width;
-                        art->height = target_height;
-                        cached_art.push_back(art);
-                    })
-            );
+        for (int i = 0; i < albums.size(); i++) {
+            auto a = albums[i];
+            scheduler.submit(art_stat.st_dev, i, [a, lfp_album_art] {
+                int width, height, channels;
+                auto small_path = lfp_album_art + "/" + a + "_small.jpg";
+                auto large_path = lfp_album_art + "/" + a + "_large.jpg";
+                unsigned char *large_data = stbi_load(large_path.c_str(), &width, &height, &channels,
+                                                      4); // force RGBA
+                unsigned char *small_data = stbi_load(small_path.c_str(), &width, &height, &channels,
+                                                      4); // force RGBA
+                if (!small_data || !large_data)
+                    return;
+                
+                int target_width = width;
+                int target_height = height;
+                
+                auto art = new CachedArt;
+                art->name = a;
+                art->data = small_data;
+                art->large_data = large_data;
+                art->width = target_width;
+                art->height = target_height;
+                std::lock_guard<std::mutex> guard(cached_art_mutex);
+                cached_art.try_emplace(a, art);
+            });
         }
     });
    
@@ -1603,6 +1609,15 @@ int main(int argc, char* argv[]) {
         return -1;
     }
     
+    {
+        char *home = getenv("HOME");
+        std::string log_path(home);
+        log_path += "/.cache";
+        mkdir(log_path.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+        log_path += "/lfp.log";
+        rt_log_start(log_path);
+    }
+    
     config_load();
     player->volume_unthrottled = config->volume;
     player->volume = config->volume;
@@ -1615,7 +1630,8 @@ int main(int argc, char* argv[]) {
             exit(EXIT_FAILURE);
         } else {
             full_path = std::string(resolvedPath);
-            player->play_track(full_path);
+            if (playlist_format_of(full_path) == PLAYLIST_NONE)
+                player->play_track(full_path);
         }
     }
     
@@ -1697,6 +1713,15 @@ int main(int argc, char* argv[]) {
     
     fill_root(client);
     
+    {
+        std::string home = getenv("HOME");
+        if (std::filesystem::is_directory(home + "/Music")) {
+            start_library_watcher(app, client, home + "/.cache/lfplayer.cache", home + "/Music");
+            // Picks up whatever changed while we weren't running (or everything, on the first start)
+            scan_library(home + "/Music", post_library_changes);
+        }
+    }
+    
     client_show(app, client);
     xcb_set_input_focus(app->connection, XCB_INPUT_FOCUS_PARENT, client->window, XCB_CURRENT_TIME);
     
@@ -1709,63 +1734,25 @@ int main(int argc, char* argv[]) {
                                client_unregister_animation(app, client);
                            }, nullptr, "");
     if (!full_path.empty()) {
-        player->play_track(full_path);
-    }
-    
-    std::thread art_thread([] {
-        char *home = getenv("HOME");
-        std::string lfp_album_art(home);
-        lfp_album_art += "/.cache";
-        lfp_album_art += "/lfp_album_art";
-        
-        for (auto q: album_songs) {
-            std::string art = lfp_album_art + "/" + sanitize_file_name(q.first);
-            if (!std::filesystem::exists(art + ".jpg")) {
-                if (!q.second.songs.empty()) {
-                    extract_album_art(q.second.songs[0].full, art);
-                }
+        if (playlist_format_of(full_path) != PLAYLIST_NONE) {
+            // Imported now that the catalog is loaded (or found again, if it was before), then played from the top
+            auto playlist = import_playlist(full_path);
+            if (playlist != NO_PLAYLIST) {
+                player->playlist_play_next(playlist);
+                player->pop_queue();
             }
-            if (std::filesystem::exists(art + ".jpg")) {
-                std::string small = art + "_small.jpg";
-                std::string large = art + "_large.jpg";
-                auto path = art + ".jpg";
-                int width, height, channels;
-                unsigned char *data = stbi_load(path.c_str(), &width, &height, &channels, 4); // force RGBA
-                if (!data)
-                    return;
-                defer(free(data));
-                int target_width = album_target_width;
-                int target_height = target_width;
-                if (!std::filesystem::exists(small)) {
-                    auto *resized_image = stbir_resize_uint8_linear(data, width, height, 0, NULL, target_width,
-                                                                    target_height, 0, STBIR_RGBA);
-                    // Save resized image (as PNG for example)
-                    if (!stbi_write_png(small.c_str(), target_width, target_height, 4, resized_image,
-                                        0)) {
-                        printf("Failed to write image.\n");
-                    }
-                }
-                
-                if (!std::filesystem::exists(large)) {
-                    auto *large_image = stbir_resize_uint8_linear(data, width, height, 0, NULL, target_width * 2,
-                                                                  target_height * 2, 0, STBIR_RGBA);
-                    // Save resized image (as PNG for example)
-                    if (!stbi_write_png(large.c_str(), target_width * 2, target_height * 2, 4, large_image,
-                                        0)) {
-                        printf("Failed to write image.\n");
-                    }
-                }
-            }
-            
+        } else {
+            player->play_track(full_path);
         }
-        
-        cache_art();
-    });
-    art_thread.detach();
+    }
+    
+    update_album_art();
     
     // Start our listening loop until the end of the program
     app_main(app);
     
+    rt_log_flush();
+    
     if (player->data) {
         player->data->finished = false;
     }
@@ -5,47 +5,13 @@
 
 #include "application.h"
 #include "utility.h"
+#include "catalog.h"
+#include "song_sort.h"
 
 extern App *app;
 
 extern bool restart;
 
-struct Option {
-    std::string full;
-    std::string name;
-    std::string artist;
-    std::string album;
-    std::string album_all_lower;
-    std::string genre;
-    std::string year;
-    std::string length;
-    std::string track;
-    std::string disc;
-    int track_num = 1000;
-    int disc_num = 1000;
-};
-
-struct AlbumOption {
-    std::vector<Option> songs;
-};
-
-extern std::unordered_map<std::string, AlbumOption> album_songs;
-
-struct ListOption : UserData {
-    Label *label = nullptr;
-    std::string title;
-    std::string title_all_lower;
-    std::string artist;
-    std::string album;
-    std::string genre;
-    std::string year;
-    std::string length;
-    std::string track;
-
-    long last_time_clicked = 0;
-    bool selected = false;
-};
-
 struct CachedArt {
     std::string name;
     int width;
@@ -54,7 +20,11 @@ struct CachedArt {
     unsigned char *large_data = nullptr;
 };
 
-extern std::vector<CachedArt *> cached_art;
+// A cover loaded by cache_art, by the name of its files (safe from any thread, null until it's loaded)
+CachedArt *cached_art_named(const std::string &art_name);
+
+// An album's cover, remembered in the catalog once it's been found
+CachedArt *album_art(AlbumId album);
 
 extern int top_size;
 extern int top_underbar_size;
@@ -69,12 +39,13 @@ extern long converting_start;
 
 struct AlbumData : UserData {
     std::string text;
+    AlbumId album = NO_ALBUM;
     cairo_surface_t *surface = nullptr;
     double hover_scalar = 0;
     cairo_surface_t *large_album_art = nullptr;
     cairo_surface_t *play_surface = nullptr;
     bool attempted = false;
-    Option option;
+    Track option; // The first song of the album
     bool selected = false;
     long time_when_selected = 0;
     long time_when_image_loaded = 0;
@@ -93,9 +64,9 @@ struct SurfaceButton : UserData {
     bool attempted = false;
 };
 
-void right_click_song(AppClient *client, std::string full_path, std::string title);
+void right_click_song(AppClient *client, TrackId track);
 
-void activate_coverlet(AppClient *client, std::string album_name);
+void activate_coverlet(AppClient *client, AlbumId album);
 
 struct SortOption {
     std::string name;
@@ -119,10 +90,16 @@ struct TableData : UserData {
     float initial_total = 0;
     float initial_x = 0;
     float initial_w = 0;
+    
+    // What the rows are sorted by, most important first (none leaves them in album order)
+    std::vector<SortKey> sort_keys;
 };
 
 void cache_art();
 
+// Pulls covers out of the songs of albums that don't have one yet (in the background), then caches them
+void update_album_art();
+
 
 
 #endif// MAIN_H
@@ -3,19 +3,22 @@
 #include "main.h"
 #include "easing.h"
 #include "config.h"
+#include "sniff.h"
+#include "library.h"
+#include "rt_log.h"
 #include <thread>
 #include <taglib/fileref.h>
 #include <taglib/tag.h>
-#include <taglib/mpegfile.h>
-#include <taglib/flacfile.h>
-#include <taglib/rifffile.h>
-#include <taglib/wavfile.h>
 #include "miniaudio.cc"
 #include <filesystem>
 #include <queue>
 #include <mutex>
 #include <condition_variable>
 #include <optional>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "stb_image.h"
 
 template <typename T>
 class MessageQueue {
@@ -68,47 +71,77 @@ void Player::clear_queue() {
     queued_items.clear();
 }
 
-QueueItem wrapped_song(std::string track_path) {
+QueueItem wrapped_song(TrackId track) {
     QueueItem item;
     item.type = QueueType::SONG;
-    item.path = track_path;   
+    item.id = track;
+    item.path = pool_string(catalog_track(track).path);
     return item;
 }
 
 void clear_alike(Player *player, const QueueItem &a);
 
-void Player::play_last(std::string track_path) {
-    QueueItem a = wrapped_song(track_path);
+void Player::play_last(TrackId track) {
+    QueueItem a = wrapped_song(track);
     clear_alike(this, a);
     queued_items.push_back(a);
 }
 
-void Player::play_after_all_next(std::string track_path) {
-    QueueItem a = wrapped_song(track_path);
+void Player::play_after_all_next(TrackId track) {
+    QueueItem a = wrapped_song(track);
     clear_alike(this, a);
     next_items.insert(next_items.end(), a);
 }
 
-void Player::play_next(std::string track_path) {
-    QueueItem a = wrapped_song(track_path);
+void Player::play_next(TrackId track) {
+    QueueItem a = wrapped_song(track);
     clear_alike(this, a);
     next_items.insert(next_items.begin(), a);
 }
 
-QueueItem wrapped_album(std::string album_name, int from_index) {
+QueueItem wrapped_album(AlbumId album, int from_index) {
     QueueItem item;
     item.type = QueueType::ALBUM;
-    item.path = album_name;
+    item.id = album;
     
-    for (auto slot: album_songs) {
-        if (slot.first == album_name) {
-            for (auto song : slot.second.songs) {
-                item.items.push_back(wrapped_song(song.full));
-            }
+    if (album != NO_ALBUM) {
+        for (auto song : catalog_album(album).songs) {
+            item.items.push_back(wrapped_song(song));
         }
     }
     
-    item.items.erase(item.items.begin(), item.items.begin() + from_index);
+    item.items.erase(item.items.begin(), item.items.begin() + std::min<size_t>(from_index, item.items.size()));
+    
+    return item;
+}
+
+QueueItem wrapped_artist(ArtistId artist) {
+    QueueItem item;
+    item.type = QueueType::ARTIST;
+    item.id = artist;
+    
+    // Only the ids and paths go in, the catalog already has the rest
+    auto &songs = catalog_artist(artist).songs;
+    item.items.reserve(songs.size());
+    for (auto song : songs) {
+        item.items.push_back(wrapped_song(song));
+    }
+    
+    return item;
+}
+
+QueueItem wrapped_playlist(PlaylistId playlist) {
+    QueueItem item;
+    item.type = QueueType::PLAYLIST;
+    item.id = playlist;
+    
+    auto &songs = ::playlist(playlist).songs;
+    item.items.reserve(songs.size());
+    for (auto song : songs) {
+        if (song != NO_TRACK && catalog_album_of(song) != NO_ALBUM) {
+            item.items.push_back(wrapped_song(song));
+        }
+    }
     
     return item;
 }
@@ -116,35 +149,59 @@ QueueItem wrapped_album(std::string album_name, int from_index) {
 void clear_alike(Player *player, const QueueItem &a) {
     for (int i = player->queued_items.size() - 1; i >= 0; i--) {
         auto q = player->queued_items[i];
-        if (q.path == a.path && q.type == a.type) {
+        if (q.id == a.id && q.type == a.type) {
             player->queued_items.erase(player->queued_items.begin() + i);
         }
     }
     for (int i = player->next_items.size() - 1; i >= 0; i--) {
         auto q = player->next_items[i];
-        if (q.path == a.path && q.type == a.type) {
+        if (q.id == a.id && q.type == a.type) {
             player->next_items.erase(player->next_items.begin() + i);
         }
     }
 }
 
-void Player::album_play_last(std::string album_name, int from_index) {
-    auto a = wrapped_album(album_name, from_index);
+void Player::album_play_last(AlbumId album, int from_index) {
+    auto a = wrapped_album(album, from_index);
     clear_alike(this, a);
     queued_items.push_back(a);
 }
 
-void Player::album_play_after_all_next(std::string album_name, int from_index) {
-    auto a = wrapped_album(album_name, from_index);
+void Player::album_play_after_all_next(AlbumId album, int from_index) {
+    auto a = wrapped_album(album, from_index);
     clear_alike(this, a);
     next_items.insert(next_items.end(), a);
 }
 
-void Player::album_play_next(std::string album_name, int from_index) {
-    auto a = wrapped_album(album_name, from_index);
+void Player::album_play_next(AlbumId album, int from_index) {
+    auto a = wrapped_album(album, from_index);
     clear_alike(this, a);
     next_items.insert(next_items.begin(), a);
 }
+
+void Player::artist_play_next(ArtistId artist) {
+    auto a = wrapped_artist(artist);
+    clear_alike(this, a);
+    next_items.insert(next_items.begin(), std::move(a));
+}
+
+void Player::artist_play_last(ArtistId artist) {
+    auto a = wrapped_artist(artist);
+    clear_alike(this, a);
+    queued_items.push_back(std::move(a));
+}
+
+void Player::playlist_play_next(PlaylistId playlist) {
+    auto a = wrapped_playlist(playlist);
+    clear_alike(this, a);
+    next_items.insert(next_items.begin(), std::move(a));
+}
+
+void Player::playlist_play_last(PlaylistId playlist) {
+    auto a = wrapped_playlist(playlist);
+    clear_alike(this, a);
+    queued_items.push_back(std::move(a));
+}
   
 void Player::set_volume(float new_volume) {
     if (new_volume < 0)
@@ -193,11 +250,11 @@ void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uin
     
     float scalar = ((float) userData->currentFrame / userData->end);
     if (!userData->preloaded_next_track && scalar > .9) {
-        userData->preloaded_next_track = true;
-        // TODO: call a function which starts a thread which preloads the next file and creates a decoder,
-        // if the decoder is the same stats as our current we can append it,
+        // The audio thread notices this and warms up whatever is next in the queue.
+        // TODO: if the warmed decoder has the same stats as our current one we could append it (gapless),
         // otherwise we have to switch devices and recreate a device based on the file requirements
-        printf("preload\n");
+        userData->preloaded_next_track = true;
+        rt_log(RT_DEBUG, "Passed 90%% at frame %llu, warming up the next track", (unsigned long long) userData->currentFrame);
     }
     
     // TODO: might need to be changed (due to 'cue' files, and gapless playback)
@@ -210,6 +267,195 @@ void data_callback(ma_device* pDevice, void* pOutput, const void* pInput, ma_uin
     }
 }
 
+static std::mutex warm_mutex;
+static std::condition_variable warm_cv;
+static std::string warm_request; // latest track somebody wants warmed
+static std::string warming; // track the warmup thread is working on right now
+static WarmTrack *warm_slot = nullptr; // finished warmup waiting to be played
+
+static void free_warm_track(WarmTrack *track) {
+    if (!track)
+        return;
+    if (track->data) {
+        ma_decoder_uninit(&track->data->decoder);
+        delete track->data;
+    }
+    if (track->cover)
+        cairo_surface_destroy(track->cover);
+    delete track;
+}
+
+// Prefers the already decoded art from the album art cache, and only extracts from the file when it's missing and
+// 'may_have_art' (the library knows which of its songs have none, so those are never opened here)
+static cairo_surface_t *make_cover(const std::string &filePath, const std::string &album, bool may_have_art) {
+    int size = (top_size - 20) * config->dpi;
+    
+    if (!album.empty()) {
+        if (auto art = cached_art_named(sanitize_file_name(album))) {
+            auto surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+            paint_rgba_to_surface(surface, art->large_data, art->width * 2, art->height * 2, size);
+            return surface;
+        }
+    }
+    
+    std::string art;
+    if (!may_have_art || !extract_album_art_data(filePath, &art))
+        return nullptr;
+    
+    int width, height, channels;
+    unsigned char *data = stbi_load_from_memory((const stbi_uc *) art.data(), art.size(), &width, &height, &channels, 4); // force RGBA
+    if (!data)
+        return nullptr;
+    defer(stbi_image_free(data));
+    
+    auto surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, size, size);
+    paint_rgba_to_surface(surface, data, width, height, size);
+    return surface;
+}
+
+// Formats miniaudio can't decode get converted once into ~/.cache/lfp_converted_songs
+static std::string converted_path(const std::string &filePath) {
+    char *home = getenv("HOME");
+    std::string lfp_converted_songs(home);
+    lfp_converted_songs += "/.cache";
+    mkdir(lfp_converted_songs.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    lfp_converted_songs += "/lfp_converted_songs";
+    mkdir(lfp_converted_songs.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+    
+    std::filesystem::path p = filePath;
+    std::string stem = p.stem().string();
+    
+    return lfp_converted_songs + "/" + sanitize_file_name(stem) + ".flac";
+}
+
+// Does all the slow work before a track can be heard: page cache, tags, cover and decoder.
+// When 'speculative' we are only guessing the track will be played, so no ffmpeg conversions are started.
+static WarmTrack *prepare_track(const std::string &filePath, bool speculative) {
+    auto track = new WarmTrack;
+    track->path = filePath;
+    track->playable_path = filePath;
+    
+    AudioFormat format = FORMAT_UNKNOWN;
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd != -1) {
+        posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+        format = sniff_audio_format(fd);
+        close(fd);
+    }
+    
+    if (format != FORMAT_UNKNOWN && !natively_decodable(format)) {
+        std::string output_path = converted_path(filePath);
+        std::string tmp_path = output_path.substr(0, output_path.size() - 5) + ".tmp.flac";
+        if (!std::filesystem::exists(output_path)) {
+            if (speculative) {
+                free_warm_track(track);
+                return nullptr;
+            }
+            std::string command = "ffmpeg -y -i \"" + filePath + "\" -map 0 -c copy -c:a flac \"" + tmp_path + "\"";
+            converting = true;
+            converting_start = app->current;
+            system(command.c_str());
+            converting = false;
+            
+            std::filesystem::copy_file(tmp_path, output_path);
+            std::filesystem::remove(tmp_path);
+        }
+        
+        track->playable_path = output_path;
+        if (!std::filesystem::exists(output_path)) {
+            free_warm_track(track);
+            return nullptr;
+        }
+    }
+    
+    Option cached;
+    bool in_library = cached_song(filePath, &cached);
+    if (in_library) {
+        track->title = cached.name;
+        track->artist = cached.artist;
+        track->album = cached.album;
+    } else { // Not part of the library, so we have to parse the tags ourselves
+        TagLib::FileRef file(filePath.c_str());
+        if (!file.isNull() && file.tag()) {
+            TagLib::Tag *tag = file.tag();
+            track->title = tag->title().to8Bit(true);
+            track->artist = tag->artist().to8Bit(true);
+            track->album = tag->album().to8Bit(true);
+        }
+    }
+    if (track->title.empty()) {
+        track->window_title = track->path;
+    } else if (track->artist.empty()) {
+        track->window_title = track->title;
+    } else {
+        track->window_title = track->artist + " - " + track->title;
+    }
+    
+    track->cover = make_cover(filePath, track->album, !in_library || cached.has_art);
+    
+    track->data = new AudioData();
+    if (ma_decoder_init_file(track->playable_path.c_str(), NULL, &track->data->decoder) != MA_SUCCESS) {
+        rt_log(RT_ERROR, "Failed to initialize decoder for: %s", track->playable_path.c_str());
+        delete track->data;
+        track->data = nullptr;
+        free_warm_track(track);
+        return nullptr;
+    }
+    
+    // TODO: for cue files, this needs to be something else than 0
+    track->data->start = 0;
+    if (ma_decoder_get_length_in_pcm_frames(&track->data->decoder, &track->data->end) != MA_SUCCESS) {
+        rt_log(RT_ERROR, "Failed to get total frame count of: %s", track->playable_path.c_str());
+        free_warm_track(track);
+        return nullptr;
+    }
+    
+    // TODO: for cue files this can be wrong because it's not taking start offset into account
+    int seconds = (double) track->data->end / (double) track->data->decoder.outputSampleRate;
+    track->length_in_seconds = seconds_to_mmss(seconds);
+    
+    return track;
+}
+
+static void warmup_thread() {
+    while (!player->finished) {
+        std::string path;
+        {
+            std::unique_lock<std::mutex> lock(warm_mutex);
+            warm_cv.wait(lock, [] { return !warm_request.empty(); });
+            path = warm_request;
+            warm_request.clear();
+            if (warm_slot && warm_slot->path == path)
+                continue;
+            warming = path;
+        }
+        
+        auto track = prepare_track(path, true);
+        
+        {
+            std::lock_guard<std::mutex> lock(warm_mutex);
+            free_warm_track(warm_slot);
+            warm_slot = track;
+            warming.clear();
+        }
+        warm_cv.notify_all();
+    }
+}
+
+// Hands over the warmed track if it's the one we want, otherwise does the work now
+static WarmTrack *take_track(const std::string &filePath) {
+    {
+        std::unique_lock<std::mutex> lock(warm_mutex);
+        warm_cv.wait(lock, [&filePath] { return warming != filePath; });
+        if (warm_slot && warm_slot->path == filePath) {
+            auto track = warm_slot;
+            warm_slot = nullptr;
+            return track;
+        }
+    }
+    return prepare_track(filePath, false);
+}
+
 void audio_listening_thread() {
     bool skip_first = false;
     AudioThreadMessage msg;
@@ -223,47 +469,9 @@ void audio_listening_thread() {
         }
         skip_first = false;
         if (msg.type == PLAY) {            
-            auto filePath = msg.content;
-            std::string originalPath = filePath;
-            TagLib::FileRef file(filePath.c_str());
-            if (!file.isNull() && file.file()) {
-                if (dynamic_cast<TagLib::MPEG::File *>(file.file())) {
-                    //std::cout << "MP3 file" << std::endl;
-                } else if (dynamic_cast<TagLib::FLAC::File *>(file.file())) {
-                    //std::cout << "FLAC file" << std::endl;
-                } else if (dynamic_cast<TagLib::RIFF::WAV::File *>(file.file())) {
-                    //std::cout << "WAV file" << std::endl;
-                } else {
-                    char *home = getenv("HOME");
-                    std::string lfp_converted_songs(home);
-                    lfp_converted_songs += "/.cache";
-                    mkdir(lfp_converted_songs.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-                    lfp_converted_songs += "/lfp_converted_songs";
-                    mkdir(lfp_converted_songs.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-                    
-                    std::filesystem::path p = filePath;
-                    std::string parentPath = p.parent_path().string();
-                    std::string stem = p.stem().string();
-                    
-                    std::string output_path = lfp_converted_songs + "/" + sanitize_file_name(stem) + ".flac";
-                    std::string tmp_path = lfp_converted_songs + "/" + sanitize_file_name(stem) + ".tmp.flac";
-                    if (!std::filesystem::exists(output_path)) {
-                        std::string command = "ffmpeg -y -i \"" + filePath + "\" -map 0 -c copy -c:a flac \"" + tmp_path + "\"";
-                        converting = true;
-                        converting_start = app->current;
-                        system(command.c_str());
-                        converting = false;
-                        
-                        std::filesystem::copy_file(tmp_path, output_path);
-                        std::filesystem::remove(tmp_path);
-                    }
-                    
-                    filePath = output_path;
-                    if (!std::filesystem::exists(output_path)) {
-                        return;
-                    }
-                }
-            }
+            WarmTrack *track = take_track(msg.content);
+            if (!track)
+                continue;
             
             int attempts = 0;
             int max_attempts = 10;
@@ -282,95 +490,75 @@ void audio_listening_thread() {
                 create_animation_loop(client);
             }
             
-            if (!file.isNull() && file.tag()) {
-                TagLib::Tag *tag = file.tag();
-                player->title = tag->title().to8Bit(true);  // Convert to std::string
-                player->artist = tag->artist().to8Bit(true);  // Convert to std::string
-                player->album = tag->album().to8Bit(true);  // Convert to std::string
+            player->title = track->title;
+            player->artist = track->artist;
+            player->album = track->album;
+            player->path = track->path;
+            player->length_in_seconds = track->length_in_seconds;
+            xcb_ewmh_set_wm_name(&app->ewmh, client->window, track->window_title.length(), track->window_title.c_str());
+            {
+                std::lock_guard<std::mutex> guard(player->cover_mutex);
+                if (player->cover)
+                    cairo_surface_destroy(player->cover);
+                player->cover = track->cover;
+                track->cover = nullptr;
             }
-            player->path = originalPath;
             
-            if (player->title.empty()) {
-                xcb_ewmh_set_wm_name(&app->ewmh, client->window, player->path.length(), player->path.c_str());
-            } else {
-                if (player->artist.empty()) {
-                    xcb_ewmh_set_wm_name(&app->ewmh, client->window, player->title.length(), player->title.c_str());
-                } else {
-                    std::string text = player->artist + " - " + player->title;
-                    xcb_ewmh_set_wm_name(&app->ewmh, client->window, text.length(), text.c_str());
-                }
-            }
-            bool worked = extract_album_art(originalPath, "/tmp/cover");
-            if (worked) {
-                player->cover = "/tmp/cover.jpg";
-            } else {
-                player->cover = "";
-            }
+            AudioData *userData = track->data;
+            track->data = nullptr;
+            free_warm_track(track);
             
             // TODO: only do these on main thread
             //client_layout(client->app, client);
             request_refresh(client->app, client);
             
             {
-                AudioData userData = {0};
-                player->data = &userData;
+                player->data = userData;
                 if (player->start_paused) {
-                    userData.paused = true;
-                }
-                
-                if (ma_decoder_init_file(filePath.c_str(), NULL, &userData.decoder) != MA_SUCCESS) {
-                    printf("Failed to initialize decoder.\n");
-                    return;
-                }
-                
-                // TODO: for cue files, this needs to be something else than 0
-                userData.start = 0;
-                if (ma_decoder_get_length_in_pcm_frames(&userData.decoder, &userData.end) != MA_SUCCESS) {
-                    printf("Failed to get total frame count.\n");
-                    ma_decoder_uninit(&userData.decoder);
-                    return;
+                    userData->paused = true;
                 }
                 
                 ma_device_config deviceConfig = ma_device_config_init(ma_device_type_playback);
-                deviceConfig.playback.format   = userData.decoder.outputFormat;
-                deviceConfig.playback.channels = userData.decoder.outputChannels;
-                deviceConfig.sampleRate        = userData.decoder.outputSampleRate;
+                deviceConfig.playback.format   = userData->decoder.outputFormat;
+                deviceConfig.playback.channels = userData->decoder.outputChannels;
+                deviceConfig.sampleRate        = userData->decoder.outputSampleRate;
                 deviceConfig.dataCallback      = data_callback;
-                deviceConfig.pUserData         = &userData;
-                
-                // TODO: for cue files this can be wrong because it's not taking start offset into account
-                int seconds = (double) userData.end / (double) userData.decoder.outputSampleRate;
-                player->length_in_seconds = seconds_to_mmss(seconds);
+                deviceConfig.pUserData         = userData;
                 
                 ma_device device;
                 if (ma_device_init(NULL, &deviceConfig, &device) != MA_SUCCESS) {
-                    printf("Failed to initialize playback device.\n");
-                    ma_decoder_uninit(&userData.decoder);
+                    rt_log(RT_ERROR, "Failed to initialize playback device.");
+                    ma_decoder_uninit(&userData->decoder);
                     return;
                 }
                 
-                userData.device = &device;
+                userData->device = &device;
                 player->set_volume(player->volume);
                 if (ma_device_start(&device) != MA_SUCCESS) {
-                    printf("Failed to start playback.\n");
+                    rt_log(RT_ERROR, "Failed to start playback.");
                     ma_device_uninit(&device);
-                    ma_decoder_uninit(&userData.decoder);
+                    ma_decoder_uninit(&userData->decoder);
                     return;
                 }
                 
-                while (!userData.finished) {
+                bool warmed_next = false;
+                while (!userData->finished) {
                     std::optional<AudioThreadMessage> tmsg = msg_queue.try_pop();
                     if (tmsg.has_value()) {
-                        userData.finished = true;
+                        userData->finished = true;
                         msg = tmsg.value();
                         skip_first = true;
                         break;
                     }
                     if (app && !app->running) {
-                        userData.finished = true;
+                        userData->finished = true;
                         player->finished = true;
                         break;
                     }
+                    if (userData->preloaded_next_track && !warmed_next) {
+                        warmed_next = true;
+                        player->warm(player->peek_queue());
+                    }
                     ma_sleep(100);  // sleep for 100ms
                 }
                 player->data = nullptr;
@@ -379,9 +567,11 @@ void audio_listening_thread() {
                 }
                 
                 ma_device_uninit(&device);
-                ma_decoder_uninit(&userData.decoder);
+                ma_decoder_uninit(&userData->decoder);
+                bool reached_end_of_song = userData->reached_end_of_song;
+                delete userData;
                 
-                if (userData.reached_end_of_song) {
+                if (reached_end_of_song) {
                     auto client = client_by_name(app, "lfplayer");
                     std::string title = "Local First Music Player";
                     xcb_ewmh_set_wm_name(&app->ewmh, client->window, title.length(), title.c_str());
@@ -399,6 +589,9 @@ void Player::start_audio_listening_thread() {
     
     std::thread t(audio_listening_thread);
     t.detach();
+    
+    std::thread w(warmup_thread);
+    w.detach();
 }
 
 void second(std::string filePath) {
@@ -418,14 +611,13 @@ void Player::pop_queue() {
     
     auto try_pop = [&next_track](std::vector<QueueItem> *list) {
         if (!list->empty()) {
-            auto q = (*list)[0];
+            auto &q = (*list)[0];
             if (q.type == QueueType::SONG) {
                 next_track = q.path;
-            } else if (q.type == QueueType::ALBUM) {
+            } else if (q.type == QueueType::ALBUM || q.type == QueueType::ARTIST || q.type == QueueType::PLAYLIST) {
                 if (!q.items.empty()) {
-                    auto list_q = q.items[0];
-                    next_track = list_q.path;
-                    (*list)[0].items.erase((*list)[0].items.begin());
+                    next_track = q.items[0].path;
+                    q.items.erase(q.items.begin());
                 }
             }
             if (q.items.empty()) {
@@ -444,6 +636,32 @@ void Player::pop_queue() {
     }
 }
 
+std::string Player::peek_queue() {
+    for (auto list : {&next_items, &queued_items}) {
+        if (list->empty())
+            continue;
+        auto &q = (*list)[0];
+        if (q.type == QueueType::SONG) {
+            return q.path;
+        } else if (q.type != QueueType::SONG && !q.items.empty()) {
+            return q.items[0].path;
+        }
+    }
+    return "";
+}
+
+void Player::warm(std::string track_path) {
+    if (track_path.empty() || track_path == path)
+        return;
+    {
+        std::lock_guard<std::mutex> lock(warm_mutex);
+        if (warming == track_path || (warm_slot && warm_slot->path == track_path))
+            return;
+        warm_request = track_path;
+    }
+    warm_cv.notify_all();
+}
+
 void Player::set_position(float scalar) {
     if (!data)
         return;   
@@ -8,7 +8,11 @@
 #include <atomic>
 #include <mutex>
 
+#include <cairo.h>
+
 #include "miniaudio.hh"
+#include "catalog.h"
+#include "playlists.h"
 
 struct AudioData {
     ma_decoder decoder;
@@ -19,11 +23,27 @@ struct AudioData {
     ma_uint64 end = 0;
     std::mutex mutex;
     ma_device *device;
-    bool preloaded_next_track = false;
+    std::atomic<bool> preloaded_next_track = false;
     
     bool reached_end_of_song = false;  
 };
 
+// Everything a track needs before it can start playing, so it can be done ahead of the click
+struct WarmTrack {
+    std::string path; // what was asked for
+    std::string playable_path; // what the decoder opens (differs for converted songs)
+    
+    std::string title;
+    std::string artist;
+    std::string album;
+    std::string window_title;
+    
+    cairo_surface_t *cover = nullptr; // premultiplied and already at the size the top bar shows it
+    
+    AudioData *data = nullptr; // decoder already initialized
+    std::string length_in_seconds;
+};
+
 enum QueueType {
     SONG,
     ALBUM,
@@ -35,7 +55,10 @@ enum QueueType {
 struct QueueItem {
     QueueType type = QueueType::INVALID;
     
-    std::string path; // Will be set for SONG types
+    // TrackId for SONG types, AlbumId for ALBUM ones, ArtistId for ARTIST ones, PlaylistId for PLAYLIST ones (what
+    // clear_alike compares)
+    uint32_t id = 0;
+    std::string path; // Will be set for SONG types (resolved when queued, so the audio thread doesn't need the catalog)
     int active = 0;
     std::vector<QueueItem> items;
 };
@@ -53,8 +76,11 @@ struct Player {
     std::string album;
     
     std::string length_in_seconds;
-    std::string cover;
     std::string path; // currently being played
+    
+    // Ready to paint cover of the track being played (take a reference, don't copy)
+    std::mutex cover_mutex;
+    cairo_surface_t *cover = nullptr;
         
     //std::vector<std::string> next_tracks;
     //std::vector<std::string> queued_tracks;
@@ -80,6 +106,11 @@ struct Player {
     
     void pop_queue();
     
+    std::string peek_queue();
+    
+    // Prepares the decoder, cover and tags of 'track_path' in the background so the next play_track of it is instant
+    void warm(std::string track_path);
+    
     void set_position(float scalar);
     
     bool animating = false;
@@ -89,17 +120,27 @@ struct Player {
     
     void set_volume(float new_volume);
     
-    void play_next(std::string track_path);
+    void play_next(TrackId track);
+    
+    void play_after_all_next(TrackId track);
+    
+    void play_last(TrackId track);
+    
+    void album_play_next(AlbumId album, int from_index = 0);
+    
+    void album_play_after_all_next(AlbumId album, int from_index = 0);
     
-    void play_after_all_next(std::string track_path);
+    void album_play_last(AlbumId album, int from_index = 0);
     
-    void play_last(std::string track_path);
+    // All of the artist's songs, album after album, as one queue entry
+    void artist_play_next(ArtistId artist);
     
-    void album_play_next(std::string album_name, int from_index = 0);
+    void artist_play_last(ArtistId artist);
     
-    void album_play_after_all_next(std::string album_name, int from_index = 0);
+    // The playlist's songs as one queue entry (the ones not found in the library are skipped)
+    void playlist_play_next(PlaylistId playlist);
     
-    void album_play_last(std::string album_name, int from_index = 0);
+    void playlist_play_last(PlaylistId playlist);
     
     void clear_queue();
     
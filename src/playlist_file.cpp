@@ -0,0 +1,348 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "playlist_file.h"
+#include "rt_log.h"
+#include <cctype>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+
+// How much of the file is read at a time
+#define PLAYLIST_CHUNK_SIZE (64 * 1024)
+
+static bool ends_with_ignoring_case(std::string_view s, std::string_view suffix) {
+    if (s.size() < suffix.size())
+        return false;
+    for (size_t i = 0; i < suffix.size(); i++) {
+        char c = s[s.size() - suffix.size() + i];
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+        if (c != suffix[i])
+            return false;
+    }
+    return true;
+}
+
+PlaylistFormat playlist_format_of(std::string_view path) {
+    if (ends_with_ignoring_case(path, ".m3u8"))
+        return PLAYLIST_M3U8;
+    if (ends_with_ignoring_case(path, ".m3u"))
+        return PLAYLIST_M3U;
+    if (ends_with_ignoring_case(path, ".pls"))
+        return PLAYLIST_PLS;
+    return PLAYLIST_NONE;
+}
+
+static bool is_utf8(std::string_view s) {
+    size_t i = 0;
+    while (i < s.size()) {
+        uint8_t b = s[i];
+        int length = b < 0x80 ? 1 : (b & 0xE0) == 0xC0 ? 2 : (b & 0xF0) == 0xE0 ? 3 : (b & 0xF8) == 0xF0 ? 4 : 0;
+        if (length == 0 || i + length > s.size())
+            return false;
+        for (int k = 1; k < length; k++)
+            if ((s[i + k] & 0xC0) != 0x80)
+                return false;
+        i += length;
+    }
+    return true;
+}
+
+// Text that isn't UTF-8 is taken to be Latin-1, which every byte is valid in
+static std::string as_utf8(std::string_view s) {
+    if (is_utf8(s))
+        return std::string(s);
+    std::string out;
+    out.reserve(s.size() * 2);
+    for (unsigned char c: s) {
+        if (c < 0x80) {
+            out.push_back(c);
+        } else {
+            out.push_back(0xC0 | c >> 6);
+            out.push_back(0x80 | (c & 0x3F));
+        }
+    }
+    return out;
+}
+
+static std::string_view trimmed(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t'))
+        s.remove_prefix(1);
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t' || s.back() == '\r'))
+        s.remove_suffix(1);
+    return s;
+}
+
+static std::string percent_decoded(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); i++) {
+        if (s[i] == '%' && i + 2 < s.size() && isxdigit((unsigned char) s[i + 1]) &&
+            isxdigit((unsigned char) s[i + 2])) {
+            char hex[3] = {s[i + 1], s[i + 2], '\0'};
+            out.push_back((char) strtol(hex, nullptr, 16));
+            i += 2;
+        } else {
+            out.push_back(s[i]);
+        }
+    }
+    return out;
+}
+
+// Takes out empty parts, "." and ".." (which never climbs above the root)
+static std::string normalized(std::string_view path) {
+    std::vector<std::string_view> parts;
+    size_t start = 0;
+    while (start < path.size()) {
+        size_t end = path.find('/', start);
+        if (end == std::string_view::npos)
+            end = path.size();
+        auto part = path.substr(start, end - start);
+        if (part == "..") {
+            if (!parts.empty())
+                parts.pop_back();
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        start = end + 1;
+    }
+    std::string out;
+    out.reserve(path.size());
+    for (auto part: parts) {
+        out.push_back('/');
+        out += part;
+    }
+    return out.empty() ? "/" : out;
+}
+
+// Where an entry line points, made absolute against the playlist's folder, or empty for a stream
+static std::string entry_path(std::string_view line, const std::string &dir) {
+    std::string path;
+    if (line.substr(0, 7) == "file://") {
+        auto rest = line.substr(7);
+        auto slash = rest.find('/'); // past the host, usually empty or "localhost"
+        if (slash == std::string_view::npos)
+            return "";
+        path = percent_decoded(rest.substr(slash));
+    } else if (line.find("://") != std::string_view::npos) {
+        return "";
+    } else {
+        path = line;
+    }
+    if (path.find('\\') != std::string::npos && path.find('/') == std::string::npos) {
+        for (auto &c: path)
+            if (c == '\\')
+                c = '/';
+    }
+    if (path.size() >= 2 && path[1] == ':') // A Windows drive, which only a fuzzy match can make anything of
+        path = "/" + path;
+    else if (path[0] != '/')
+        path = dir + "/" + path;
+    return normalized(path);
+}
+
+// The absolute folder the playlist at 'path' is in
+static std::string folder_of(const std::string &path) {
+    auto slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "" : path.substr(0, slash);
+    if (path[0] != '/') {
+        char cwd[PATH_MAX];
+        if (getcwd(cwd, sizeof(cwd)))
+            dir = std::string(cwd) + "/" + dir;
+    }
+    return normalized(dir);
+}
+
+struct PlaylistReader {
+    PlaylistFormat format = PLAYLIST_M3U;
+    std::string dir; // the playlist's, which relative paths start from
+    PlaylistEntryCallback on_entry = nullptr;
+    void *user_data = nullptr;
+    bool first_line = true;
+
+    // M3U: what the last #EXTINF said, for the path that comes after it
+    std::string title;
+    int length = -1;
+
+    // PLS: FileN= doesn't have to come before TitleN=, or in order, so they're only handed out at the end
+    std::vector<PlaylistEntry> numbered;
+};
+
+static void read_m3u_line(PlaylistReader *reader, std::string_view line) {
+    if (line[0] == '#') {
+        if (line.substr(0, 8) == "#EXTINF:") {
+            auto info = line.substr(8);
+            reader->length = atoi(std::string(info.substr(0, info.find(','))).c_str());
+            auto comma = info.find(',');
+            reader->title = comma == std::string_view::npos ? "" : as_utf8(trimmed(info.substr(comma + 1)));
+        }
+        return;
+    }
+    PlaylistEntry entry;
+    entry.path = entry_path(as_utf8(line), reader->dir);
+    entry.title.swap(reader->title);
+    entry.length = reader->length;
+    reader->length = -1;
+    if (!entry.path.empty())
+        reader->on_entry(entry, reader->user_data);
+}
+
+static void read_pls_line(PlaylistReader *reader, std::string_view line) {
+    auto equals = line.find('=');
+    if (equals == std::string_view::npos)
+        return;
+    auto key = line.substr(0, equals);
+    auto value = trimmed(line.substr(equals + 1));
+    size_t digits = key.size();
+    while (digits > 0 && key[digits - 1] >= '0' && key[digits - 1] <= '9')
+        digits--;
+    if (digits == key.size() || key.size() - digits > 7) // No number, or more entries than any playlist has
+        return;
+    std::string name(key.substr(0, digits));
+    for (auto &c: name)
+        if (c >= 'A' && c <= 'Z')
+            c += 'a' - 'A';
+    size_t number = atoi(std::string(key.substr(digits)).c_str());
+    if (number == 0 || (name != "file" && name != "title" && name != "length"))
+        return;
+    if (reader->numbered.size() < number)
+        reader->numbered.resize(number);
+    auto &entry = reader->numbered[number - 1];
+    if (name == "file")
+        entry.path = entry_path(as_utf8(value), reader->dir);
+    else if (name == "title")
+        entry.title = as_utf8(value);
+    else
+        entry.length = atoi(std::string(value).c_str());
+}
+
+static void read_line(PlaylistReader *reader, std::string_view line) {
+    if (reader->first_line) {
+        reader->first_line = false;
+        if (line.substr(0, 3) == "\xEF\xBB\xBF") // The byte order mark Windows puts in front
+            line.remove_prefix(3);
+    }
+    line = trimmed(line);
+    if (line.empty())
+        return;
+    if (reader->format == PLAYLIST_PLS)
+        read_pls_line(reader, line);
+    else
+        read_m3u_line(reader, line);
+}
+
+bool read_playlist_file(const std::string &path, PlaylistEntryCallback on_entry, void *user_data) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file) {
+        rt_log(RT_WARNING, "Couldn't open the playlist %s", path.c_str());
+        return false;
+    }
+    PlaylistReader reader;
+    reader.format = playlist_format_of(path);
+    reader.dir = folder_of(path);
+    reader.on_entry = on_entry;
+    reader.user_data = user_data;
+
+    // A line can be cut in two by the end of a chunk, so what's left over goes in front of the next one
+    std::string chunk;
+    size_t kept = 0;
+    while (true) {
+        chunk.resize(kept + PLAYLIST_CHUNK_SIZE);
+        size_t got = fread(chunk.data() + kept, 1, PLAYLIST_CHUNK_SIZE, file);
+        size_t end = kept + got;
+        std::string_view text(chunk.data(), end);
+        size_t start = 0;
+        while (true) {
+            auto newline = text.find('\n', start);
+            if (newline == std::string_view::npos)
+                break;
+            read_line(&reader, text.substr(start, newline - start));
+            start = newline + 1;
+        }
+        if (got == 0) {
+            if (start < end)
+                read_line(&reader, text.substr(start));
+            break;
+        }
+        chunk.erase(0, start);
+        kept = end - start;
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+
+    for (auto &entry: reader.numbered)
+        if (!entry.path.empty())
+            on_entry(entry, user_data);
+    return ok;
+}
+
+// 'path' as seen from the folder 'dir' ("../Artist/song.flac"), or as it is when the two only share the root
+static std::string relative_to(const std::string &path, const std::string &dir) {
+    size_t common = 0; // the length of the folders they share, up to a '/'
+    size_t i = 0;
+    while (i < path.size() && i < dir.size() && path[i] == dir[i]) {
+        i++;
+        if (path[i - 1] == '/')
+            common = i - 1;
+    }
+    if (i == dir.size() && i < path.size() && path[i] == '/')
+        common = i;
+    if (common == 0)
+        return path;
+    std::string relative;
+    for (size_t k = common; k < dir.size(); k++)
+        if (dir[k] == '/')
+            relative += "../";
+    relative += path.substr(common + 1);
+    return relative;
+}
+
+bool write_playlist_file(const std::string &path, const std::vector<PlaylistEntry> &entries) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::string dir = folder_of(path);
+    bool pls = playlist_format_of(path) == PLAYLIST_PLS;
+
+    std::string text = pls ? "[playlist]\n" : "#EXTM3U\n";
+    for (size_t i = 0; i < entries.size(); i++) {
+        auto &e = entries[i];
+        std::string where = relative_to(e.path, dir);
+        if (pls) {
+            auto number = std::to_string(i + 1);
+            text += "File" + number + "=" + where + "\n";
+            if (!e.title.empty())
+                text += "Title" + number + "=" + e.title + "\n";
+            if (e.length >= 0)
+                text += "Length" + number + "=" + std::to_string(e.length) + "\n";
+        } else {
+            if (!e.title.empty() || e.length >= 0)
+                text += "#EXTINF:" + std::to_string(e.length) + "," + e.title + "\n";
+            text += where + "\n";
+        }
+    }
+    if (pls)
+        text += "NumberOfEntries=" + std::to_string(entries.size()) + "\nVersion=2\n";
+
+    std::string temp_path = path + ".tmp";
+    FILE *file = fopen(temp_path.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        rt_log(RT_ERROR, "Couldn't write the playlist %s", path.c_str());
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,41 @@
+/* date = October 20th 2026 12:25 am */
+
+#ifndef PLAYLIST_FILE_H
+#define PLAYLIST_FILE_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// The playlist files other players read and write. M3U is one path per line with #EXTINF lines in front carrying
+// "seconds,title"; .m3u8 is the same in UTF-8, while a plain .m3u can be in anything (Latin-1 is assumed for lines
+// that aren't UTF-8). PLS is an ini file of FileN=, TitleN= and LengthN=. Paths can be relative to the playlist,
+// file:// URIs, or from Windows; streams (http:// and the like) are skipped since they can't be in the library.
+
+enum PlaylistFormat {
+    PLAYLIST_M3U,
+    PLAYLIST_M3U8,
+    PLAYLIST_PLS,
+    PLAYLIST_NONE,
+};
+
+// By the extension (in any case)
+PlaylistFormat playlist_format_of(std::string_view path);
+
+struct PlaylistEntry {
+    std::string path; // absolute, with "." and ".." taken out
+    std::string title; // what the playlist calls the song (often "Artist - Title"), empty if it doesn't say
+    int length = -1; // seconds, -1 if it doesn't say
+};
+
+typedef void (*PlaylistEntryCallback)(const PlaylistEntry &entry, void *user_data);
+
+// Reads the playlist a chunk at a time (so a big one never has to fit in memory as text) and hands 'on_entry' every
+// entry in order. False if the file couldn't be read.
+bool read_playlist_file(const std::string &path, PlaylistEntryCallback on_entry, void *user_data);
+
+// As extended M3U in UTF-8, or as PLS for a .pls 'path', through a temporary file. Paths are written relative to the
+// playlist when they share more than the root with it, so the folder can be moved along with the music.
+bool write_playlist_file(const std::string &path, const std::vector<PlaylistEntry> &entries);
+
+#endif //PLAYLIST_FILE_H
@@ -0,0 +1,376 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "playlist_tab.h"
+#include "config.h"
+#include "drawer.h"
+#include "components.h"
+#include "player.h"
+#include "library.h"
+#include "collate.h"
+#include "rt_log.h"
+#include <algorithm>
+#include <sys/eventfd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// How many playlists the right-click menus list
+#define MENU_PLAYLISTS 3
+
+struct PlaylistRow : UserData {
+    PlaylistId playlist = NO_PLAYLIST;
+    cairo_surface_t *cover = nullptr; // made from the first found song's album art once it's loaded
+    int cover_size = 0;
+    bool selected = false;
+    long last_time_clicked = 0;
+
+    ~PlaylistRow() {
+        if (cover) {
+            cairo_surface_destroy(cover);
+        }
+    }
+};
+
+struct PlaylistsData : UserData {
+    uint64_t shown_version = 0; // of the playlists the rows were made for
+    std::string previous_filter;
+};
+
+static AppClient *playlists_client = nullptr;
+static int resolved_fd = -1;
+
+// "2 hr 41 min", or "41 min" under an hour
+static std::string duration_text(uint32_t seconds) {
+    uint32_t minutes = (seconds + 30) / 60;
+    if (minutes < 60)
+        return std::to_string(minutes) + " min";
+    return std::to_string(minutes / 60) + " hr " + std::to_string(minutes % 60) + " min";
+}
+
+static std::string counted(size_t count, const char *one, const char *many) {
+    return std::to_string(count) + " " + (count == 1 ? one : many);
+}
+
+static std::string playlists_folder() {
+    return std::string(getenv("HOME")) + "/Music/Playlists";
+}
+
+static void paint_playlist_row(AppClient *client, cairo_t *cr, Container *c) {
+    auto row = (PlaylistRow *) c->user_data;
+    auto &p = playlist(row->playlist);
+    if (row->selected) {
+        draw_colored_rect(client, ArgbColor(.545, .655, .788, 1), c->real_bounds);
+    } else if (c->state.mouse_hovering) {
+        draw_colored_rect(client, ArgbColor(.945, .953, .973, 1), c->real_bounds);
+    }
+
+    int pad = 8 * config->dpi;
+    int size = c->real_bounds.h - pad * 2;
+    Bounds cover(c->real_bounds.x + pad * 2, c->real_bounds.y + pad, size, size);
+    if (!row->cover) {
+        auto first = std::find_if(p.songs.begin(), p.songs.end(), [](TrackId id) { return id != NO_TRACK; });
+        if (first != p.songs.end()) {
+            if (auto art = album_art(catalog_album_of(*first))) {
+                row->cover = accelerated_surface(app, client, art->width, art->height);
+                paint_surface_with_data(row->cover, art->data, art->width, art->height);
+                row->cover_size = art->width;
+            }
+        }
+    }
+    if (row->cover && row->cover_size > 0) {
+        cairo_save(cr);
+        cairo_translate(cr, cover.x, cover.y);
+        double scale = cover.w / row->cover_size;
+        cairo_scale(cr, scale, scale);
+        cairo_set_source_surface(cr, row->cover, 0, 0);
+        cairo_paint(cr);
+        cairo_restore(cr);
+    } else {
+        draw_colored_rect(client, ArgbColor(.88, .88, .88, 1), cover);
+    }
+
+    std::string stats = counted(p.songs.size(), "song", "songs") + "  ·  " + duration_text(p.length);
+    if (!p.unresolved.empty())
+        stats += "  ·  " + std::to_string(p.unresolved.size()) + " not found";
+    int text_x = cover.x + cover.w + pad * 2;
+    auto text_bounds = c->real_bounds;
+    text_bounds.w -= text_x - c->real_bounds.x + pad;
+    text_bounds.x = text_x;
+    draw_clip_begin(client, text_bounds);
+    {
+        auto [f, w, h] = draw_text_begin(client, 11 * config->dpi, config->font, EXPAND(ArgbColor(0, 0, 0, 1)), p.name);
+        f->draw_text_end(text_x, c->real_bounds.y + c->real_bounds.h / 2 - h);
+    }
+    {
+        auto [f, w, h] = draw_text_begin(client, 9 * config->dpi, config->font, EXPAND(ArgbColor(.44, .44, .44, 1)), stats);
+        f->draw_text_end(text_x, c->real_bounds.y + c->real_bounds.h / 2 + 2 * config->dpi);
+    }
+    draw_clip_end(client);
+}
+
+static void right_click_playlist(AppClient *client, PlaylistId id) {
+    struct PlaylistRightClickData : UserData {
+        PlaylistId playlist;
+    };
+
+    struct RightClickOption : UserData {
+        std::string icon;
+        std::string text;
+        cairo_surface_t *surface = nullptr;
+        ArgbColor icon_color = ArgbColor(1.000, 0.306, 0.420, 1.0);
+    };
+    int option_height = 32 * config->dpi;
+    int options = 4;
+    int option_width = 280 * config->dpi;
+
+    Settings settings;
+    settings.force_position = true;
+    settings.override_redirect = true;
+    settings.decorations = false;
+    settings.x = client->bounds->x + client->mouse_initial_x;
+    settings.y = client->bounds->y + client->mouse_initial_y;
+    settings.w = option_width;
+    settings.h = option_height * options + 8 * config->dpi;
+    settings.dialog = true;
+    PopupSettings popup_settings;
+    popup_settings.name = "right_click_song";
+    auto popup = client->create_popup(popup_settings, settings);
+    auto data = new PlaylistRightClickData;
+    data->playlist = id;
+    popup->user_data = data;
+    popup->root->type = ::vbox;
+    popup->root->when_paint = [](AppClient *client, cairo_t *, Container *c) {
+        draw_colored_rect(client, ArgbColor(1, 1, 1, 1), c->real_bounds);
+        draw_round_rect(client, ArgbColor(.7, .7, .7, 1), c->real_bounds, 0, std::floor(1 * config->dpi));
+    };
+
+    auto add_option = [popup](std::string icon, std::string text) {
+        auto data = new RightClickOption;
+        data->icon = icon;
+        data->text = text;
+        auto option = popup->root->child(FILL_SPACE, FILL_SPACE);
+        load_icon_full_path(app, popup, &data->surface, asset(icon), 24 * config->dpi);
+        dye_surface(data->surface, data->icon_color);
+        option->user_data = data;
+        option->when_paint = [](AppClient *client, cairo_t *, Container *c) {
+            auto data = (RightClickOption *) c->user_data;
+            int width = 24 * config->dpi;
+            if (data->surface) {
+                width = cairo_image_surface_get_width(data->surface);
+            }
+
+            if (c->state.mouse_hovering || c->state.mouse_pressing) {
+                if (c->state.mouse_pressing) {
+                    draw_colored_rect(client, ArgbColor(.93, .93, .93, 1), c->real_bounds);
+                } else {
+                    draw_colored_rect(client, ArgbColor(.955, .955, .955, 1), c->real_bounds);
+                }
+            }
+
+            draw_text(client, 10 * config->dpi, config->font, EXPAND(ArgbColor(0, 0, 0, 1)), data->text, c->real_bounds, 5, 8 * config->dpi * 2 + width);
+            if (data->surface) {
+                int height = cairo_image_surface_get_height(data->surface);
+                cairo_set_source_surface(client->cr, data->surface, c->real_bounds.x + 8 * config->dpi, c->real_bounds.y + c->real_bounds.h * .5 - height * .5);
+                cairo_paint(client->cr);
+            }
+        };
+        option->when_clicked = [](AppClient *client, cairo_t *, Container *c) {
+            auto data = (RightClickOption *) c->user_data;
+            auto client_data = (PlaylistRightClickData *) client->user_data;
+            if (data->text == "Play Next") {
+                player->playlist_play_next(client_data->playlist);
+            } else if (data->text == "Add to Queue") {
+                player->playlist_play_last(client_data->playlist);
+            } else if (data->text == "Export") {
+                auto folder = playlists_folder();
+                mkdir(folder.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+                auto &p = playlist(client_data->playlist);
+                // Over the file it came from if that's in the folder, so exporting again doesn't make a copy
+                std::string file = p.source.rfind(folder + "/", 0) == 0 ? p.source :
+                                   folder + "/" + sanitize_file_name(p.name) + ".m3u8";
+                if (export_playlist(client_data->playlist, file))
+                    rt_log(RT_INFO, "Exported playlist %s to %s", p.name.c_str(), file.c_str());
+            } else if (data->text == "Delete") {
+                playlist_delete(client_data->playlist);
+                if (playlists_client) {
+                    client_layout(app, playlists_client);
+                    request_refresh(app, playlists_client);
+                }
+            }
+            client_close_threaded(app, client);
+        };
+    };
+
+    auto pad = popup->root->child(FILL_SPACE, 4 * config->dpi);
+    add_option("corner-up-right.svg", "Play Next");
+    add_option("arrow-bar-to-down.svg", "Add to Queue");
+    auto seperator = popup->root->child(FILL_SPACE, 8 * config->dpi);
+    seperator->when_paint = [](AppClient *client, cairo_t *, Container *c) {
+        draw_colored_rect(client, ArgbColor(.7, .7, .7, .4),
+                          Bounds(c->real_bounds.x + 20 * config->dpi,
+                                 c->real_bounds.y + 4 * config->dpi,
+                                 c->real_bounds.w - 40 * config->dpi, std::floor(1 * config->dpi)));
+    };
+    add_option("", "Export");
+    add_option("", "Delete");
+    pad = popup->root->child(FILL_SPACE, 4 * config->dpi);
+
+    client_show(app, popup);
+}
+
+static Container *make_playlist_row(Container *content, PlaylistId playlist) {
+    auto row = content->child(FILL_SPACE, 56 * config->dpi);
+    auto data = new PlaylistRow;
+    data->playlist = playlist;
+    row->user_data = data;
+    row->when_paint = paint_playlist_row;
+    row->when_clicked = [](AppClient *client, cairo_t *cr, Container *c) {
+        auto data = (PlaylistRow *) c->user_data;
+        for (auto child: c->parent->children)
+            ((PlaylistRow *) child->user_data)->selected = false;
+        data->selected = true;
+        if (c->state.mouse_button_pressed == 3) {
+            right_click_playlist(client, data->playlist);
+            return;
+        }
+        if (client->app->current - data->last_time_clicked < 500)
+            play_selected_playlist(client);
+        data->last_time_clicked = client->app->current;
+        request_refresh(app, client);
+    };
+    return row;
+}
+
+void play_selected_playlist(AppClient *client) {
+    auto content = container_by_name("playlists_content", client->root);
+    if (!content)
+        return;
+    for (auto child: content->children) {
+        auto data = (PlaylistRow *) child->user_data;
+        if (child->exists && data->selected) {
+            player->playlist_play_next(data->playlist);
+            player->pop_queue();
+            return;
+        }
+    }
+}
+
+// A row for every playlist that isn't deleted, newest last, keeping the selection
+static void make_playlist_rows(Container *content) {
+    PlaylistId selected = NO_PLAYLIST;
+    for (auto child: content->children) {
+        auto row = (PlaylistRow *) child->user_data;
+        if (row->selected)
+            selected = row->playlist;
+        delete child;
+    }
+    content->children.clear();
+    for (PlaylistId id = 0; id < playlist_count(); id++) {
+        if (playlist(id).deleted)
+            continue;
+        auto row = make_playlist_row(content, id);
+        ((PlaylistRow *) row->user_data)->selected = id == selected;
+    }
+}
+
+static void resolved_wakeup(App *app, int fd, void *) {
+    uint64_t count;
+    read(fd, &count, sizeof(count));
+    if (playlists_take_resolved() && playlists_client) {
+        client_layout(app, playlists_client);
+        request_refresh(app, playlists_client);
+    }
+    // Entries that came in while that search ran
+    playlists_resolve_in_background(resolved_fd);
+}
+
+void find_missing_playlist_songs() {
+    if (resolved_fd != -1)
+        playlists_resolve_in_background(resolved_fd);
+}
+
+void fill_playlist_tab(AppClient *client, Container *playlists_root) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    playlists_client = client;
+    std::string home = getenv("HOME");
+    load_playlists(home + "/.cache/lfplayer.playlists");
+    import_playlist_folder(playlists_folder());
+    if (resolved_fd == -1) {
+        resolved_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (resolved_fd != -1)
+            poll_descriptor(app, resolved_fd, EPOLLIN, resolved_wakeup, nullptr, "playlists_resolved");
+    }
+    find_missing_playlist_songs();
+
+    playlists_root->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
+        draw_colored_rect(client, ArgbColor(1, 1, 1, 1), c->real_bounds);
+    };
+
+    ScrollPaneSettings scroll_settings(config->dpi);
+    scroll_settings.right_inline_track = true;
+    auto playlists_scroll = make_newscrollpane_as_child(playlists_root, scroll_settings);
+    playlists_scroll->name = "playlists_root";
+    playlists_scroll->user_data = new PlaylistsData;
+    auto content = playlists_scroll->content;
+    content->name = "playlists_content";
+
+    // The rows are made again whenever a playlist comes or goes (there are never many), and filtered by name
+    content->pre_layout = [](AppClient *client, Container *c, const Bounds &b) {
+        auto data = (PlaylistsData *) c->parent->user_data;
+        if (data->shown_version != playlists_version()) {
+            data->shown_version = playlists_version();
+            make_playlist_rows(c);
+            data->previous_filter = "\n"; // So the filter runs over the new rows
+        }
+        auto filter_textarea = container_by_name("filter_textarea", client->root);
+        if (!filter_textarea)
+            return;
+        auto text = ((TextAreaData *) filter_textarea->user_data)->state->text;
+        if (text == data->previous_filter)
+            return;
+        data->previous_filter = text;
+        auto key = collation_key(text);
+        for (auto row: c->children) {
+            auto &p = playlist(((PlaylistRow *) row->user_data)->playlist);
+            row->exists = key.empty() || collation_key(p.name).find(key) != std::string::npos;
+        }
+    };
+}
+
+void playlist_tab_apply_changes(AppClient *client, const CatalogChanges &changes) {
+    // Rows paint straight from the playlists (and pick up a cover once their first song has one)
+    playlists_apply_changes(changes);
+    // Entries that didn't match anything get another go with the new songs (a run already going picks them up after)
+    if (!changes.added.empty())
+        find_missing_playlist_songs();
+    request_refresh(app, client);
+}
+
+std::vector<PlaylistId> playlists_for_menu() {
+    std::vector<PlaylistId> ids;
+    for (PlaylistId id = playlist_count(); id-- > 0 && ids.size() < MENU_PLAYLISTS;)
+        if (!playlist(id).deleted)
+            ids.push_back(id);
+    return ids;
+}
+
+PlaylistId new_playlist_with(const std::vector<TrackId> &songs) {
+    std::string name = "Playlist";
+    for (int number = 2;; number++) {
+        bool taken = false;
+        for (PlaylistId id = 0; id < playlist_count(); id++)
+            taken |= !playlist(id).deleted && playlist(id).name == name;
+        if (!taken)
+            break;
+        name = "Playlist " + std::to_string(number);
+    }
+    auto id = playlist_create(name);
+    playlist_add(id, songs);
+    return id;
+}
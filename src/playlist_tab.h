@@ -0,0 +1,30 @@
+/* date = October 20th 2026 1:35 am */
+
+#ifndef PLAYLIST_TAB_H
+#define PLAYLIST_TAB_H
+
+#include "container.h"
+#include "main.h"
+#include "playlists.h"
+
+// Loads the saved playlists and imports the new or changed files in ~/Music/Playlists (fill_songs_tab has to have
+// loaded the catalog), then shows a row for each with its song count, how long it plays for and how many of its songs
+// haven't been found
+void fill_playlist_tab(AppClient *client, Container *playlists_root);
+
+// Fills in the entries whose songs the library watcher saw show up
+void playlist_tab_apply_changes(AppClient *client, const CatalogChanges &changes);
+
+// Searches the library for the songs still missing from the playlists (once a scan is through, so it's complete)
+void find_missing_playlist_songs();
+
+// Puts the selected playlist up next and starts playing it
+void play_selected_playlist(AppClient *client);
+
+// The playlists the right-click menus offer to add to: the newest few, newest first
+std::vector<PlaylistId> playlists_for_menu();
+
+// "Playlist" (or "Playlist 2" and so on, whichever is free) made out of 'songs'
+PlaylistId new_playlist_with(const std::vector<TrackId> &songs);
+
+#endif //PLAYLIST_TAB_H
@@ -0,0 +1,588 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "playlists.h"
+#include "playlist_file.h"
+#include "library_cache.h"
+#include "search.h"
+#include "rt_log.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <mutex>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+
+// The playlists file (native byte order like the library cache):
+//
+//   PlaylistsHeader
+//   PlaylistRecord[playlist_count]
+//   uint32_t[entry_count]: the path of every entry, one playlist after the other
+//   TitleRecord[title_count]: the titles the unresolved entries came with
+//   string table, laid out like the library cache's
+//
+// A deleted playlist that was imported keeps its record (without entries) so its file isn't imported again.
+
+#define PLAYLISTS_MAGIC "LFPL"
+#define PLAYLISTS_VERSION 1
+
+#define PLAYLIST_DELETED (1 << 0)
+
+struct PlaylistsHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t playlist_count;
+    uint32_t entry_count;
+    uint32_t title_count;
+    uint32_t strings_size;
+};
+
+struct PlaylistRecord {
+    uint32_t name;
+    uint32_t source;
+    int64_t source_mtime;
+    uint32_t flags; // PLAYLIST_*
+    uint32_t first_entry;
+    uint32_t entry_count;
+    uint32_t first_title;
+    uint32_t title_count;
+    uint32_t unused; // keeps the size a multiple of 8
+};
+
+struct TitleRecord {
+    uint32_t position;
+    uint32_t title;
+};
+
+static std::vector<Playlist> playlists;
+static std::string playlists_path;
+static uint64_t version = 0;
+
+// Handed over from the resolving thread
+struct ResolvedEntry {
+    PlaylistId playlist;
+    uint32_t position;
+    std::string path; // that it was for, in case the playlist changed in the meantime
+    TrackId id;
+};
+
+static std::mutex resolve_mutex;
+static bool resolving = false;
+static std::vector<ResolvedEntry> resolved;
+
+// NO_TRACK if no song in the library has that path (without adding it to the string pool if it's new)
+static TrackId find_path(std::string_view path) {
+    StringId id = pool_find(path);
+    if (id == 0)
+        return NO_TRACK;
+    TrackId track = catalog_find(id);
+    if (track == NO_TRACK || catalog_album_of(track) == NO_ALBUM)
+        return NO_TRACK;
+    return track;
+}
+
+// "Album/01 Song.flac", which stays the same when the library as a whole is somewhere else
+static std::string_view path_tail(std::string_view path) {
+    auto last = path.rfind('/');
+    if (last == std::string_view::npos || last == 0)
+        return path;
+    auto before = path.rfind('/', last - 1);
+    return before == std::string_view::npos ? path : path.substr(before + 1);
+}
+
+// Every song in the library by path_tail, NO_TRACK for the tails more than one song has
+static std::unordered_map<std::string_view, TrackId> tail_index() {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::unordered_map<std::string_view, TrackId> tails;
+    tails.reserve(catalog_track_count());
+    for (TrackId id = 0; id < catalog_track_count(); id++) {
+        if (catalog_album_of(id) == NO_ALBUM)
+            continue;
+        auto [it, added] = tails.emplace(path_tail(pool_view(catalog_track(id).path)), id);
+        if (!added)
+            it->second = NO_TRACK;
+    }
+    return tails;
+}
+
+static void recount(Playlist *p) {
+    p->length = 0;
+    for (auto id: p->songs)
+        if (id != NO_TRACK && catalog_album_of(id) != NO_ALBUM)
+            p->length += catalog_track(id).length;
+}
+
+// Fills in the unresolved entries of 'p' that the catalog has now, by path, then by 'tails' if there are any
+static bool resolve_known(Playlist *p, const std::unordered_map<std::string_view, TrackId> *tails) {
+    auto &list = p->unresolved;
+    size_t kept = 0;
+    for (size_t i = 0; i < list.size(); i++) {
+        TrackId id = find_path(list[i].path);
+        if (id == NO_TRACK && tails) {
+            auto it = tails->find(path_tail(list[i].path));
+            if (it != tails->end())
+                id = it->second;
+        }
+        if (id != NO_TRACK) {
+            p->songs[list[i].position] = id;
+        } else {
+            if (kept != i)
+                list[kept] = std::move(list[i]);
+            kept++;
+        }
+    }
+    bool any = kept != list.size();
+    list.resize(kept);
+    if (any)
+        recount(p);
+    return any;
+}
+
+static void save_playlists() {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    if (playlists_path.empty())
+        return;
+    StringTable table;
+    std::vector<PlaylistRecord> records;
+    std::vector<uint32_t> entries;
+    std::vector<TitleRecord> titles;
+    for (auto &p: playlists) {
+        if (p.deleted && p.source.empty())
+            continue;
+        PlaylistRecord r{};
+        r.name = table.add(p.name);
+        r.source = table.add(p.source);
+        r.source_mtime = p.source_mtime;
+        r.flags = p.deleted ? PLAYLIST_DELETED : 0;
+        r.first_entry = entries.size();
+        r.entry_count = p.songs.size();
+        r.first_title = titles.size();
+        size_t next = 0; // the next unresolved entry, they go by position too
+        for (uint32_t i = 0; i < p.songs.size(); i++) {
+            if (p.songs[i] != NO_TRACK) {
+                entries.push_back(table.add(pool_string(catalog_track(p.songs[i]).path)));
+                continue;
+            }
+            while (next < p.unresolved.size() && p.unresolved[next].position < i)
+                next++;
+            auto &u = p.unresolved[next];
+            entries.push_back(table.add(u.path));
+            if (!u.title.empty())
+                titles.push_back({i, table.add(u.title)});
+        }
+        r.title_count = titles.size() - r.first_title;
+        records.push_back(r);
+    }
+
+    PlaylistsHeader header{};
+    memcpy(header.magic, PLAYLISTS_MAGIC, 4);
+    header.version = PLAYLISTS_VERSION;
+    header.playlist_count = records.size();
+    header.entry_count = entries.size();
+    header.title_count = titles.size();
+    header.strings_size = table.bytes.size();
+
+    std::string temp_path = playlists_path + ".tmp";
+    FILE *file = fopen(temp_path.c_str(), "wb");
+    if (!file)
+        return;
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+              fwrite(records.data(), sizeof(PlaylistRecord), records.size(), file) == records.size() &&
+              fwrite(entries.data(), sizeof(uint32_t), entries.size(), file) == entries.size() &&
+              fwrite(titles.data(), sizeof(TitleRecord), titles.size(), file) == titles.size() &&
+              fwrite(table.bytes.data(), 1, table.bytes.size(), file) == table.bytes.size();
+    ok = fclose(file) == 0 && ok;
+    if (!ok || std::rename(temp_path.c_str(), playlists_path.c_str()) != 0) {
+        rt_log(RT_ERROR, "Couldn't write the playlists to %s", playlists_path.c_str());
+        unlink(temp_path.c_str());
+    }
+}
+
+static void changed() {
+    version++;
+    save_playlists();
+}
+
+void load_playlists(const std::string &path) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    playlists.clear();
+    playlists_path = path;
+    version++;
+
+    std::string bytes;
+    if (FILE *file = fopen(path.c_str(), "rb")) {
+        char chunk[64 * 1024];
+        size_t got;
+        while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0)
+            bytes.append(chunk, got);
+        fclose(file);
+    }
+    if (bytes.size() < sizeof(PlaylistsHeader))
+        return;
+    PlaylistsHeader h;
+    memcpy(&h, bytes.data(), sizeof(h));
+    size_t records_at = sizeof(PlaylistsHeader);
+    size_t entries_at = records_at + (size_t) h.playlist_count * sizeof(PlaylistRecord);
+    size_t titles_at = entries_at + (size_t) h.entry_count * sizeof(uint32_t);
+    size_t strings_at = titles_at + (size_t) h.title_count * sizeof(TitleRecord);
+    if (memcmp(h.magic, PLAYLISTS_MAGIC, 4) != 0 || h.version != PLAYLISTS_VERSION ||
+        strings_at + h.strings_size != bytes.size()) {
+        rt_log(RT_WARNING, "Playlists file %s is damaged or from another version, ignoring it", path.c_str());
+        return;
+    }
+    const char *strings = bytes.data() + strings_at;
+    auto string_at = [&](uint32_t offset, std::string_view *out) {
+        if (offset % 4 != 0 || (uint64_t) offset + sizeof(uint32_t) + 1 > h.strings_size)
+            return false;
+        uint32_t length;
+        memcpy(&length, strings + offset, sizeof(length));
+        if ((uint64_t) offset + sizeof(uint32_t) + length + 1 > h.strings_size)
+            return false;
+        *out = std::string_view(strings + offset + sizeof(uint32_t), length);
+        return true;
+    };
+    auto entries = (const uint32_t *) (bytes.data() + entries_at);
+    auto titles = (const TitleRecord *) (bytes.data() + titles_at);
+
+    std::unordered_map<std::string_view, TrackId> tails;
+    bool have_tails = false;
+    for (uint32_t i = 0; i < h.playlist_count; i++) {
+        PlaylistRecord r;
+        memcpy(&r, bytes.data() + records_at + i * sizeof(PlaylistRecord), sizeof(r));
+        std::string_view name, source;
+        if (!string_at(r.name, &name) || !string_at(r.source, &source) ||
+            (uint64_t) r.first_entry + r.entry_count > h.entry_count ||
+            (uint64_t) r.first_title + r.title_count > h.title_count) {
+            rt_log(RT_WARNING, "Playlists file %s is damaged, ignoring the rest of it", path.c_str());
+            break;
+        }
+        Playlist p;
+        p.name = name;
+        p.source = source;
+        p.source_mtime = r.source_mtime;
+        p.deleted = r.flags & PLAYLIST_DELETED;
+        p.songs.reserve(r.entry_count);
+        const TitleRecord *title = titles + r.first_title;
+        const TitleRecord *titles_end = title + r.title_count;
+        for (uint32_t e = 0; e < r.entry_count; e++) {
+            std::string_view entry;
+            if (!string_at(entries[r.first_entry + e], &entry))
+                continue;
+            TrackId id = find_path(entry);
+            if (id == NO_TRACK) {
+                UnresolvedEntry u;
+                u.position = p.songs.size();
+                u.path = entry;
+                while (title < titles_end && title->position < e)
+                    title++;
+                std::string_view title_text;
+                if (title < titles_end && title->position == e && string_at(title->title, &title_text))
+                    u.title = title_text;
+                p.unresolved.push_back(std::move(u));
+            }
+            p.songs.push_back(id);
+        }
+        // The library might have moved since
+        if (!p.unresolved.empty()) {
+            if (!have_tails)
+                tails = tail_index();
+            have_tails = true;
+            resolve_known(&p, &tails);
+        }
+        recount(&p);
+        playlists.push_back(std::move(p));
+    }
+}
+
+size_t playlist_count() {
+    return playlists.size();
+}
+
+const Playlist &playlist(PlaylistId id) {
+    return playlists[id];
+}
+
+uint64_t playlists_version() {
+    return version;
+}
+
+PlaylistId playlist_create(const std::string &name) {
+    Playlist p;
+    p.name = name;
+    playlists.push_back(std::move(p));
+    changed();
+    return playlists.size() - 1;
+}
+
+void playlist_add(PlaylistId id, const std::vector<TrackId> &songs) {
+    auto &p = playlists[id];
+    for (auto song: songs)
+        if (song != NO_TRACK)
+            p.songs.push_back(song);
+    recount(&p);
+    changed();
+}
+
+void playlist_delete(PlaylistId id) {
+    auto &p = playlists[id];
+    p.deleted = true;
+    p.songs.clear();
+    p.unresolved.clear();
+    p.length = 0;
+    changed();
+}
+
+static void add_entry(const PlaylistEntry &entry, void *user_data) {
+    auto p = (Playlist *) user_data;
+    TrackId id = find_path(entry.path);
+    if (id == NO_TRACK) {
+        UnresolvedEntry u;
+        u.position = p->songs.size();
+        u.path = entry.path;
+        u.title = entry.title;
+        p->unresolved.push_back(std::move(u));
+    }
+    p->songs.push_back(id);
+}
+
+PlaylistId import_playlist(const std::string &file) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto start = std::chrono::steady_clock::now();
+    struct stat st{};
+    if (playlist_format_of(file) == PLAYLIST_NONE || stat(file.c_str(), &st) != 0)
+        return NO_PLAYLIST;
+    Playlist p;
+    p.name = std::filesystem::path(file).stem().string();
+    p.source = file;
+    p.source_mtime = st.st_mtime;
+    if (!read_playlist_file(file, add_entry, &p))
+        return NO_PLAYLIST;
+    if (!p.unresolved.empty()) {
+        auto tails = tail_index();
+        resolve_known(&p, &tails);
+    }
+    recount(&p);
+    rt_log(RT_INFO, "Imported playlist %s: %zu songs, %zu not found (yet), in %ld ms", file.c_str(), p.songs.size(),
+           p.unresolved.size(),
+           (long) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+
+    // Importing the same file again replaces what it was imported as
+    PlaylistId id = NO_PLAYLIST;
+    for (PlaylistId i = 0; i < playlists.size(); i++)
+        if (playlists[i].source == file)
+            id = i;
+    if (id == NO_PLAYLIST) {
+        playlists.push_back(std::move(p));
+        id = playlists.size() - 1;
+    } else {
+        playlists[id] = std::move(p);
+    }
+    changed();
+    return id;
+}
+
+void import_playlist_folder(const std::string &dir) {
+    std::error_code ec;
+    for (auto &item: std::filesystem::directory_iterator(dir, ec)) {
+        std::string file = item.path().string();
+        struct stat st{};
+        if (playlist_format_of(file) == PLAYLIST_NONE || stat(file.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        bool known = false;
+        for (auto &p: playlists)
+            known |= p.source == file && p.source_mtime == st.st_mtime;
+        if (!known)
+            import_playlist(file);
+    }
+}
+
+bool export_playlist(PlaylistId id, const std::string &file) {
+    auto &p = playlists[id];
+    std::vector<PlaylistEntry> entries;
+    entries.reserve(p.songs.size());
+    size_t next = 0;
+    for (uint32_t i = 0; i < p.songs.size(); i++) {
+        PlaylistEntry e;
+        if (p.songs[i] != NO_TRACK) {
+            auto &track = catalog_track(p.songs[i]);
+            e.path = pool_string(track.path);
+            e.title = pool_string(track.title);
+            if (track.artist != 0 && !e.title.empty())
+                e.title = pool_string(track.artist) + " - " + e.title;
+            e.length = track.length;
+        } else {
+            while (next < p.unresolved.size() && p.unresolved[next].position < i)
+                next++;
+            e.path = p.unresolved[next].path;
+            e.title = p.unresolved[next].title;
+        }
+        entries.push_back(std::move(e));
+    }
+    if (!write_playlist_file(file, entries))
+        return false;
+    // So the folder import doesn't bring it back as a second playlist
+    struct stat st{};
+    if (stat(file.c_str(), &st) == 0) {
+        p.source = file;
+        p.source_mtime = st.st_mtime;
+        changed();
+    }
+    return true;
+}
+
+void playlists_apply_changes(const CatalogChanges &changes) {
+    if (changes.added.empty())
+        return;
+    bool any = false;
+    for (auto &p: playlists) {
+        if (p.unresolved.empty())
+            continue;
+        any |= resolve_known(&p, nullptr);
+        for (auto &u: p.unresolved)
+            u.tried = false; // One of the new songs might be it
+    }
+    if (any)
+        changed();
+}
+
+// The words of a title or file name worth searching for: no punctuation, and for a file name no track number in front
+static std::string search_words(std::string_view text, bool file_name) {
+    std::string words;
+    std::string word;
+    auto flush = [&] {
+        bool number = std::all_of(word.begin(), word.end(), [](char c) { return c >= '0' && c <= '9'; });
+        if (!(number && file_name && words.empty())) {
+            if (!words.empty())
+                words.push_back(' ');
+            words += word;
+        }
+        word.clear();
+    };
+    for (char c: text) {
+        if ((unsigned char) c >= 0x80 || isalnum((unsigned char) c) || c == '\'')
+            word.push_back(c);
+        else if (!word.empty())
+            flush();
+    }
+    if (!word.empty())
+        flush();
+    return words;
+}
+
+// The song 'query' finds if it's a clearly better match than any other (the folder's words can break a tie)
+static TrackId best_match(const std::string &query, const std::string &folder) {
+    auto hits = search_library(query);
+    if (hits.size() > 1 && !folder.empty()) {
+        auto narrower = search_library(query + " " + folder);
+        if (!narrower.empty())
+            hits.swap(narrower);
+    }
+    if (hits.empty() || (hits.size() > 1 && hits[0].score == hits[1].score))
+        return NO_TRACK;
+    return hits[0].id;
+}
+
+void playlists_resolve_in_background(int notify_fd) {
+    struct Job {
+        PlaylistId playlist;
+        uint32_t position;
+        std::string path;
+        std::string query;
+        std::string folder;
+    };
+    {
+        std::lock_guard<std::mutex> guard(resolve_mutex);
+        if (resolving)
+            return; // What's left gets its turn once this run is taken (see playlists_take_resolved)
+    }
+    std::vector<Job> jobs;
+    for (PlaylistId id = 0; id < playlists.size(); id++) {
+        for (auto &u: playlists[id].unresolved) {
+            if (u.tried)
+                continue;
+            u.tried = true;
+            std::string_view name = u.path;
+            name.remove_prefix(name.rfind('/') + 1);
+            std::string_view folder = std::string_view(u.path).substr(0, u.path.size() - name.size());
+            if (!folder.empty())
+                folder.remove_suffix(1);
+            folder.remove_prefix(folder.rfind('/') + 1);
+            if (u.title.empty() && name.rfind('.') != std::string_view::npos)
+                name = name.substr(0, name.rfind('.'));
+            Job job{id, u.position, u.path,
+                    u.title.empty() ? search_words(name, true) : search_words(u.title, false),
+                    search_words(folder, false)};
+            if (!job.query.empty())
+                jobs.push_back(std::move(job));
+        }
+    }
+    if (jobs.empty())
+        return;
+    {
+        std::lock_guard<std::mutex> guard(resolve_mutex);
+        resolving = true;
+    }
+    std::thread([jobs = std::move(jobs), notify_fd] {
+        std::vector<ResolvedEntry> found;
+        for (auto &job: jobs) {
+            TrackId id = best_match(job.query, job.folder);
+            if (id != NO_TRACK)
+                found.push_back({job.playlist, job.position, job.path, id});
+        }
+        rt_log(RT_INFO, "Playlists: searching found %zu of %zu missing songs", found.size(), jobs.size());
+        {
+            std::lock_guard<std::mutex> guard(resolve_mutex);
+            resolving = false;
+            for (auto &r: found)
+                resolved.push_back(std::move(r));
+        }
+        uint64_t one = 1;
+        write(notify_fd, &one, sizeof(one));
+    }).detach();
+}
+
+bool playlists_take_resolved() {
+    std::vector<ResolvedEntry> results;
+    {
+        std::lock_guard<std::mutex> guard(resolve_mutex);
+        results.swap(resolved);
+    }
+    std::vector<PlaylistId> touched;
+    for (auto &r: results) {
+        if (r.playlist >= playlists.size() || catalog_album_of(r.id) == NO_ALBUM)
+            continue;
+        auto &p = playlists[r.playlist];
+        auto it = std::lower_bound(p.unresolved.begin(), p.unresolved.end(), r.position,
+                                   [](const UnresolvedEntry &u, uint32_t position) { return u.position < position; });
+        if (it == p.unresolved.end() || it->position != r.position || it->path != r.path)
+            continue;
+        p.songs[r.position] = r.id;
+        p.unresolved.erase(it);
+        touched.push_back(r.playlist);
+    }
+    if (touched.empty())
+        return false;
+    std::sort(touched.begin(), touched.end());
+    touched.erase(std::unique(touched.begin(), touched.end()), touched.end());
+    for (auto id: touched)
+        recount(&playlists[id]);
+    changed();
+    return true;
+}
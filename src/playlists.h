@@ -0,0 +1,76 @@
+/* date = October 20th 2026 12:50 am */
+
+#ifndef PLAYLISTS_H
+#define PLAYLISTS_H
+
+#include "catalog.h"
+#include <string>
+#include <vector>
+
+// The user's playlists, each an array of TrackIds, kept in ~/.cache/lfplayer.playlists. TrackIds only last a run, so
+// the file holds the paths (every one once) and load_playlists turns them back into ids through the catalog. Entries
+// the catalog doesn't have (an imported playlist from another machine, a song that was moved) stay in their place as
+// NO_TRACK, remembering what they were, until a song turns up at that path or playlists_resolve_in_background finds
+// one that matches. Only touched from the main thread.
+typedef uint32_t PlaylistId;
+
+#define NO_PLAYLIST ((PlaylistId) -1)
+
+struct UnresolvedEntry {
+    uint32_t position = 0; // into Playlist::songs
+    std::string path;
+    std::string title; // what the imported playlist called it, if anything
+    bool tried = false; // already looked for in the background
+};
+
+struct Playlist {
+    std::string name;
+    std::vector<TrackId> songs; // NO_TRACK for the entries not found yet
+    std::vector<UnresolvedEntry> unresolved; // by position
+    uint32_t length = 0; // seconds, the songs that were found
+    std::string source; // the file it was imported from or last exported to, if any
+    int64_t source_mtime = 0; // of 'source' then, so it isn't imported again unless it changes
+    bool deleted = false; // ids aren't reused, so the queue can hold on to one
+};
+
+// Reads the playlists saved at 'path' (the catalog has to be loaded first); every change after this is saved there
+void load_playlists(const std::string &path);
+
+// Ids go from 0 up to this (deleted playlists included)
+size_t playlist_count();
+
+const Playlist &playlist(PlaylistId id);
+
+// Goes up by one with every change, so views can tell they're out of date
+uint64_t playlists_version();
+
+PlaylistId playlist_create(const std::string &name);
+
+// Appends 'songs' to the end
+void playlist_add(PlaylistId id, const std::vector<TrackId> &songs);
+
+void playlist_delete(PlaylistId id);
+
+// An M3U, M3U8 or PLS file as a playlist named after the file, or in place of the one imported from it before. Paths
+// are looked up in the catalog's path index without adding anything to the string pool, then what's left by the
+// last two parts of the path (a library that lives somewhere else on this machine), and the rest is left unresolved.
+PlaylistId import_playlist(const std::string &file);
+
+// Every playlist file in 'dir' that wasn't imported yet, or changed since it was
+void import_playlist_folder(const std::string &dir);
+
+// Writes the playlist out as M3U8 (or PLS, by the extension), unresolved entries included
+bool export_playlist(PlaylistId id, const std::string &file);
+
+// Fills in the unresolved entries whose path the library watcher just saw show up, and has the rest searched for
+// again next time
+void playlists_apply_changes(const CatalogChanges &changes);
+
+// Looks for the unresolved entries not tried yet on a thread of their own, searching the library for the title the
+// playlist gave them (or their file name). 'notify_fd' (an eventfd) is written to when it's done.
+void playlists_resolve_in_background(int notify_fd);
+
+// Puts what the background search found into the playlists; true if anything changed
+bool playlists_take_resolved();
+
+#endif //PLAYLISTS_H
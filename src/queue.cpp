@@ -73,41 +73,34 @@ void add_queue_items(AppClient *client, ScrollContainer *queue_scroll, const std
         auto c = queue_scroll->content->child(FILL_SPACE, 64 * config->dpi);
         auto data = new QueueOption;
         
-        std::string album_name;
+        AlbumId album = NO_ALBUM;
         if (item.type == QueueType::ALBUM) {
-            for (auto tuple : album_songs) {
-                if (tuple.first == item.path) {
-                    for (auto song_data : tuple.second.songs) {
-                        data->top = item.path;
-                        data->middle = song_data.artist;
-                        album_name = data->top;
-                        goto out;
-                    }
-                }
-            }
+            auto &a = catalog_album(item.id);
+            data->top = pool_string(a.name);
+            if (!a.songs.empty())
+                data->middle = pool_string(catalog_track(a.songs[0]).artist);
+            album = item.id;
+        } else if (item.type == QueueType::ARTIST) {
+            auto &a = catalog_artist(item.id);
+            data->top = pool_string(a.name);
+            data->middle = std::to_string(item.items.size()) + (item.items.size() == 1 ? " song" : " songs");
+            album = a.cover;
+        } else if (item.type == QueueType::PLAYLIST) {
+            data->top = playlist(item.id).name;
+            data->middle = std::to_string(item.items.size()) + (item.items.size() == 1 ? " song" : " songs");
+            if (!item.items.empty())
+                album = catalog_album_of(item.items[0].id);
          } else if (item.type == QueueType::SONG) {
-            // item.path for song is the full path
-            for (auto tuple : album_songs) {
-                for (auto song_data : tuple.second.songs) {
-                    if (song_data.full == item.path) {
-                        data->top = song_data.name;
-                        data->middle = song_data.album;
-                        data->bottom = song_data.artist;
-                        album_name = song_data.album;
-                        goto out;
-                    }
-                }
-            }
+            auto &song_data = catalog_track(item.id);
+            data->top = pool_string(song_data.title);
+            data->middle = pool_string(song_data.album);
+            data->bottom = pool_string(song_data.artist);
+            album = catalog_album_of(item.id);
         }  
-        out:
         
-        if (!album_name.empty()) { 
-            for (auto art : cached_art) {
-                if (art->name == sanitize_file_name(album_name)) {
-                    data->surface = accelerated_surface(app, client, art->width, art->height);
-                    paint_surface_with_data(data->surface, art->data, art->width, art->height);
-                }
-            }
+        if (auto art = album_art(album)) { 
+            data->surface = accelerated_surface(app, client, art->width, art->height);
+            paint_surface_with_data(data->surface, art->data, art->width, art->height);
         }
         
         c->user_data = data;
@@ -0,0 +1,594 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "search.h"
+#include "collate.h"
+#include "library.h"
+#include <algorithm>
+#include <climits>
+#include <mutex>
+#include <unordered_map>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define FTS_FUZZY_MATCH_IMPLEMENTATION
+#include "fts_fuzzy_match.h"
+
+// How many candidates are verified between looks at whether the search was cancelled
+#define CANCEL_CHECK_EVERY 512
+
+typedef uint32_t Trigram; // three bytes of a collation key
+
+#define FIELD_COUNT 4
+
+// What's searched of a song, copied out of the catalog so the search thread never has to touch it. The fields are
+// the collation keys, and queries are turned into one too, so "bjork" finds "Björk" without anything being lowercased
+// or folded per song while searching.
+struct SearchSong {
+    StringId fields[FIELD_COUNT] = {}; // by SearchField
+    bool live = false;
+};
+
+// What conditions (year:>2000) are checked against
+enum Column {
+    COLUMN_YEAR,
+    COLUMN_LENGTH, // seconds
+    COLUMN_GENRE, // the StringId of the collation key
+    COLUMN_COUNT,
+};
+
+// All of this is read by the search thread while the main thread changes it
+static std::mutex index_mutex;
+static std::vector<SearchSong> songs; // by TrackId
+// The characters each field has (see char_mask), one array per field by TrackId, so the prefilter goes straight
+// through memory. Songs that aren't live have none.
+static std::vector<uint64_t> field_masks[FIELD_COUNT];
+static std::vector<int32_t> columns[COLUMN_COUNT]; // by TrackId
+static std::unordered_map<StringId, uint32_t> genre_songs; // the genre keys of live songs, to how many have it
+// Every trigram to the songs that have it (sorted, each song once)
+static std::unordered_map<Trigram, std::vector<TrackId>> postings;
+// Bumped whenever a song goes in or out
+static uint64_t index_version = 0;
+
+static void add_trigrams(std::string_view key, std::vector<Trigram> *out) {
+    for (size_t i = 0; i + 3 <= key.size(); i++)
+        out->push_back((uint8_t) key[i] | (uint8_t) key[i + 1] << 8 | (uint32_t) (uint8_t) key[i + 2] << 16);
+}
+
+// Sorted and unique (into 'trigrams', which is reused between songs so it doesn't allocate every time)
+static void trigrams_of(const SearchSong &song, std::vector<Trigram> *trigrams) {
+    trigrams->clear();
+    for (StringId field: song.fields)
+        add_trigrams(pool_view(field), trigrams);
+    std::sort(trigrams->begin(), trigrams->end());
+    trigrams->erase(std::unique(trigrams->begin(), trigrams->end()), trigrams->end());
+}
+
+// A bit per letter (either case) and digit, with the rest of ASCII hashed into 12 more, and the bytes of UTF-8
+// sequences into the last 16 (fuzzy matching goes byte by byte too, so a word's bytes can come from anywhere)
+static uint64_t char_bit(uint8_t c) {
+    if (c >= 'A' && c <= 'Z')
+        c += 'a' - 'A';
+    if (c >= 'a' && c <= 'z')
+        return 1ull << (c - 'a');
+    if (c >= '0' && c <= '9')
+        return 1ull << (26 + c - '0');
+    if (c < 0x80)
+        return 1ull << (36 + c % 12);
+    return 1ull << (48 + c % 16);
+}
+
+static uint64_t char_mask(std::string_view s) {
+    uint64_t mask = 0;
+    for (auto c: s)
+        mask |= char_bit(c);
+    return mask;
+}
+
+// Passes when the column's value is inside any of the ranges (both ends included)
+struct Condition {
+    Column column;
+    std::vector<std::pair<int32_t, int32_t>> ranges;
+};
+
+struct Word {
+    std::string text; // a collation key
+    SearchField field;
+    uint64_t mask; // char_mask of the text
+};
+
+// What a query compiles to: the conditions get checked first, then the trigrams of the words rule songs out,
+// then their masks, and only then are the words matched (and scored)
+struct Plan {
+    std::vector<Condition> conditions;
+    std::vector<Word> words;
+    std::vector<Trigram> trigrams; // of the words long enough to have any, sorted and unique
+    bool nothing = false; // there's a condition no song can pass (a genre nobody has)
+};
+
+// Splits on spaces, except inside quotes (which are dropped), so artist:"sigur ros" is one token
+static std::vector<std::string> tokenize(const std::string &text) {
+    std::vector<std::string> tokens;
+    std::string token;
+    bool quoted = false;
+    for (char c: text) {
+        if (c == '"') {
+            quoted = !quoted;
+        } else if (c == ' ' && !quoted) {
+            if (!token.empty())
+                tokens.push_back(token);
+            token.clear();
+        } else {
+            token += c;
+        }
+    }
+    if (!token.empty())
+        tokens.push_back(token);
+    return tokens;
+}
+
+static void add_words(const std::string &folded, SearchField field, Plan *plan) {
+    size_t start = 0;
+    while (start < folded.size()) {
+        size_t end = folded.find(' ', start);
+        if (end == std::string::npos)
+            end = folded.size();
+        if (end > start) {
+            std::string text = folded.substr(start, end - start);
+            add_trigrams(text, &plan->trigrams);
+            plan->words.push_back({text, field, char_mask(text)});
+        }
+        start = end + 1;
+    }
+}
+
+static bool parse_digits(const std::string &s, long long *number) {
+    if (s.empty() || s.size() > 9 || s.find_first_not_of("0123456789") != std::string::npos)
+        return false;
+    *number = std::stoll(s);
+    return true;
+}
+
+// "1997", or for lengths "3:30", "5m", "3m30s", "90s", "1h" or a bare number of minutes. 'span' is how much
+// more still counts as the same (the rest of the minute when it stopped at minutes).
+static bool parse_number(const std::string &s, bool duration, int32_t *value, int32_t *span) {
+    long long number, total = 0;
+    *span = 0;
+    if (!duration) {
+        if (!parse_digits(s, &number))
+            return false;
+        *value = (int32_t) number;
+        return true;
+    }
+    size_t colon = s.find(':');
+    if (colon != std::string::npos) {
+        long long seconds;
+        if (!parse_digits(s.substr(0, colon), &number) || !parse_digits(s.substr(colon + 1), &seconds))
+            return false;
+        total = number * 60 + seconds;
+    } else if (parse_digits(s, &number)) {
+        total = number * 60;
+        *span = 59;
+    } else {
+        size_t start = 0;
+        for (size_t i = 0; i < s.size(); i++) {
+            if (s[i] >= '0' && s[i] <= '9')
+                continue;
+            if (!parse_digits(s.substr(start, i - start), &number))
+                return false;
+            if (s[i] == 'h') {
+                total += number * 3600;
+                *span = 3599;
+            } else if (s[i] == 'm') {
+                total += number * 60;
+                *span = 59;
+            } else if (s[i] == 's') {
+                total += number;
+                *span = 0;
+            } else {
+                return false;
+            }
+            start = i + 1;
+        }
+        if (start < s.size()) { // 3m30
+            if (!parse_digits(s.substr(start), &number))
+                return false;
+            total += number;
+            *span = 0;
+        }
+    }
+    if (total > INT_MAX - 3600) // So adding the span can't overflow
+        return false;
+    *value = (int32_t) total;
+    return true;
+}
+
+// ">2000", "<=5m", "1990..1999", "2000..", or just a value
+static bool parse_range(const std::string &s, bool duration, std::pair<int32_t, int32_t> *range) {
+    int32_t value, span;
+    size_t dots = s.find("..");
+    if (dots != std::string::npos) {
+        std::string low = s.substr(0, dots);
+        std::string high = s.substr(dots + 2);
+        if (low.empty() && high.empty())
+            return false;
+        range->first = INT_MIN;
+        range->second = INT_MAX;
+        if (!low.empty()) {
+            if (!parse_number(low, duration, &value, &span))
+                return false;
+            range->first = value;
+        }
+        if (!high.empty()) {
+            if (!parse_number(high, duration, &value, &span))
+                return false;
+            range->second = value + span;
+        }
+        return true;
+    }
+    std::string op = s.substr(0, s.find_first_not_of("<>="));
+    if (!parse_number(s.substr(op.size()), duration, &value, &span))
+        return false;
+    if (op == ">=") {
+        *range = {value, INT_MAX};
+    } else if (op == ">") {
+        *range = {value + span + 1, INT_MAX};
+    } else if (op == "<=") {
+        *range = {INT_MIN, value + span};
+    } else if (op == "<") {
+        *range = {INT_MIN, value - 1};
+    } else if (op.empty() || op == "=") {
+        *range = {value, value + span};
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// With 'index_mutex' held (genre:rock needs to know the genres there are)
+static Plan compile_query(const std::string &text, SearchField default_field) {
+    Plan plan;
+    // Folded whole before it's split, so curly quotes group words and a full-width colon names a field
+    for (auto &token: tokenize(collation_key(text))) {
+        size_t colon = token.find(':');
+        std::string name = colon == std::string::npos ? "" : token.substr(0, colon);
+        std::string value = colon == std::string::npos ? "" : token.substr(colon + 1);
+        if (name == "title") {
+            add_words(value, SEARCH_TITLE, &plan);
+        } else if (name == "artist") {
+            add_words(value, SEARCH_ARTIST, &plan);
+        } else if (name == "album") {
+            add_words(value, SEARCH_ALBUM, &plan);
+        } else if (name == "genre") {
+            if (value.empty())
+                continue;
+            Condition condition{COLUMN_GENRE, {}};
+            for (auto &g: genre_songs) {
+                if (pool_view(g.first).find(value) != std::string_view::npos)
+                    condition.ranges.push_back({(int32_t) g.first, (int32_t) g.first});
+            }
+            if (condition.ranges.empty())
+                plan.nothing = true;
+            plan.conditions.push_back(condition);
+        } else if (name == "year" || name == "len" || name == "length") {
+            Condition condition{name == "year" ? COLUMN_YEAR : COLUMN_LENGTH, {}};
+            std::pair<int32_t, int32_t> range;
+            if (parse_range(value, condition.column == COLUMN_LENGTH, &range)) {
+                condition.ranges.push_back(range);
+                plan.conditions.push_back(condition);
+            }
+        } else {
+            add_words(token, default_field, &plan);
+        }
+    }
+    std::sort(plan.trigrams.begin(), plan.trigrams.end());
+    plan.trigrams.erase(std::unique(plan.trigrams.begin(), plan.trigrams.end()), plan.trigrams.end());
+    return plan;
+}
+
+static bool passes_conditions(TrackId id, const std::vector<Condition> &conditions) {
+    for (auto &condition: conditions) {
+        int32_t value = columns[condition.column][id];
+        bool any = false;
+        for (auto &range: condition.ranges)
+            any |= value >= range.first && value <= range.second;
+        if (!any)
+            return false;
+    }
+    return true;
+}
+
+// The live songs that pass every condition, out of all of them. Four at a time with SSE2 (which every x86-64 has).
+static void conditions_all(const std::vector<Condition> &conditions, std::vector<TrackId> *out) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    size_t count = songs.size();
+    size_t id = 0;
+#ifdef __SSE2__
+    const __m128i all = _mm_set1_epi32(-1);
+    for (; id + 4 <= count; id += 4) {
+        __m128i pass = all;
+        for (auto &condition: conditions) {
+            __m128i values = _mm_loadu_si128((const __m128i *) (columns[condition.column].data() + id));
+            __m128i any = _mm_setzero_si128();
+            for (auto &range: condition.ranges) {
+                __m128i outside = _mm_or_si128(_mm_cmplt_epi32(values, _mm_set1_epi32(range.first)),
+                                               _mm_cmpgt_epi32(values, _mm_set1_epi32(range.second)));
+                any = _mm_or_si128(any, _mm_andnot_si128(outside, all));
+            }
+            pass = _mm_and_si128(pass, any);
+        }
+        int bits = _mm_movemask_ps(_mm_castsi128_ps(pass));
+        for (int i = 0; i < 4; i++)
+            if ((bits & (1 << i)) && songs[id + i].live)
+                out->push_back(id + i);
+    }
+#endif
+    for (; id < count; id++)
+        if (songs[id].live && passes_conditions(id, conditions))
+            out->push_back(id);
+}
+
+// A song can only match if, for every word, one of the fields it can match has all of the word's characters
+static bool passes_prefilter(TrackId id, const std::vector<Word> &words) {
+    for (auto &w: words) {
+        bool any = false;
+        for (int f = 0; f < FIELD_COUNT; f++)
+            if (w.field == SEARCH_ANY_FIELD || w.field == f)
+                any |= (field_masks[f][id] & w.mask) == w.mask;
+        if (!any)
+            return false;
+    }
+    return true;
+}
+
+// The songs that passes_prefilter lets through, out of all of them. Two at a time with SSE2.
+static void prefilter_all(const std::vector<Word> &words, std::vector<TrackId> *out) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    size_t count = songs.size();
+    size_t id = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; id + 2 <= count; id += 2) {
+        __m128i pass = _mm_set1_epi32(-1);
+        for (auto &word: words) {
+            __m128i w = _mm_set1_epi64x((long long) word.mask);
+            __m128i any = zero;
+            for (int f = 0; f < FIELD_COUNT; f++) {
+                if (word.field != SEARCH_ANY_FIELD && word.field != f)
+                    continue;
+                // All of the word's characters are there when none of its bits are missing from the field
+                __m128i missing = _mm_andnot_si128(_mm_loadu_si128((const __m128i *) (field_masks[f].data() + id)), w);
+                __m128i halves = _mm_cmpeq_epi32(missing, zero);
+                any = _mm_or_si128(any, _mm_and_si128(halves, _mm_shuffle_epi32(halves, _MM_SHUFFLE(2, 3, 0, 1))));
+            }
+            pass = _mm_and_si128(pass, any);
+        }
+        int bits = _mm_movemask_pd(_mm_castsi128_pd(pass));
+        if (bits & 1)
+            out->push_back(id);
+        if (bits & 2)
+            out->push_back(id + 1);
+    }
+#endif
+    for (; id < count; id++)
+        if (passes_prefilter(id, words))
+            out->push_back(id);
+}
+
+// Every word has to fuzzily match at least one of its fields, and its best one counts towards the score
+static bool score_song(const Plan &plan, const SearchSong &song, int *score) {
+    *score = 0;
+    for (auto &w: plan.words) {
+        bool matched = false;
+        int best = 0;
+        for (int f = 0; f < FIELD_COUNT; f++) {
+            StringId field = song.fields[f];
+            if (field == 0 || (w.field != SEARCH_ANY_FIELD && w.field != f))
+                continue;
+            // The simple match is a lot cheaper than the scored one, and most fields don't match at all
+            int field_score;
+            if (!fts::fuzzy_match_simple(w.text.c_str(), pool_cstr(field)))
+                continue;
+            if (fts::fuzzy_match(w.text.c_str(), pool_cstr(field), field_score) && (!matched || field_score > best)) {
+                best = field_score;
+                matched = true;
+            }
+        }
+        if (!matched)
+            return false;
+        *score += best;
+    }
+    return true;
+}
+
+bool search_library_run(const std::string &text, SearchRun *run, std::vector<SearchHit> *hits) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    hits->clear();
+    run->narrowed = false;
+    run->candidates = 0;
+    std::lock_guard<std::mutex> guard(index_mutex);
+    run->version = index_version;
+    Plan plan = compile_query(text, run->default_field);
+    if (plan.nothing)
+        return true;
+
+    // Starting from the rarest trigram, so the candidates only get fewer
+    std::vector<const std::vector<TrackId> *> lists;
+    if (run->use_index) {
+        for (auto t: plan.trigrams) {
+            auto it = postings.find(t);
+            if (it == postings.end())
+                return true;
+            lists.push_back(&it->second);
+        }
+        std::sort(lists.begin(), lists.end(), [](auto a, auto b) { return a->size() < b->size(); });
+    }
+
+    std::vector<TrackId> candidates;
+    size_t first = 0;
+    bool conditions_checked = false;
+    bool prefiltered = false;
+    if (run->within && run->within_version == index_version) {
+        candidates = *run->within;
+        run->narrowed = true;
+    } else if (!plan.conditions.empty()) {
+        conditions_all(plan.conditions, &candidates);
+        conditions_checked = true;
+    } else if (!lists.empty()) {
+        candidates = *lists[0];
+        first = 1;
+    } else if (run->use_prefilter && !plan.words.empty()) {
+        prefilter_all(plan.words, &candidates);
+        prefiltered = true;
+    } else { // Also when there's nothing to check at all (only spaces, or year: that isn't finished yet)
+        for (TrackId id = 0; id < songs.size(); id++)
+            if (songs[id].live)
+                candidates.push_back(id);
+    }
+    for (size_t i = first; i < lists.size() && !candidates.empty(); i++) {
+        auto &list = *lists[i];
+        candidates.erase(std::remove_if(candidates.begin(), candidates.end(), [&list](TrackId id) {
+            return !std::binary_search(list.begin(), list.end(), id);
+        }), candidates.end());
+    }
+    run->candidates = candidates.size();
+
+    for (size_t i = 0; i < candidates.size(); i++) {
+        if (run->generation && i % CANCEL_CHECK_EVERY == 0 &&
+            run->generation->load(std::memory_order_relaxed) != run->mine)
+            return false;
+        int score;
+        TrackId id = candidates[i];
+        if (!songs[id].live)
+            continue;
+        if (!conditions_checked && !passes_conditions(id, plan.conditions))
+            continue;
+        if (run->use_prefilter && !prefiltered && !passes_prefilter(id, plan.words))
+            continue;
+        if (score_song(plan, songs[id], &score))
+            hits->push_back({id, score});
+    }
+    std::stable_sort(hits->begin(), hits->end(), [](const SearchHit &a, const SearchHit &b) {
+        return a.score > b.score;
+    });
+    return true;
+}
+
+std::vector<SearchHit> search_library(const std::string &query) {
+    std::vector<SearchHit> hits;
+    SearchRun run;
+    search_library_run(query, &run, &hits);
+    return hits;
+}
+
+bool query_narrows(const std::string &from, const std::string &to) {
+    return to.size() > from.size() && to.compare(0, from.size(), from) == 0 &&
+           to.find_first_of(":\"") == std::string::npos;
+}
+
+bool song_matches_query(const std::string &text, TrackId id) {
+    std::lock_guard<std::mutex> guard(index_mutex);
+    Plan plan = compile_query(text, SEARCH_ANY_FIELD);
+    if (plan.nothing)
+        return false;
+    if (id >= songs.size() || !songs[id].live || !passes_conditions(id, plan.conditions))
+        return false;
+    if (!plan.trigrams.empty()) {
+        std::vector<Trigram> has;
+        trigrams_of(songs[id], &has);
+        if (!std::includes(has.begin(), has.end(), plan.trigrams.begin(), plan.trigrams.end()))
+            return false;
+    }
+    int score;
+    return score_song(plan, songs[id], &score);
+}
+
+static std::vector<Trigram> scratch; // only the main thread changes the index
+
+void search_index_add(TrackId id) {
+    auto &track = catalog_track(id);
+    SearchSong song;
+    song.fields[SEARCH_TITLE] = track.title_key;
+    song.fields[SEARCH_ARTIST] = track.artist_key;
+    song.fields[SEARCH_ALBUM] = track.album_key;
+    song.fields[SEARCH_GENRE] = track.genre_key;
+    song.live = true;
+    trigrams_of(song, &scratch);
+
+    std::lock_guard<std::mutex> guard(index_mutex);
+    if (songs.size() <= id) {
+        songs.resize(id + 1);
+        for (auto &masks: field_masks)
+            masks.resize(id + 1, 0);
+        for (auto &column: columns)
+            column.resize(id + 1, 0);
+    }
+    songs[id] = song;
+    for (int f = 0; f < FIELD_COUNT; f++)
+        field_masks[f][id] = char_mask(pool_view(song.fields[f]));
+    columns[COLUMN_YEAR][id] = track.year;
+    columns[COLUMN_LENGTH][id] = (int32_t) track.length;
+    columns[COLUMN_GENRE][id] = (int32_t) track.genre_key;
+    if (track.genre_key != 0)
+        genre_songs[track.genre_key]++;
+    index_version++;
+    for (auto t: scratch) {
+        auto &list = postings[t];
+        if (list.empty() || list.back() < id) { // New songs have the biggest ids, so this is almost always it
+            list.push_back(id);
+        } else {
+            auto position = std::lower_bound(list.begin(), list.end(), id);
+            if (*position != id)
+                list.insert(position, id);
+        }
+    }
+}
+
+void search_index_remove(TrackId id) {
+    std::lock_guard<std::mutex> guard(index_mutex);
+    if (id >= songs.size() || !songs[id].live)
+        return;
+    trigrams_of(songs[id], &scratch);
+    StringId genre = songs[id].fields[SEARCH_GENRE];
+    if (genre != 0 && --genre_songs[genre] == 0)
+        genre_songs.erase(genre);
+    songs[id].live = false;
+    for (auto &masks: field_masks)
+        masks[id] = 0;
+    index_version++;
+    for (auto t: scratch) {
+        auto it = postings.find(t);
+        if (it == postings.end())
+            continue;
+        auto &list = it->second;
+        auto position = std::lower_bound(list.begin(), list.end(), id);
+        if (position != list.end() && *position == id)
+            list.erase(position);
+        if (list.empty())
+            postings.erase(it);
+    }
+}
+
+void search_index_clear() {
+    std::lock_guard<std::mutex> guard(index_mutex);
+    songs.clear();
+    for (auto &masks: field_masks)
+        masks.clear();
+    for (auto &column: columns)
+        column.clear();
+    genre_songs.clear();
+    postings.clear();
+    index_version++;
+}
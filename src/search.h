@@ -0,0 +1,86 @@
+/* date = October 19th 2026 8:30 pm */
+
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include "catalog.h"
+#include <atomic>
+#include <string>
+#include <vector>
+
+// Searching the catalog through a trigram index over every song's title, artist, album and genre, all compared by
+// their collation keys (so case, accents and full-width forms don't matter). Each word of the query with three or
+// more letters has to appear as written in one of those (which the index finds without looking at any other song),
+// and then every word has to fuzzily match one of them (which is also how they're scored). Words shorter than that
+// only match fuzzily, against every song. Before any matching, a mask of the characters in each field rules out songs
+// where no field has all of a word's characters. The index keeps its own copy of what it searches, so searches can
+// run on any thread (search_worker.h runs them off the main one), but only the catalog changes it.
+//
+// A word can also be narrowed down to a field, or be a condition on the year, the length or the genre:
+//
+//   artist:radiohead year:>2000 genre:rock len:<5m kid a
+//
+//   title: artist: album:   the word (or "quoted words") only has to match that field
+//   genre:rock              genres with "rock" in their name
+//   year:1997 year:>=2000 year:1990..1999
+//   len:<5m len:>3:30 len:90s len:4   (a bare number is minutes; len:4 is anything from 4:00 to 4:59)
+//
+// A condition that isn't finished yet (year:> while it's being typed) is left out rather than matching nothing, and
+// a query with nothing left to check matches every song. Something before a colon that isn't one of those (like
+// "re:") is just part of a word. The conditions are checked first, in one pass over arrays of every song's year,
+// length and genre, before any text.
+
+enum SearchField {
+    SEARCH_TITLE,
+    SEARCH_ARTIST,
+    SEARCH_ALBUM,
+    SEARCH_GENRE,
+    SEARCH_ANY_FIELD,
+};
+
+struct SearchHit {
+    TrackId id;
+    int score; // higher is better
+};
+
+// The songs matching 'query', best first
+std::vector<SearchHit> search_library(const std::string &query);
+
+struct SearchRun {
+    // What words without a field have to match (the album tab only searches album names)
+    SearchField default_field = SEARCH_ANY_FIELD;
+    // Only the songs in 'within' (sorted ids) are looked at, if the index hasn't changed since 'within_version'.
+    // That's for a query which narrows one that found them (see query_narrows).
+    const std::vector<TrackId> *within = nullptr;
+    uint64_t within_version = 0;
+    // The search gives up as soon as 'generation' stops being 'mine'
+    const std::atomic<uint64_t> *generation = nullptr;
+    uint64_t mine = 0;
+    // The benchmark turns these off to see what they're worth
+    bool use_index = true;
+    bool use_prefilter = true; // rejects songs missing one of a word's characters before any matching runs
+
+    // Filled in
+    uint64_t version = 0; // of the index the search ran against
+    bool narrowed = false; // only looked at 'within'
+    size_t candidates = 0; // songs the index couldn't rule out
+};
+
+// search_library with more say over how it runs. False if it was cancelled (and 'hits' is incomplete).
+bool search_library_run(const std::string &query, SearchRun *run, std::vector<SearchHit> *hits);
+
+// Whether 'to' can only ever find some of what 'from' found. Typing more onto plain words does that, but a colon
+// or a quote can turn what came before into something else.
+bool query_narrows(const std::string &from, const std::string &to);
+
+// Whether one song would be in search_library's results
+bool song_matches_query(const std::string &query, TrackId id);
+
+// Kept up to date by the catalog: a song is added once its tags are in, and removed before they change
+void search_index_add(TrackId id);
+
+void search_index_remove(TrackId id);
+
+void search_index_clear();
+
+#endif //SEARCH_H
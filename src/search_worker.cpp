@@ -0,0 +1,172 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "search_worker.h"
+#include "utility.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+struct SearchWorker {
+    AppClient *client = nullptr;
+    SearchCallback on_done = nullptr;
+    int results_fd = -1;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::atomic<uint64_t> generation{0}; // of the newest query; anything older still running gives up
+
+    // Waiting for the search thread
+    bool pending = false;
+    std::string query;
+    SearchField field = SEARCH_ANY_FIELD;
+    long submitted_ms = 0;
+
+    // Finished, waiting for the main thread
+    bool done = false;
+    uint64_t done_generation = 0;
+    std::string done_query;
+    std::vector<SearchHit> hits;
+    SearchStats stats;
+
+    // Only touched by the search thread: the last query that ran to the end, and the songs it found (by id)
+    std::string last_query;
+    SearchField last_field = SEARCH_ANY_FIELD;
+    std::vector<TrackId> last_ids;
+    uint64_t last_version = 0;
+    bool has_last = false;
+};
+
+static SearchWorker *worker = nullptr;
+
+static void search_thread() {
+    while (true) {
+        std::string query;
+        SearchField field;
+        uint64_t mine;
+        SearchStats stats;
+        {
+            std::unique_lock<std::mutex> lock(worker->mutex);
+            worker->cv.wait(lock, [] { return worker->pending; });
+            worker->pending = false;
+            query = worker->query;
+            field = worker->field;
+            stats.submitted_ms = worker->submitted_ms;
+            mine = worker->generation.load();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        SearchRun run;
+        run.generation = &worker->generation;
+        run.mine = mine;
+        run.default_field = field;
+        // The album and artist tabs match plain words against a different field, so only their own results narrow
+        if (worker->has_last && worker->last_field == field && query_narrows(worker->last_query, query)) {
+            run.within = &worker->last_ids;
+            run.within_version = worker->last_version;
+        }
+        std::vector<SearchHit> hits;
+        if (!search_library_run(query, &run, &hits))
+            continue;
+        stats.search_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        stats.narrowed = run.narrowed;
+        stats.candidates = run.candidates;
+
+        worker->has_last = true;
+        worker->last_query = query;
+        worker->last_field = field;
+        worker->last_version = run.version;
+        worker->last_ids.clear();
+        for (auto &hit: hits)
+            worker->last_ids.push_back(hit.id);
+        std::sort(worker->last_ids.begin(), worker->last_ids.end());
+
+        {
+            std::lock_guard<std::mutex> guard(worker->mutex);
+            if (worker->generation.load() != mine)
+                continue;
+            worker->done = true;
+            worker->done_generation = mine;
+            worker->done_query = query;
+            worker->hits.swap(hits);
+            worker->stats = stats;
+        }
+        uint64_t one = 1;
+        write(worker->results_fd, &one, sizeof(one));
+    }
+}
+
+static void results_wakeup(App *app, int fd, void *) {
+    uint64_t count;
+    read(fd, &count, sizeof(count));
+
+    std::string query;
+    std::vector<SearchHit> hits;
+    SearchStats stats;
+    SearchCallback on_done;
+    AppClient *client;
+    {
+        std::lock_guard<std::mutex> guard(worker->mutex);
+        // Something typed (or cleared) after this one finished makes it stale
+        if (!worker->done || worker->done_generation != worker->generation.load())
+            return;
+        worker->done = false;
+        query.swap(worker->done_query);
+        hits.swap(worker->hits);
+        stats = worker->stats;
+        on_done = worker->on_done;
+        client = worker->client;
+    }
+    on_done(client, query, hits, stats);
+}
+
+void search_library_async(App *app, AppClient *client, const std::string &query, SearchCallback on_done,
+                          SearchField default_field) {
+    if (!worker) {
+        int results_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (results_fd == -1) {
+            // Still works, just on this thread
+            SearchStats stats;
+            stats.submitted_ms = get_current_time_in_ms();
+            SearchRun run;
+            run.default_field = default_field;
+            std::vector<SearchHit> hits;
+            search_library_run(query, &run, &hits);
+            stats.candidates = run.candidates;
+            on_done(client, query, hits, stats);
+            return;
+        }
+        worker = new SearchWorker;
+        worker->results_fd = results_fd;
+        poll_descriptor(app, results_fd, EPOLLIN, results_wakeup, nullptr, "search_results");
+        std::thread t(search_thread);
+        t.detach();
+    }
+    {
+        std::lock_guard<std::mutex> guard(worker->mutex);
+        worker->client = client;
+        worker->on_done = on_done;
+        worker->query = query;
+        worker->field = default_field;
+        worker->submitted_ms = get_current_time_in_ms();
+        worker->pending = true;
+        worker->generation++;
+    }
+    worker->cv.notify_one();
+}
+
+void search_cancel() {
+    if (!worker)
+        return;
+    std::lock_guard<std::mutex> guard(worker->mutex);
+    worker->pending = false;
+    worker->generation++;
+}
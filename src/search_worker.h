@@ -0,0 +1,29 @@
+/* date = October 19th 2026 9:10 pm */
+
+#ifndef SEARCH_WORKER_H
+#define SEARCH_WORKER_H
+
+#include "application.h"
+#include "search.h"
+#include <string>
+#include <vector>
+
+struct SearchStats {
+    long submitted_ms = 0; // when the query was handed over (get_current_time_in_ms)
+    double search_ms = 0; // on the search thread
+    bool narrowed = false; // only re-filtered the last query's results
+    size_t candidates = 0;
+};
+
+typedef void (*SearchCallback)(AppClient *client, const std::string &query, const std::vector<SearchHit> &hits,
+                               const SearchStats &stats);
+
+// Runs 'query' on the search thread, and hands its hits to 'on_done' on the main loop. A newer query (or
+// search_cancel) makes whatever is still running give up, so 'on_done' only ever sees the latest one. Plain words
+// match 'default_field' (see SearchRun).
+void search_library_async(App *app, AppClient *client, const std::string &query, SearchCallback on_done,
+                          SearchField default_field = SEARCH_ANY_FIELD);
+
+void search_cancel();
+
+#endif //SEARCH_WORKER_H
@@ -0,0 +1,71 @@
+
+#include "sniff.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+static bool is_mpeg_audio_frame(const unsigned char *b) {
+    // 11 bit frame sync, and a layer of 00 is ADTS (aac) not mp3
+    return b[0] == 0xFF && (b[1] & 0xE0) == 0xE0 && (b[1] & 0x06) != 0;
+}
+
+AudioFormat sniff_audio_format(int fd) {
+    unsigned char head[4096];
+    ssize_t len = pread(fd, head, sizeof(head), 0);
+    if (len < 12)
+        return FORMAT_UNKNOWN;
+    
+    if (memcmp(head, "ID3", 3) == 0) {
+        // Skip the ID3v2 tag (size is syncsafe, and excludes the 10 byte header and optional footer)
+        off_t size = ((head[6] & 0x7F) << 21) | ((head[7] & 0x7F) << 14) | ((head[8] & 0x7F) << 7) | (head[9] & 0x7F);
+        off_t offset = 10 + size + ((head[5] & 0x10) ? 10 : 0);
+        unsigned char after[4];
+        if (pread(fd, after, sizeof(after), offset) == sizeof(after)) {
+            if (memcmp(after, "fLaC", 4) == 0)
+                return FORMAT_FLAC;
+            if (after[0] == 0xFF && (after[1] & 0xF6) == 0xF0)
+                return FORMAT_OTHER; // ADTS aac with an ID3 tag in front
+        }
+        return FORMAT_MP3;
+    }
+    if (memcmp(head, "fLaC", 4) == 0)
+        return FORMAT_FLAC;
+    if (memcmp(head, "RIFF", 4) == 0 && memcmp(head + 8, "WAVE", 4) == 0)
+        return FORMAT_WAV;
+    if (memcmp(head, "OggS", 4) == 0)
+        return FORMAT_OGG;
+    if (memcmp(head + 4, "ftyp", 4) == 0)
+        return FORMAT_MP4;
+    if (memcmp(head, "FORM", 4) == 0 && (memcmp(head + 8, "AIFF", 4) == 0 || memcmp(head + 8, "AIFC", 4) == 0))
+        return FORMAT_AIFF;
+    
+    static const unsigned char asf_guid[] = {0x30, 0x26, 0xB2, 0x75, 0x8E, 0x66, 0xCF, 0x11};
+    if (memcmp(head, asf_guid, sizeof(asf_guid)) == 0 ||
+        memcmp(head, "MAC ", 4) == 0 ||
+        memcmp(head, "wvpk", 4) == 0 ||
+        memcmp(head, "MPCK", 4) == 0 ||
+        memcmp(head, "MP+", 3) == 0 ||
+        memcmp(head, "DSD ", 4) == 0 ||
+        (head[0] == 0xFF && (head[1] & 0xF6) == 0xF0)) {
+        return FORMAT_OTHER;
+    }
+    
+    if (is_mpeg_audio_frame(head))
+        return FORMAT_MP3;
+    
+    return FORMAT_UNKNOWN;
+}
+
+AudioFormat sniff_audio_format(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd == -1)
+        return FORMAT_UNKNOWN;
+    AudioFormat format = sniff_audio_format(fd);
+    close(fd);
+    return format;
+}
+
+bool natively_decodable(AudioFormat format) {
+    return format == FORMAT_MP3 || format == FORMAT_FLAC || format == FORMAT_WAV;
+}
@@ -0,0 +1,27 @@
+/* date = October 19th 2026 9:41 am */
+
+#ifndef SNIFF_H
+#define SNIFF_H
+
+#include <string>
+
+enum AudioFormat {
+    FORMAT_UNKNOWN,
+    FORMAT_MP3,
+    FORMAT_FLAC,
+    FORMAT_WAV,
+    FORMAT_OGG,
+    FORMAT_MP4,
+    FORMAT_AIFF,
+    FORMAT_OTHER, // recognized (ape, wavpack, asf, ...) but nothing we decode ourselves
+};
+
+// Tells the container format from the first few KB of an open file, without parsing any tags
+AudioFormat sniff_audio_format(int fd);
+
+AudioFormat sniff_audio_format(const std::string &path);
+
+// Formats miniaudio decodes directly, everything else gets converted with ffmpeg first
+bool natively_decodable(AudioFormat format);
+
+#endif //SNIFF_H
@@ -0,0 +1,196 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "song_sort.h"
+#include "library.h"
+#include <algorithm>
+#include <climits>
+#include <thread>
+
+// Below this many songs a sort isn't worth starting threads for
+#define PARALLEL_SORT_MIN 50000
+
+// Negative if 'a' goes first, positive if 'b' does, zero if the key can't tell them apart
+static int compare_by(const Track &a, const Track &b, const SortKey &key) {
+    int order = 0;
+    switch (key.column) {
+        case SORT_TIME:
+        case SORT_YEAR: {
+            uint32_t x = key.column == SORT_TIME ? a.length : a.year;
+            uint32_t y = key.column == SORT_TIME ? b.length : b.year;
+            if (x == y)
+                return 0;
+            if (x == 0 || y == 0)
+                return x == 0 ? 1 : -1;
+            order = x < y ? -1 : 1;
+            break;
+        }
+        default: {
+            StringId x, y;
+            if (key.column == SORT_TITLE) {
+                x = a.title_key;
+                y = b.title_key;
+            } else if (key.column == SORT_ARTIST) {
+                x = a.artist_key;
+                y = b.artist_key;
+            } else if (key.column == SORT_ALBUM) {
+                x = a.album_key;
+                y = b.album_key;
+            } else {
+                x = a.genre_key;
+                y = b.genre_key;
+            }
+            if (x == y)
+                return 0;
+            auto vx = pool_view(x);
+            auto vy = pool_view(y);
+            if (vx.empty() || vy.empty())
+                return vx.empty() ? 1 : -1;
+            order = vx.compare(vy);
+            if (order == 0)
+                return 0;
+            break;
+        }
+    }
+    return key.descending ? -order : order;
+}
+
+static bool track_sorts_before(TrackId a, TrackId b, const Track &ta, const Track &tb,
+                               const std::vector<SortKey> &keys) {
+    for (auto &key: keys) {
+        int order = compare_by(ta, tb, key);
+        if (order != 0)
+            return order < 0;
+    }
+    if (comes_before(ta, tb))
+        return true;
+    if (comes_before(tb, ta))
+        return false;
+    return a < b;
+}
+
+bool sorts_before(TrackId a, TrackId b, const std::vector<SortKey> &keys) {
+    return track_sorts_before(a, b, catalog_track(a), catalog_track(b), keys);
+}
+
+// Where each song's value of 'field' falls among the distinct values of the songs (0 for the first), and 'last' for
+// the ones that don't have it
+static void rank_text(const std::vector<const Track *> &tracks, StringId Track::*field, uint32_t last,
+                      std::vector<uint32_t> *ranks) {
+    std::vector<StringId> distinct;
+    distinct.reserve(tracks.size());
+    for (auto t: tracks)
+        distinct.push_back(t->*field);
+    std::sort(distinct.begin(), distinct.end());
+    distinct.erase(std::unique(distinct.begin(), distinct.end()), distinct.end());
+    std::vector<uint32_t> by_text(distinct.size());
+    for (uint32_t i = 0; i < by_text.size(); i++)
+        by_text[i] = i;
+    std::sort(by_text.begin(), by_text.end(), [&](uint32_t a, uint32_t b) {
+        return pool_view(distinct[a]) < pool_view(distinct[b]);
+    });
+    std::vector<uint32_t> rank_of(distinct.size());
+    for (uint32_t r = 0; r < by_text.size(); r++)
+        rank_of[by_text[r]] = r;
+    ranks->resize(tracks.size());
+    for (size_t i = 0; i < tracks.size(); i++) {
+        StringId value = tracks[i]->*field;
+        if (value == 0) {
+            (*ranks)[i] = last;
+        } else {
+            auto at = std::lower_bound(distinct.begin(), distinct.end(), value) - distinct.begin();
+            (*ranks)[i] = rank_of[at];
+        }
+    }
+}
+
+std::vector<uint32_t> sort_permutation(const std::vector<TrackId> &ids, const std::vector<SortKey> &keys) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    std::vector<const Track *> tracks;
+    tracks.reserve(ids.size());
+    for (auto id: ids)
+        tracks.push_back(&catalog_track(id));
+
+    // Every song gets a row of numbers that compare the same way sorts_before does (the text turned into its rank
+    // among the songs), so sorting only ever compares numbers and never touches the catalog or the string pool
+    const uint32_t last = UINT32_MAX;
+    size_t width = keys.size() + 5;
+    std::vector<uint32_t> rows(ids.size() * width);
+    std::vector<uint32_t> ranks;
+    for (size_t k = 0; k < keys.size(); k++) {
+        auto &key = keys[k];
+        if (key.column == SORT_TIME || key.column == SORT_YEAR) {
+            ranks.resize(ids.size());
+            for (size_t i = 0; i < ids.size(); i++) {
+                uint32_t value = key.column == SORT_TIME ? tracks[i]->length : tracks[i]->year;
+                ranks[i] = value == 0 ? last : value;
+            }
+        } else {
+            auto field = key.column == SORT_TITLE ? &Track::title_key :
+                         key.column == SORT_ARTIST ? &Track::artist_key :
+                         key.column == SORT_ALBUM ? &Track::album_key : &Track::genre_key;
+            rank_text(tracks, field, last, &ranks);
+        }
+        for (size_t i = 0; i < ids.size(); i++) {
+            uint32_t rank = ranks[i];
+            if (key.descending && rank != last)
+                rank = last - 1 - rank;
+            rows[i * width + k] = rank;
+        }
+    }
+    // Then songs tab order (comes_before): album key, album name, disc, track, with the songs without an album last
+    rank_text(tracks, &Track::album_key, last, &ranks);
+    for (size_t i = 0; i < ids.size(); i++)
+        rows[i * width + keys.size()] = ranks[i];
+    rank_text(tracks, &Track::album, last, &ranks);
+    for (size_t i = 0; i < ids.size(); i++) {
+        auto row = &rows[i * width + keys.size() + 1];
+        row[0] = ranks[i];
+        row[1] = ranks[i] == last ? 0 : tracks[i]->disc;
+        row[2] = ranks[i] == last ? 0 : tracks[i]->track;
+        row[3] = ids[i];
+    }
+    auto before = [&rows, width](uint32_t a, uint32_t b) {
+        const uint32_t *x = &rows[a * width];
+        const uint32_t *y = &rows[b * width];
+        for (size_t k = 0; k < width; k++)
+            if (x[k] != y[k])
+                return x[k] < y[k];
+        return false;
+    };
+
+    std::vector<uint32_t> order(ids.size());
+    for (uint32_t i = 0; i < order.size(); i++)
+        order[i] = i;
+
+    size_t pieces = std::min<size_t>(std::max(1u, std::thread::hardware_concurrency()), 8);
+    if (order.size() < PARALLEL_SORT_MIN || pieces == 1) {
+        std::sort(order.begin(), order.end(), before);
+        return order;
+    }
+    std::vector<size_t> bounds;
+    for (size_t p = 0; p <= pieces; p++)
+        bounds.push_back(order.size() * p / pieces);
+    std::vector<std::thread> sorters;
+    for (size_t p = 0; p < pieces; p++)
+        sorters.emplace_back([&, p] {
+            std::sort(order.begin() + bounds[p], order.begin() + bounds[p + 1], before);
+        });
+    for (auto &t: sorters)
+        t.join();
+    // Neighbouring pieces are merged until there's one left
+    for (size_t span = 1; span < pieces; span *= 2) {
+        for (size_t p = 0; p + span < pieces; p += 2 * span) {
+            size_t end = std::min(p + 2 * span, pieces);
+            std::inplace_merge(order.begin() + bounds[p], order.begin() + bounds[p + span],
+                               order.begin() + bounds[end], before);
+        }
+    }
+    return order;
+}
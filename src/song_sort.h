@@ -0,0 +1,32 @@
+/* date = October 19th 2026 11:05 pm */
+
+#ifndef SONG_SORT_H
+#define SONG_SORT_H
+
+#include "catalog.h"
+#include <vector>
+
+enum SortColumn {
+    SORT_TITLE,
+    SORT_TIME,
+    SORT_ARTIST,
+    SORT_ALBUM,
+    SORT_GENRE,
+    SORT_YEAR,
+};
+
+struct SortKey {
+    SortColumn column = SORT_TITLE;
+    bool descending = false;
+};
+
+// Whether 'a' goes before 'b': by the first key, ties by the next one and so on, then in songs tab order
+// (comes_before), then by id, so where the songs started never matters. Text goes by its collation key, and songs
+// without the tag (or the year) go last either way.
+bool sorts_before(TrackId a, TrackId b, const std::vector<SortKey> &keys);
+
+// The order 'ids' go in sorted by 'keys', as positions into 'ids', so rows can be put in that order instead of being
+// made again. Long lists are sorted in pieces on several threads, and the pieces merged.
+std::vector<uint32_t> sort_permutation(const std::vector<TrackId> &ids, const std::vector<SortKey> &keys);
+
+#endif //SONG_SORT_H
@@ -11,22 +11,17 @@
 #include "config.h"
 #include "drawer.h"
 #include "components.h"
-#define FTS_FUZZY_MATCH_IMPLEMENTATION
-#include "fts_fuzzy_match.h"
 #include "ThreadPool.h"
 #include <filesystem>
 #include <fstream>
-#include <iostream>
 #include "player.h"
+#include "library.h"
+#include "facets.h"
+#include "search.h"
+#include "search_worker.h"
+#include "rt_log.h"
 #include <sys/stat.h>
-#include <taglib/fileref.h>
-#include <taglib/tag.h>
-#include <taglib/mpegfile.h>
-#include <taglib/id3v2tag.h>
-#include <taglib/flacfile.h>
-#include <taglib/xiphcomment.h>
-#include <taglib/mp4file.h>
-#include <taglib/mp4tag.h>
+#include <unordered_set>
 
 #include "stb_image.h"
 #include "stb_image_resize2.h"
@@ -34,27 +29,49 @@
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 
-static void paint_list_option_text(AppClient *client, cairo_t *cr, Container *c, bool only_drag = false) {
-    auto data = (ListOption *) c->user_data;
+// The songs the table has: all of them in the order the header sorts by, and of those the ones the search and the
+// facet sidebar let through, which are the rows of the list
+struct SongRows : UserData {
+    std::vector<TrackId> sorted;
+    std::vector<TrackId> shown;
+    TrackId selected = NO_TRACK;
+    
+    TrackId last_clicked = NO_TRACK;
+    long last_time_clicked = 0;
+};
+
+static VirtualList *songs_list(AppClient *client) {
+    return (VirtualList *) container_by_name("songs_list", client->root);
+}
+
+// Where the selected song is in the list, or past the end if it isn't showing
+static size_t selected_position(SongRows *rows) {
+    if (rows->selected == NO_TRACK)
+        return rows->shown.size();
+    return std::find(rows->shown.begin(), rows->shown.end(), rows->selected) - rows->shown.begin();
+}
+
+static void paint_list_option_text(AppClient *client, cairo_t *cr, Container *c, TrackId id, bool only_drag = false) {
+    auto &track = catalog_track(id);
     auto header = container_by_name("table_headers", client->root);
     auto table_data = (TableData *) header->user_data;
     
     std::string text;
     for (auto &col: table_data->cols) {
         if (col.name == "Name")
-            text = data->title;
+            text = pool_string(track.title);
          if (col.name == "Time")
-            text = data->length;
+            text = seconds_to_mmss(track.length);
         if (col.name == "Artist")
-            text = data->artist;
+            text = pool_string(track.artist);
         if (col.name == "Album")
-            text = data->album;
+            text = pool_string(track.album);
         if (col.name == "Genre")
-            text = data->genre;
+            text = pool_string(track.genre);
         if (col.name == "Year") {
-            text = data->year;
-            if (text == "0") 
+            if (track.year == 0) 
                 continue;
+            text = std::to_string(track.year);
         }
         auto b = c->real_bounds;
         b.x = col.offset + 50 * config->dpi;
@@ -77,110 +94,89 @@ static void paint_list_option_text(AppClient *client, cairo_t *cr, Container *c,
     }
 }
 
-static void write_to(std::ofstream &file, std::string header, std::string body) {
-    file << header;
-    file << body;
-    file << std::endl;
-}
-
-static void load_from_cache(std::string cache_path, std::vector<Option> &options) {
-#ifdef TRACY_ENABLE
-    ZoneScopedN("From cache");
-#endif
-    // TODO: if version #1 not found, create from cache first, and then load it here
-    // TODO: if version #1 not found, create from cache first, and then load it here
-    // TODO: if version #1 not found, create from cache first, and then load it here
-    // TODO: if version #1 not found, create from cache first, and then load it here
+void put_selected_on_screen(AppClient *client) {
+    auto songs_content = container_by_name("songs_content", client->root);
+    auto list = songs_list(client);
+    if (!songs_content || !list)
+        return;
+    auto rows = (SongRows *) list->user_data;
+    auto position = selected_position(rows);
+    if (position == rows->shown.size())
+        return;
+    
+    // Where the row is, whether or not a container is showing it
+    auto row = Bounds(list->real_bounds.x, list->real_bounds.y + position * list->row_height, list->real_bounds.w,
+                      list->row_height);
+    
+    // Check if it's off screen
+    auto smaller = songs_content->parent->real_bounds;
+    smaller.shrink(row.h * 5 * config->dpi);
+    
+    auto barely_offscreen = !overlaps(row, smaller) && overlaps(row, songs_content->parent->real_bounds);
     
-    std::ifstream file(cache_path); // Replace with your actual file name
-    std::string line;
-    std::string path;
-    std::string title;
-    std::string artist;
-    std::string album;
-    std::string genre;
-    std::string year;
-    std::string length;
-    std::string track;
-    std::string disc;
-    bool last = false;
-    while (std::getline(file, line)) {
-        if (line.find("Path:") != std::string::npos) {
-            line.erase(0, 6);
-            path = line;
-        } else if (line.find("Title:") != std::string::npos) {
-            line.erase(0, 7);
-            title = line;
-        } else if (line.find("Artist:") != std::string::npos) {
-            line.erase(0, 8);
-            artist = line;
-        } else if (line.find("Album:") != std::string::npos) {
-            line.erase(0, 7);
-            album = line;
-        } else if (line.find("Genre:") != std::string::npos) {
-            line.erase(0, 7);
-            genre = line;
-        } else if (line.find("Year:") != std::string::npos) {
-            line.erase(0, 6);
-            year = line;
-        } else if (line.find("Length:") != std::string::npos) {
-            line.erase(0, 8);
-            length = line;
-        } else if (line.find("Track:") != std::string::npos) {
-            line.erase(0, 7);
-            track = line;
-        }else if (line.find("Disc:") != std::string::npos) {
-            line.erase(0, 6);
-            disc = line;
-            last = true;
+    if (barely_offscreen) {
+        if (songs_content->parent->when_fine_scrolled) {
+            if (row.y < smaller.y + smaller.y / 2) {
+                songs_content->parent->when_fine_scrolled(client, client->cr, songs_content->parent,
+                                                          0, row.h, false);
+            } else {
+                songs_content->parent->when_fine_scrolled(client, client->cr, songs_content->parent,
+                                                          0, -row.h, false);
+            }
         }
+    } else if (!overlaps(row, smaller)) {
+        // TODO: stop the fine_scroll
         
-        if (last) {
-            last = false;
-            options.push_back({path, title, artist, album, toLower(album), genre, year, length, track, disc});
-            path = title = artist = album = genre = year = length = track = "";            
-        }
+        int offset = -(songs_content->wanted_pad.y + position * list->row_height);
+        offset += smaller.h / 2;
+        songs_content->parent->scroll_v_real = offset;
+        songs_content->parent->scroll_v_visual = offset;
+        client_layout(app, client);
     }
-    file.close();    
 }
 
-void put_selected_on_screen(AppClient *client) {
-    if (auto songs_content = container_by_name("songs_content", client->root)) {
-        for (int i = 0; i < songs_content->children.size(); i++) {
-            auto child = songs_content->children[i];
-            if (child->exists) {
-                auto data = (ListOption *) child->user_data;
-                if (data->selected) {
-                    // Check if it's off screen
-                    auto smaller = songs_content->parent->real_bounds;
-                    smaller.shrink(child->real_bounds.h * 5 * config->dpi);
-                    
-                    auto barely_offscreen = !overlaps(child->real_bounds, smaller) && overlaps(child->real_bounds, songs_content->parent->real_bounds);
-                    
-                    if (barely_offscreen) {
-                        if (songs_content->parent->when_fine_scrolled) {
-                            if (child->real_bounds.y < smaller.y + smaller.y / 2) {
-                                songs_content->parent->when_fine_scrolled(client, client->cr, songs_content->parent,
-                                                                  0, child->real_bounds.h, false);
-                            } else {
-                                songs_content->parent->when_fine_scrolled(client, client->cr, songs_content->parent,
-                                                                              0, -child->real_bounds.h, false);
-                            }
-                        }
-                    } else if (!overlaps(child->real_bounds, smaller)) {
-                        // TODO: stop the fine_scroll
-                        
-                        int offset = -get_offset(child, (ScrollContainer *) songs_content->parent);
-                        offset += smaller.h / 2;
-                        songs_content->parent->scroll_v_real = offset;
-                        songs_content->parent->scroll_v_visual = offset;
-                        client_layout(app, client);
-                        return;
-                    }
-                }
-            }
+TrackId selected_song(AppClient *client) {
+    auto list = songs_list(client);
+    if (!list)
+        return NO_TRACK;
+    auto rows = (SongRows *) list->user_data;
+    return selected_position(rows) < rows->shown.size() ? rows->selected : NO_TRACK;
+}
+
+// Moves the selection 'step' rows down (or up), going around at the ends
+static void move_selection(AppClient *client, int step) {
+    auto list = songs_list(client);
+    if (!list)
+        return;
+    auto rows = (SongRows *) list->user_data;
+    auto position = selected_position(rows);
+    auto count = rows->shown.size();
+    if (position == count)
+        return;
+    rows->selected = rows->shown[(position + count + step) % count];
+    put_selected_on_screen(client);
+}
+
+void select_next_song(AppClient *client) {
+    move_selection(client, 1);
+}
+
+void select_previous_song(AppClient *client) {
+    move_selection(client, -1);
+}
+
+static bool sort_column_named(const std::string &name, SortColumn *column) {
+    static const std::pair<const char *, SortColumn> columns[] = {
+            {"Name", SORT_TITLE}, {"Time", SORT_TIME}, {"Artist", SORT_ARTIST},
+            {"Album", SORT_ALBUM}, {"Genre", SORT_GENRE}, {"Year", SORT_YEAR},
+    };
+    for (auto &c: columns) {
+        if (name == c.first) {
+            *column = c.second;
+            return true;
         }
     }
+    return false;
 }
 
 static void layout_table_headers(AppClient *client, Container *c) {
@@ -216,6 +212,27 @@ static void paint_table_header(AppClient *client, cairo_t *cr, Container *c) {
         auto x = c->real_bounds.x + 50 * config->dpi + col.offset;
         f->draw_text_end(x, c->real_bounds.y + c->real_bounds.h / 2 - h / 2);
         draw_colored_rect(client, ArgbColor(.812, .812, .812, 1), Bounds(x - 8 * config->dpi, c->real_bounds.y, std::floor(1 * config->dpi), c->real_bounds.h));
+        
+        // A triangle after the name of every column sorted by, pointing up when it's ascending, and fainter the less
+        // it matters
+        SortColumn column;
+        if (!sort_column_named(col.name, &column))
+            continue;
+        for (int k = 0; k < data->sort_keys.size(); k++) {
+            if (data->sort_keys[k].column != column)
+                continue;
+            double size = 4 * config->dpi;
+            double tx = x + w + 6 * config->dpi;
+            double ty = c->real_bounds.y + c->real_bounds.h / 2;
+            double tip = data->sort_keys[k].descending ? size / 2 : -size / 2;
+            cairo_move_to(cr, tx, ty - tip);
+            cairo_line_to(cr, tx + size * 2, ty - tip);
+            cairo_line_to(cr, tx + size, ty + tip);
+            cairo_close_path(cr);
+            double shade = k == 0 ? .44 : .66;
+            cairo_set_source_rgba(cr, shade, shade, shade, 1);
+            cairo_fill(cr);
+        }
     }
     
     // Paint over target, and re-draw it over
@@ -245,6 +262,8 @@ static void paint_table_header(AppClient *client, cairo_t *cr, Container *c) {
     }
 }
 
+static void sort_song_rows(AppClient *client);
+
 static void create_table_headers(AppClient *client, Container *c) {
     auto data = new TableData;
     c->user_data = data;
@@ -386,368 +405,418 @@ static void create_table_headers(AppClient *client, Container *c) {
         client_layout(app, client);
         request_refresh(app, client);
     };
+    // Moving or resizing a column ends in a drag, which mustn't also sort by it
+    c->when_drag_end_is_click = false;
+    // Clicking a column sorts by it (ascending, then descending, then back to album order). Shift clicking adds it
+    // as a tie breaker after the ones already sorted by instead.
+    c->when_clicked = [](AppClient *client, cairo_t *cr, Container *c) {
+        auto data = (TableData *) c->user_data;
+        SortColumn column;
+        bool found = false;
+        for (auto &col: data->cols) {
+            auto left = c->real_bounds.x + 50 * config->dpi + col.offset - 8 * config->dpi;
+            if (client->mouse_current_x >= left && client->mouse_current_x < left + col.size) {
+                found = sort_column_named(col.name, &column);
+                break;
+            }
+        }
+        if (!found)
+            return;
+        bool shift = client->keyboard && xkb_state_mod_name_is_active(client->keyboard->state, XKB_MOD_NAME_SHIFT,
+                                                                      XKB_STATE_MODS_EFFECTIVE) > 0;
+        auto &keys = data->sort_keys;
+        auto existing = std::find_if(keys.begin(), keys.end(), [column](const SortKey &k) { return k.column == column; });
+        if (shift) {
+            if (existing == keys.end()) {
+                SortKey key;
+                key.column = column;
+                keys.push_back(key);
+            } else {
+                existing->descending = !existing->descending;
+            }
+        } else if (existing == keys.begin() && keys.size() == 1) {
+            if (existing->descending)
+                keys.clear();
+            else
+                existing->descending = true;
+        } else {
+            SortKey key;
+            key.column = column;
+            keys.assign(1, key);
+        }
+        sort_song_rows(client);
+        client_layout(app, client);
+        put_selected_on_screen(client);
+        request_refresh(app, client);
+    };
 }
 
 
-// Helper to read 4-byte little-endian unsigned int safely
-uint32_t readUInt32LE(const char *data) {
-    return (static_cast<uint8_t>(data[0])) |
-           (static_cast<uint8_t>(data[1]) << 8) |
-           (static_cast<uint8_t>(data[2]) << 16) |
-           (static_cast<uint8_t>(data[3]) << 24);
-}
-
-// Case-insensitive string comparison (portable)
-bool iequals(const std::string &a, const std::string &b) {
-    if (a.size() != b.size()) return false;
-    for (size_t i = 0; i < a.size(); ++i) {
-        if (std::tolower(static_cast<unsigned char>(a[i])) !=
-            std::tolower(static_cast<unsigned char>(b[i]))) {
-            return false;
+struct Filter : UserData {
+    std::string previous_filter;
+    // The query the rows were last filtered by (the search thread might not be done with previous_filter yet), and
+    // the songs it found by id
+    std::string shown_query;
+    std::vector<char> matched;
+    
+    // For the debug log: when the query that's about to be painted was typed, and how the search went
+    bool awaiting_paint = false;
+    SearchStats stats;
+    size_t hits = 0;
+};
+
+static void paint_even_row(AppClient *client, cairo_t *cr, Container *c, TrackId id, bool selected) {
+    if (selected) {
+        draw_colored_rect(client, ArgbColor(.545, .655, .788, 1), c->real_bounds);
+    } else {
+        draw_colored_rect(client, ArgbColor(.945, .953, .973, 1), c->real_bounds);
+        
+        auto line = c->real_bounds;
+        line.h = 1;
+        draw_colored_rect(client, ArgbColor(.953, .961, .965, 1), line);
+        line.y += 1;
+        draw_colored_rect(client, ArgbColor(.957, .969, .98, 1), line);
+        
+        line.y = c->real_bounds.y + c->real_bounds.h - 1;
+        draw_colored_rect(client, ArgbColor(.906, .914, .925, 1), line);
+        line.y = c->real_bounds.y + c->real_bounds.h - 2;
+        draw_colored_rect(client, ArgbColor(.933, .941, .953, 1), line);
+    }
+    paint_list_option_text(client, cr, c, id);
+    auto header = container_by_name("table_headers", client->root);
+    auto table_data = (TableData *) header->user_data;
+    if (table_data->dragging_col) {
+        SortOption tcol;
+        for (auto col : table_data->cols) {
+            if (col.name == table_data->target) {
+                tcol = col;
+                break;
+            }
+        }
+        auto leading_x = client->mouse_current_x - table_data->col_drag_offset - 8 * config->dpi;
+        auto bb = Bounds(leading_x, c->real_bounds.y, tcol.size, c->real_bounds.h);
+        if (selected) {
+            draw_colored_rect(client, ArgbColor(.545, .655, .788, 1), bb);
+        } else {
+            draw_colored_rect(client, ArgbColor(.945, .953, .973, 1), bb);
+            
+            auto line = bb;
+            line.h = 1;
+            draw_colored_rect(client, ArgbColor(.953, .961, .965, 1), line);
+            line.y += 1;
+            draw_colored_rect(client, ArgbColor(.957, .969, .98, 1), line);
+            
+            line.y = bb.y + bb.h - 1;
+            draw_colored_rect(client, ArgbColor(.906, .914, .925, 1), line);
+            line.y = bb.y + bb.h - 2;
+            draw_colored_rect(client, ArgbColor(.933, .941, .953, 1), line);
         }
+        
     }
-    return true;
+    paint_list_option_text(client, cr, c, id, true);
 }
 
-int extractDiscNumberFromFlac(const std::string &filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file) {
-        std::cerr << "Failed to open file.\n";
-        return -1;
-    }
-
-    // Check FLAC header
-    char header[4];
-    file.read(header, 4);
-    if (file.gcount() != 4 || std::string(header, 4) != "fLaC") {
-        std::cerr << "Not a valid FLAC file.\n";
-        return -1;
+// White Option
+static void paint_odd_row(AppClient *client, cairo_t *cr, Container *c, TrackId id, bool selected) {
+    if (selected) {
+        draw_colored_rect(client, ArgbColor(.545, .655, .788, 1), c->real_bounds);
+    } else {
+        draw_colored_rect(client, ArgbColor(.98, .98, .988, 1), c->real_bounds);
+        
+        auto line = c->real_bounds;
+        line.h = 1;
+        draw_colored_rect(client, ArgbColor(.965, .969, .973, 1), line);
+        line.y += 1;
+        draw_colored_rect(client, ArgbColor(.992, .992, .992, 1), line);
+        
+        line.y = c->real_bounds.y + c->real_bounds.h - 1;
+        draw_colored_rect(client, ArgbColor(.925, .925, .925, 1), line);
+        line.y = c->real_bounds.y + c->real_bounds.h - 2;
+        draw_colored_rect(client, ArgbColor(.961, .961, .961, 1), line);
     }
-
-    bool lastBlock = false;
-    while (!lastBlock && file) {
-        // Read metadata block header
-        unsigned char blockHeader[4];
-        file.read(reinterpret_cast<char*>(blockHeader), 4);
-        if (file.gcount() != 4) {
-            std::cerr << "Failed to read metadata block header.\n";
-            return -1;
-        }
-
-        lastBlock = blockHeader[0] & 0x80;
-        uint8_t blockType = blockHeader[0] & 0x7F;
-        uint32_t blockSize = (blockHeader[1] << 16) | (blockHeader[2] << 8) | blockHeader[3];
-
-        if (blockType == 4) {  // VORBIS_COMMENT
-            std::vector<char> blockData(blockSize);
-            file.read(blockData.data(), blockSize);
-            if (file.gcount() != static_cast<std::streamsize>(blockSize)) {
-                std::cerr << "Failed to read Vorbis comment block.\n";
-                return -1;
-            }
-
-            const char *ptr = blockData.data();
-            const char *end = ptr + blockSize;
-
-            // Read vendor string length (4 bytes LE)
-            if (ptr + 4 > end) return -1;
-            uint32_t vendorLen = readUInt32LE(ptr);
-            ptr += 4;
-            if (ptr + vendorLen > end) return -1;
-            ptr += vendorLen;  // Skip vendor string
-
-            // Read user comment list length (4 bytes LE)
-            if (ptr + 4 > end) return -1;
-            uint32_t userCommentListLen = readUInt32LE(ptr);
-            ptr += 4;
-
-            for (uint32_t i = 0; i < userCommentListLen; ++i) {
-                if (ptr + 4 > end) return -1;
-                uint32_t commentLen = readUInt32LE(ptr);
-                ptr += 4;
-                if (ptr + commentLen > end) return -1;
-                std::string comment(ptr, commentLen);
-                ptr += commentLen;
-
-                auto eqPos = comment.find('=');
-                if (eqPos != std::string::npos) {
-                    std::string key = comment.substr(0, eqPos);
-                    std::string value = comment.substr(eqPos + 1);
-                    if (iequals(key, "DISCNUMBER")) {
-                        try {
-                            return std::stoi(value);
-                        } catch (...) {
-                            std::cerr << "Failed to parse DISCNUMBER value.\n";
-                            return -1;
-                        }
-                    }
-                }
+    paint_list_option_text(client, cr, c, id);
+    auto header = container_by_name("table_headers", client->root);
+    auto table_data = (TableData *) header->user_data;
+    if (table_data->dragging_col) {
+        SortOption tcol;
+        for (auto col : table_data->cols) {
+            if (col.name == table_data->target) {
+                tcol = col;
+                break;
             }
-            // No DISCNUMBER found
-            return -1;
+        }
+        auto leading_x = client->mouse_current_x - table_data->col_drag_offset - 8 * config->dpi;
+        auto bb = Bounds(leading_x, c->real_bounds.y, tcol.size, c->real_bounds.h);
+        if (selected) {
+            draw_colored_rect(client, ArgbColor(.545, .655, .788, 1), bb);
         } else {
-            // Skip block
-            file.seekg(blockSize, std::ios::cur);
+            draw_colored_rect(client, ArgbColor(.98, .98, .988, 1), bb);
+            
+            auto line = bb;
+            line.h = 1;
+            draw_colored_rect(client, ArgbColor(.965, .969, .973, 1), line);
+            line.y += 1;
+            draw_colored_rect(client, ArgbColor(.992, .992, .992, 1), line);
+            
+            line.y = bb.y + bb.h - 1;
+            draw_colored_rect(client, ArgbColor(.925, .925, .925, 1), line);
+            line.y = bb.y + bb.h - 2;
+            draw_colored_rect(client, ArgbColor(.961, .961, .961, 1), line);
         }
     }
-
-    std::cerr << "No Vorbis comment block found.\n";
-    return -1;
+    paint_list_option_text(client, cr, c, id, true);
 }
 
-
-// Reads 4-byte synchsafe int (7 bits per byte)
-uint32_t readSynchsafeInt(const unsigned char *data) {
-    return ((data[0] & 0x7F) << 21) |
-           ((data[1] & 0x7F) << 14) |
-           ((data[2] & 0x7F) << 7) |
-           (data[3] & 0x7F);
+// Alternates the row backgrounds by position
+static void paint_song_row(AppClient *client, cairo_t *cr, Container *row, size_t index) {
+    auto rows = (SongRows *) row->parent->user_data;
+    if (index >= rows->shown.size())
+        return;
+    auto id = rows->shown[index];
+    if (index % 2 == 0) {
+        paint_even_row(client, cr, row, id, id == rows->selected);
+    } else {
+        paint_odd_row(client, cr, row, id, id == rows->selected);
+    }
 }
 
-// Reads 4-byte big-endian int
-uint32_t readUInt32BE(const unsigned char *data) {
-    return (static_cast<uint32_t>(data[0]) << 24) |
-           (static_cast<uint32_t>(data[1]) << 16) |
-           (static_cast<uint32_t>(data[2]) << 8) |
-           (static_cast<uint32_t>(data[3]));
+static void song_row_made(AppClient *client, Container *row) {
+    row->when_clicked = [](AppClient *client, cairo_t *cr, Container *c) {
+        auto rows = (SongRows *) c->parent->user_data;
+        auto index = virtual_row_index(c);
+        if (index >= rows->shown.size())
+            return;
+        auto id = rows->shown[index];
+        rows->selected = id;
+        if (c->state.mouse_button_pressed == 3) {
+            right_click_song(client, id);
+            return;
+        }
+        if (rows->last_clicked == id && client->app->current - rows->last_time_clicked < 500) {
+            player->play_track(pool_string(catalog_track(id).path));
+        }
+        rows->last_clicked = id;
+        rows->last_time_clicked = client->app->current;
+    };
+    row->when_mouse_enters_container = [](AppClient *client, cairo_t *cr, Container *c) {
+        auto rows = (SongRows *) c->parent->user_data;
+        auto index = virtual_row_index(c);
+        if (index < rows->shown.size())
+            player->warm(pool_string(catalog_track(rows->shown[index]).path));
+    };
 }
 
-int extractDiscNumberFromMp3(const std::string &filePath) {
-    std::ifstream file(filePath, std::ios::binary);
-    if (!file) {
-        std::cerr << "Failed to open file.\n";
-        return -1;
+// A row shows if its song was found by the search (when there is one) and is let through by the facet sidebar
+static void show_matching_rows(AppClient *client) {
+    auto content = container_by_name("songs_content", client->root);
+    auto list = songs_list(client);
+    if (!content || !list)
+        return;
+    auto filter = (Filter *) content->user_data;
+    auto rows = (SongRows *) list->user_data;
+    bool searching = !filter->shown_query.empty();
+    rows->shown.clear();
+    for (auto id: rows->sorted) {
+        bool found = !searching || (id < filter->matched.size() && filter->matched[id]);
+        if (found && facet_selection_has(id))
+            rows->shown.push_back(id);
     }
+    virtual_list_set_row_count(list, rows->shown.size());
+}
 
-    // Check ID3 header
-    unsigned char header[10];
-    file.read(reinterpret_cast<char*>(header), 10);
-    if (file.gcount() != 10 || std::string(reinterpret_cast<char*>(header), 3) != "ID3") {
-        std::cerr << "No ID3v2 tag found.\n";
-        return -1;
-    }
-
-    uint8_t versionMajor = header[3];
-    uint8_t versionMinor = header[4];
-    uint8_t flags = header[5];
-    uint32_t tagSize = readSynchsafeInt(&header[6]);
-
-    // Optional extended header for ID3v2.3+ (skip if present)
-    if ((flags & 0x40) != 0) {
-        unsigned char extHeader[4];
-        file.read(reinterpret_cast<char*>(extHeader), 4);
-        if (file.gcount() != 4) return -1;
-        uint32_t extSize = readUInt32BE(extHeader);
-        file.seekg(extSize - 4, std::ios::cur);
-    }
-
-    uint32_t bytesRead = 0;
-    while (bytesRead + 10 <= tagSize) {
-        unsigned char frameHeader[10];
-        file.read(reinterpret_cast<char*>(frameHeader), 10);
-        if (file.gcount() != 10) break;
-
-        std::string frameID(reinterpret_cast<char*>(frameHeader), 4);
-        uint32_t frameSize;
-        if (versionMajor == 4) {
-            frameSize = readSynchsafeInt(&frameHeader[4]);
-        } else {
-            frameSize = readUInt32BE(&frameHeader[4]);
-        }
-
-        uint16_t frameFlags = (frameHeader[8] << 8) | frameHeader[9];
-        bytesRead += 10;
-
-        if (frameSize == 0) break;  // Padding
+// Puts the songs in the order the header says, by sorting their ids rather than making anything again
+static void sort_song_rows(AppClient *client) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto header = container_by_name("table_headers", client->root);
+    auto list = songs_list(client);
+    if (!header || !list)
+        return;
+    auto table_data = (TableData *) header->user_data;
+    auto rows = (SongRows *) list->user_data;
+    
+    auto order = sort_permutation(rows->sorted, table_data->sort_keys);
+    std::vector<TrackId> sorted;
+    sorted.reserve(order.size());
+    for (auto position: order)
+        sorted.push_back(rows->sorted[position]);
+    rows->sorted.swap(sorted);
+    show_matching_rows(client);
+}
 
-        if (bytesRead + frameSize > tagSize) {
-            // Corrupt frame
+// Shows only the rows of the songs found, all at once
+static void songs_search_done(AppClient *client, const std::string &query, const std::vector<SearchHit> &hits,
+                              const SearchStats &stats) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto content = container_by_name("songs_content", client->root);
+    if (!content)
+        return;
+    auto filter = (Filter *) content->user_data;
+    if (query != filter->previous_filter)
+        return;
+    
+    filter->shown_query = query;
+    filter->matched.assign(catalog_track_count(), false);
+    for (auto &hit: hits)
+        if (hit.id < filter->matched.size())
+            filter->matched[hit.id] = true;
+    show_matching_rows(client);
+    
+    // When you type in a new filter query, it auto selects the best match the sidebar lets through (rows keep their
+    // order)
+    TrackId best = NO_TRACK;
+    for (auto &hit: hits) {
+        if (facet_selection_has(hit.id)) {
+            best = hit.id;
             break;
         }
-
-        if (frameID == "TPOS") {
-            std::vector<char> frameData(frameSize);
-            file.read(frameData.data(), frameSize);
-            if (file.gcount() != static_cast<std::streamsize>(frameSize)) {
-                std::cerr << "Failed to read TPOS frame data.\n";
-                return -1;
-            }
-
-            // First byte: encoding (0 = ISO-8859-1, 1 = UTF-16 etc.)
-            std::string text(frameData.begin() + 1, frameData.end());
-            try {
-                size_t pos = 0;
-                int disc = std::stoi(text, &pos);
-                return disc;
-            } catch (...) {
-                std::cerr << "Failed to parse TPOS value.\n";
-                return -1;
-            }
-        } else {
-            // Skip this frame
-            file.seekg(frameSize, std::ios::cur);
-        }
-        bytesRead += frameSize;
     }
-
-    std::cerr << "TPOS frame not found.\n";
-    return -1;
+    if (auto list = songs_list(client))
+        ((SongRows *) list->user_data)->selected = best;
+    filter->awaiting_paint = true;
+    filter->stats = stats;
+    filter->hits = hits.size();
+    
+    client_layout(app, client);
+    if (best != NO_TRACK)
+        put_selected_on_screen(client);
+    request_refresh(app, client);
 }
 
-int getDiscNumber(const std::string &filePath) {
-    int disc = extractDiscNumberFromFlac(filePath);
-    if (disc != -1) {
-        return disc;
+struct FacetRow : UserData {
+    Facet facet = FACET_COUNT; // FACET_COUNT for the title of a facet
+    uint32_t key = 0;
+    std::string text;
+    uint32_t count = 0;
+    bool selected = false;
+};
+
+struct FacetSidebar : UserData {
+    uint64_t shown_version = 0; // of the facets the rows were made from
+};
+
+static void paint_facet_row(AppClient *client, cairo_t *cr, Container *c) {
+    auto row = (FacetRow *) c->user_data;
+    if (row->facet == FACET_COUNT) {
+        draw_text(client, 10 * config->dpi, config->font, EXPAND(ArgbColor(.44, .44, .44, 1)), row->text, c->real_bounds, 5, 10 * config->dpi);
+        return;
     }
-
-    disc = extractDiscNumberFromMp3(filePath);
-    if (disc != -1) {
-        return disc;
+    if (row->selected) {
+        draw_colored_rect(client, ArgbColor(.545, .655, .788, 1), c->real_bounds);
+    } else if (c->state.mouse_hovering) {
+        draw_colored_rect(client, ArgbColor(.945, .953, .973, 1), c->real_bounds);
     }
+    auto [f, w, h] = draw_text_begin(client, 9 * config->dpi, config->font, EXPAND(ArgbColor(.44, .44, .44, 1)), std::to_string(row->count));
+    f->draw_text_end(c->real_bounds.x + c->real_bounds.w - w - 10 * config->dpi, c->real_bounds.y + c->real_bounds.h / 2 - h / 2);
     
-    TagLib::MP4::File mp4File(filePath.c_str());
-    if (mp4File.isValid()) {
-        TagLib::MP4::Tag *tag = mp4File.tag();
-        if (tag) {
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
-            TagLib::MP4::ItemListMap items = tag->itemListMap();
-#pragma GCC diagnostic pop
-            if (items.contains("disk")) {
-                TagLib::MP4::Item item = items["disk"];
-                if (item.isValid() && item.toIntPair().first > 0) {
-                    return item.toIntPair().first;
-                }
-            }
-        }
-    }
-
-    // Check for MP4 (M4A) files
-    /*
-    TagLib::MP4::File mp4File(filePath.c_str());
-    if (mp4File.isValid()) {
-        TagLib::MP4::Tag *tag = mp4File.tag();
-        if (tag) {
-            if (tag->itemListMap().contains("disk")) {
-                TagLib::MP4::Item item = tag->itemListMap()["disk"];
-                if (!item.isEmpty() && item.toIntPair().first > 0) {
-                    return item.toIntPair().first;
-                }
-            }
-        }
-    }
-*/
-
-    return 0;
+    auto name = c->real_bounds;
+    name.w -= w + 24 * config->dpi;
+    draw_clip_begin(client, name);
+    draw_text(client, 10 * config->dpi, config->font, EXPAND(ArgbColor(0, 0, 0, 1)), row->text, c->real_bounds, 5, 18 * config->dpi);
+    draw_clip_end(client);
 }
 
-
-static void cache_creation_thread(std::string cache_path, std::string path_to_search, std::string lfp_album_art) {
-    namespace fs = std::filesystem;
-
-    unsigned int threads = std::thread::hardware_concurrency();
-    if (threads == 0)
-        threads = 8;
-    ThreadPool pool(threads);
-    std::vector< std::future<Option> > results;
- 
-    std::vector<std::string> albums;
-    for (const auto& entry : fs::recursive_directory_iterator(path_to_search)) {
-        if (fs::is_regular_file(entry.path())) {
-            std::string full_path = entry.path().string();
-
-            results.emplace_back(pool.enqueue([full_path, entry] {
-                Option o;
-                TagLib::FileRef tag_file(full_path.c_str());
-                if (tag_file.isNull()) {
-                   return o;   
-                }
-                TagLib::Tag *tag = tag_file.tag();
-                if (tag) {
-                    o.full = full_path;
-                    o.name = tag->title().to8Bit(true);  // Convert to std::string
-                    if (o.name.empty()) {
-                        o.name = entry.path().filename().string();
-                    }
-                    o.artist = tag->artist().to8Bit(true);  // Convert to std::string
-                    o.album = tag->album().to8Bit(true);  // Convert to std::string
-                    o.genre = tag->genre().to8Bit(true);  // Convert to std::string
-                    o.disc = std::to_string(getDiscNumber(full_path));
-                    o.year = std::to_string((int) tag->year());  // Convert to std::string
-                    o.track = std::to_string((int) tag->track());  // Convert to std::string
-                }
-                
-                int length_in_seconds;
-                TagLib::AudioProperties *properties = tag_file.audioProperties();
-                if (properties) {
-                   o.length = std::to_string(properties->length());
-                }
-                return o;
-                                                                           
-                //options.push_back(o);
-            }));
-        }
-    }
+// A title for every facet, and under it its values with the most songs, each with how many it would show
+static void fill_facet_sidebar(Container *content) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    for (auto child: content->children)
+        delete child;
+    content->children.clear();
     
-    std::vector<Option> options;
-    for (auto && result: results) {
-        options.push_back(result.get());
-    }
-       
-    std::ofstream file(cache_path); // Replace with your actual file name
-    file << "version: 1" << std::endl;
-    for (auto o: options) {
-        if (o.full.empty())
+    for (int f = 0; f < FACET_COUNT; f++) {
+        auto values = facet_values((Facet) f, FACET_SIDEBAR_VALUES);
+        if (values.empty())
             continue;
-        write_to(file, "Path: ", o.full);
-        //file << "Path: " << full_path.c_str() << std::end;
-        write_to(file, "Title: ", o.name);
-        write_to(file, "Artist: ", o.artist);
-        write_to(file, "Album: ", o.album);
-        write_to(file, "Genre: ", o.genre);
-        write_to(file, "Year: ", o.year);
-        write_to(file, "Length: ", o.length);
-        write_to(file, "Track: ", o.track);
-        write_to(file, "Disc: ", o.disc);
+        auto title = content->child(FILL_SPACE, 28 * config->dpi);
+        auto title_data = new FacetRow;
+        title_data->text = facet_title((Facet) f);
+        title->user_data = title_data;
+        title->when_paint = paint_facet_row;
+        
+        for (auto &value: values) {
+            auto row = content->child(FILL_SPACE, 22 * config->dpi);
+            auto data = new FacetRow;
+            data->facet = (Facet) f;
+            data->key = value.key;
+            data->text = facet_value_name((Facet) f, value.key);
+            data->count = value.count;
+            data->selected = value.selected;
+            row->user_data = data;
+            row->when_paint = paint_facet_row;
+            row->when_clicked = [](AppClient *client, cairo_t *cr, Container *c) {
+                auto data = (FacetRow *) c->user_data;
+                facet_toggle(data->facet, data->key);
+                show_matching_rows(client);
+                // The sidebar is made again with the new counts (see its pre_layout), which deletes 'c'
+                client_layout(app, client);
+                request_refresh(app, client);
+            };
+        }
     }
- 
-    file.close();     
 }
 
-static void create_cache(std::string cache_path, std::string path_to_search) {
-    char *home = getenv("HOME");
-    std::string lfp_album_art(home);
-    lfp_album_art += "/.cache";
-    mkdir(lfp_album_art.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-    lfp_album_art += "/lfp_album_art";
-    mkdir(lfp_album_art.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
- 
-    std::thread t([&](){
-        cache_creation_thread(cache_path, path_to_search, lfp_album_art);
-    });
-    t.join();
+static void make_facet_sidebar(Container *songs_root) {
+    auto sidebar = songs_root->child(180 * config->dpi, FILL_SPACE);
+    sidebar->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
+        draw_colored_rect(client, ArgbColor(.98, .98, .988, 1), c->real_bounds);
+        auto line = c->real_bounds;
+        line.w = 1;
+        draw_colored_rect(client, ArgbColor(.847, .847, .847, 1), line);
+    };
+    
+    ScrollPaneSettings scroll_settings(config->dpi);
+    scroll_settings.right_inline_track = true;
+    auto sidebar_scroll = make_newscrollpane_as_child(sidebar, scroll_settings);
+    sidebar_scroll->content->name = "facet_sidebar";
+    sidebar_scroll->content->user_data = new FacetSidebar;
+    sidebar_scroll->content->pre_layout = [](AppClient *client, Container *c, const Bounds &b) {
+        auto sidebar = (FacetSidebar *) c->user_data;
+        if (sidebar->shown_version == facets_version())
+            return;
+        sidebar->shown_version = facets_version();
+        fill_facet_sidebar(c);
+    };
 }
 
-void fill_songs_tab(AppClient *client, Container *songs_root, std::vector<Option> &options) {
+void fill_songs_tab(AppClient *client, Container *songs_root) {
 #ifdef TRACY_ENABLE
     ZoneScoped;
 #endif
  
     songs_root->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
         //draw_colored_rect(client, ArgbColor(0, 0, 1, 1), c->real_bounds);
+        auto content = container_by_name("songs_content", client->root);
+        if (!content)
+            return;
+        auto filter = (Filter *) content->user_data;
+        if (filter->awaiting_paint) {
+            filter->awaiting_paint = false;
+            rt_log(RT_DEBUG, "Search \"%s\": %zu hits of %zu candidates%s, %.2f ms searching, %ld ms keystroke to repaint",
+                   filter->previous_filter.c_str(), filter->hits, filter->stats.candidates,
+                   filter->stats.narrowed ? " (narrowed)" : "", filter->stats.search_ms,
+                   get_current_time_in_ms() - filter->stats.submitted_ms);
+        }
     };
     
-    auto table_headers = songs_root->child(FILL_SPACE, 28 * config->dpi);
+    // The table, and the facet sidebar to its right (the column math in here takes the table to start at the left
+    // edge of the window)
+    songs_root->type = ::hbox;
+    auto songs_column = songs_root->child(FILL_SPACE, FILL_SPACE);
+    make_facet_sidebar(songs_root);
+    
+    auto table_headers = songs_column->child(FILL_SPACE, 28 * config->dpi);
     table_headers->when_paint = paint_table_header;
     create_table_headers(client, table_headers);
         
      
     ScrollPaneSettings scroll_settings(config->dpi);
     scroll_settings.right_inline_track = true;
-    auto songs_scroll_root = make_newscrollpane_as_child(songs_root, scroll_settings);
-    struct Filter : UserData {
-        std::string previous_filter;
-    };
+    auto songs_scroll_root = make_newscrollpane_as_child(songs_column, scroll_settings);
     songs_scroll_root->content->user_data = new Filter;
     songs_scroll_root->content->name = "songs_content";
     songs_scroll_root->content->pre_layout = [](AppClient *client, Container *c, const Bounds &b) {
@@ -759,24 +828,12 @@ void fill_songs_tab(AppClient *client, Container *songs_root, std::vector<Option
                 filter->previous_filter = data->state->text;
                 
                 if (filter->previous_filter.empty()) {
-                    for (auto child: c->children) {
-                        auto data = (ListOption *) child->user_data;
-                        //data->selected = false;
-                        child->exists = true;
-                    }    
+                    filter->shown_query.clear();
+                    show_matching_rows(client);
+                    search_cancel();
                 } else {
-                    std::string needle = toLower(filter->previous_filter);
-                    bool first = true;
-                    for (auto child: c->children) {
-                        auto data = (ListOption *) child->user_data;
-                        child->exists = fts::fuzzy_match_simple(needle.c_str(), data->title.c_str());
-                        data->selected = false;
-                        if (first && child->exists) { // When you type in a new filter query, it auto selects first
-                            first = false;
-                            data->selected = true;
-                            put_selected_on_screen(client);
-                        }
-                    }    
+                    // The rows change once the search thread is done (see songs_search_done)
+                    search_library_async(app, client, filter->previous_filter, songs_search_done);
                 }
             }
         }
@@ -785,245 +842,96 @@ void fill_songs_tab(AppClient *client, Container *songs_root, std::vector<Option
         //draw_colored_rect(client, ArgbColor(0, 0, 1, 1), c->real_bounds);
     };
     
+    // Only the rows on screen have containers, so the size of the library doesn't matter to layout or startup
+    auto list = make_virtual_list_as_child(songs_scroll_root->content, 30 * config->dpi, paint_song_row);
+    list->name = "songs_list";
+    list->when_row_made = song_row_made;
+    auto rows = new SongRows;
+    list->user_data = rows;
+    
     
     namespace fs = std::filesystem;
     
+    std::vector<Track> tracks;
+    std::vector<SongStamp> stamps;
+    std::vector<AlbumEntry> albums;
     char *home = getenv("HOME");
     std::string cache_path(home);
     cache_path += "/.cache/lfplayer.cache";
     
-    std::string path_to_search(home);
-    path_to_search += "/Music";
-    
-    {
-        if (fs::exists(cache_path)) {
-            load_from_cache(cache_path, options);
-        } else {
-            {
-#ifdef TRACY_ENABLE
-                ZoneScopedN("From files");
-#endif                
-                try {
-                    if (fs::exists(path_to_search) && fs::is_directory(path_to_search)) {
-                        create_cache(cache_path, path_to_search);    
-                        
-                        load_from_cache(cache_path, options);
-                    } else {
-                        std::cerr << "Provided path is not a directory or doesn't exist." << std::endl;
-                    }
-                } catch (const fs::filesystem_error& e) {
-                    std::cerr << "Filesystem error: " << e.what() << std::endl;
-                } catch (const std::exception& e) {
-                    std::cerr << "General error: " << e.what() << std::endl;
-                }
-            }
-        }
-    }
+    // A missing cache (first start) leaves the list empty: the scan started after the window shows fills it in
+    if (fs::exists(cache_path))
+        load_from_cache(cache_path, tracks, stamps, &albums);
     
     std::string lfp_album_art(home);
     lfp_album_art += "/.cache";
     mkdir(lfp_album_art.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
     lfp_album_art += "/lfp_album_art";
     mkdir(lfp_album_art.c_str(), S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
-
-    std::vector<std::string> albums_seen;
-    for (auto &o: options) {
-        if (!o.track.empty()) {
-            bool inside = false;
-            for (auto a : albums_seen) {
-                if (a == o.album) {
-                    inside = true;
-                }
-            }
-            if (!inside) {
-                std::string art = lfp_album_art + "/" + sanitize_file_name(o.album);
-                if (!fs::exists(art)) {
-                    //extract_album_art(o.full, art);
-                    albums_seen.push_back(o.album);
-                }
-            }
-            
-            
-            try {
-                o.track_num = std::atoi(o.track.c_str());
-                o.disc_num = std::atoi(o.disc.c_str());
-            } catch (...) {
-                
-            }
-        }
-    }
-   
-    std::sort(options.begin(), options.end(), [](Option a, Option b) {
-                      if (a.album.empty()) {
-                          return false;
-                      }
-                      if (b.album.empty()) {
-                          return true;
-                      }
-                      if (a.album == b.album) {
-                          if (a.disc_num == b.disc_num) {
-                              return a.track_num < b.track_num;
-                          } else {
-                              return a.disc_num < b.disc_num;
-                          }
-                      } else {
-                          return a.album < b.album;
-                      }
-                  });
+    
+    // In cache order, which the album index points into, so the TrackIds are the indices into 'tracks'
+    catalog_load(tracks, albums);
+    set_cached_songs(stamps);
     
     {
 #ifdef TRACY_ENABLE
         ZoneScopedN("Create options");
 #endif
-        int even = 0;
-        for (auto o: options) {
-            auto list_option = songs_scroll_root->content->child(FILL_SPACE, 30 * config->dpi);
-            list_option->when_clicked = [](AppClient *client, cairo_t *cr, Container *c) {
-                auto data = (ListOption *) c->user_data;
-                bool was_selected = data->selected;
-                for (auto child : c->parent->children) {
-                    auto d = (ListOption *) child->user_data;
-                    d->selected = false;
-                }
-                data->selected = true;
-                if (c->state.mouse_button_pressed == 3) {
-                    right_click_song(client, data->label->text, data->title);
-                    return;
-                }
-                if (client->app->current - data->last_time_clicked < 500) {
-                    player->play_track(data->label->text);
-                }
-                data->last_time_clicked = client->app->current;
-            };
-            auto label = new Label(o.full);
-            label->size = 10 * config->dpi;
-            auto list_option_data = new ListOption;
-            list_option_data->title = o.name;
-            list_option_data->title_all_lower = toLower(o.name);
-            list_option_data->artist = o.artist;
-            list_option_data->album = o.album;
-            list_option_data->genre = o.genre;
-            list_option_data->year = o.year;
-            list_option_data->length = o.length;
-            if (!o.length.empty()) {
-                try {
-                    list_option_data->length = seconds_to_mmss(std::atoi(o.length.c_str()));
-                } catch (...) {
-                    
-                }
-            }
-            
-            list_option_data->track = o.track;
-            
-            list_option_data->label = label;
-            list_option->user_data = list_option_data;
-            if (even++ % 2 == 0) {
-                list_option->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
-                    auto data = (ListOption *) c->user_data;
-                    if (data->selected) {
-                        draw_colored_rect(client, ArgbColor(.545, .655, .788, 1), c->real_bounds);
-                    } else {
-                        draw_colored_rect(client, ArgbColor(.945, .953, .973, 1), c->real_bounds);
-                        
-                        auto line = c->real_bounds;
-                        line.h = 1;
-                        draw_colored_rect(client, ArgbColor(.953, .961, .965, 1), line);
-                        line.y += 1;
-                        draw_colored_rect(client, ArgbColor(.957, .969, .98, 1), line);
-                        
-                        line.y = c->real_bounds.y + c->real_bounds.h - 1;
-                        draw_colored_rect(client, ArgbColor(.906, .914, .925, 1), line);
-                        line.y = c->real_bounds.y + c->real_bounds.h - 2;
-                        draw_colored_rect(client, ArgbColor(.933, .941, .953, 1), line);
-                    }
-                    paint_list_option_text(client, cr, c);
-                    auto header = container_by_name("table_headers", client->root);
-                    auto table_data = (TableData *) header->user_data;
-                    if (table_data->dragging_col) {
-                        SortOption tcol;
-                        for (auto col : table_data->cols) {
-                            if (col.name == table_data->target) {
-                                tcol = col;
-                                break;
-                            }
-                        }
-                        auto leading_x = client->mouse_current_x - table_data->col_drag_offset - 8 * config->dpi;
-                        auto bb = Bounds(leading_x, c->real_bounds.y, tcol.size, c->real_bounds.h);
-                        if (data->selected) {
-                            draw_colored_rect(client, ArgbColor(.545, .655, .788, 1), bb);
-                        } else {
-                            draw_colored_rect(client, ArgbColor(.945, .953, .973, 1), bb);
-                            
-                            auto line = bb;
-                            line.h = 1;
-                            draw_colored_rect(client, ArgbColor(.953, .961, .965, 1), line);
-                            line.y += 1;
-                            draw_colored_rect(client, ArgbColor(.957, .969, .98, 1), line);
-                            
-                            line.y = bb.y + bb.h - 1;
-                            draw_colored_rect(client, ArgbColor(.906, .914, .925, 1), line);
-                            line.y = bb.y + bb.h - 2;
-                            draw_colored_rect(client, ArgbColor(.933, .941, .953, 1), line);
-                        }
-                        
-                    }
-                    paint_list_option_text(client, cr, c, true);
-                };    
-            } else {
-                // White Option
-                list_option->when_paint = [](AppClient *client, cairo_t *cr, Container *c) {
-                    auto data = (ListOption *) c->user_data;
-                    if (data->selected) {
-                        draw_colored_rect(client, ArgbColor(.545, .655, .788, 1), c->real_bounds);
-                    } else {
-                        draw_colored_rect(client, ArgbColor(.98, .98, .988, 1), c->real_bounds);
-                        
-                        auto line = c->real_bounds;
-                        line.h = 1;
-                        draw_colored_rect(client, ArgbColor(.965, .969, .973, 1), line);
-                        line.y += 1;
-                        draw_colored_rect(client, ArgbColor(.992, .992, .992, 1), line);
-                        
-                        line.y = c->real_bounds.y + c->real_bounds.h - 1;
-                        draw_colored_rect(client, ArgbColor(.925, .925, .925, 1), line);
-                        line.y = c->real_bounds.y + c->real_bounds.h - 2;
-                        draw_colored_rect(client, ArgbColor(.961, .961, .961, 1), line);
-                    }
-                    paint_list_option_text(client, cr, c);
-                    auto header = container_by_name("table_headers", client->root);
-                    auto table_data = (TableData *) header->user_data;
-                    if (table_data->dragging_col) {
-                        SortOption tcol;
-                        for (auto col : table_data->cols) {
-                            if (col.name == table_data->target) {
-                                tcol = col;
-                                break;
-                            }
-                        }
-                        auto leading_x = client->mouse_current_x - table_data->col_drag_offset - 8 * config->dpi;
-                        auto bb = Bounds(leading_x, c->real_bounds.y, tcol.size, c->real_bounds.h);
-                        if (data->selected) {
-                            draw_colored_rect(client, ArgbColor(.545, .655, .788, 1), bb);
-                        } else {
-                            draw_colored_rect(client, ArgbColor(.98, .98, .988, 1), bb);
-                            
-                            auto line = bb;
-                            line.h = 1;
-                            draw_colored_rect(client, ArgbColor(.965, .969, .973, 1), line);
-                            line.y += 1;
-                            draw_colored_rect(client, ArgbColor(.992, .992, .992, 1), line);
-                            
-                            line.y = bb.y + bb.h - 1;
-                            draw_colored_rect(client, ArgbColor(.925, .925, .925, 1), line);
-                            line.y = bb.y + bb.h - 2;
-                            draw_colored_rect(client, ArgbColor(.961, .961, .961, 1), line);
-                        }
-                    }
-                    paint_list_option_text(client, cr, c, true);
-                };    
-            }   
+        // The album index is already in songs tab order (comes_before), so nothing needs sorting, except for the songs
+        // without an album: the index has them by disc and track, but comes_before leaves them to go by id
+        for (auto &a: albums) {
+            size_t first = rows->sorted.size();
+            for (auto s: a.songs)
+                rows->sorted.push_back(s);
+            if (a.name.empty())
+                std::sort(rows->sorted.begin() + first, rows->sorted.end());
         }
+        rows->shown = rows->sorted;
+        virtual_list_set_row_count(list, rows->shown.size());
     }
 }
+
+void songs_tab_apply_changes(AppClient *client, const CatalogChanges &changes) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto content = container_by_name("songs_content", client->root);
+    auto list = songs_list(client);
+    if (!content || !list)
+        return;
+    auto rows = (SongRows *) list->user_data;
+    
+    // Changed songs are taken out and put back in, since their tags might have moved them (the selection goes by id,
+    // so it stays with a song that's put back)
+    std::unordered_set<TrackId> taken_out(changes.removed.begin(), changes.removed.end());
+    rows->sorted.erase(std::remove_if(rows->sorted.begin(), rows->sorted.end(),
+                                      [&taken_out](TrackId id) { return taken_out.count(id) > 0; }),
+                       rows->sorted.end());
     
-    
\ No newline at end of file
+    auto filter = (Filter *) content->user_data;
+    // A first scan hands over thousands of songs at a time, so they're sorted on their own and merged in
+    std::vector<TrackId> added;
+    for (auto id: changes.added) {
+        if (!filter->shown_query.empty()) {
+            if (id >= filter->matched.size())
+                filter->matched.resize(id + 1, false);
+            filter->matched[id] = song_matches_query(filter->shown_query, id);
+        }
+        added.push_back(id);
+    }
+    auto header = container_by_name("table_headers", client->root);
+    auto &sort_keys = ((TableData *) header->user_data)->sort_keys;
+    auto by_track = [&sort_keys](TrackId a, TrackId b) {
+        return sorts_before(a, b, sort_keys);
+    };
+    std::sort(added.begin(), added.end(), by_track);
+    std::vector<TrackId> merged;
+    merged.reserve(rows->sorted.size() + added.size());
+    std::merge(rows->sorted.begin(), rows->sorted.end(), added.begin(), added.end(),
+               std::back_inserter(merged), by_track);
+    rows->sorted.swap(merged);
+    show_matching_rows(client);
+    
+    client_layout(app, client);
+    request_refresh(app, client);
+}
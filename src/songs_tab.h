@@ -8,10 +8,22 @@
 #include "main.h"
 #include <vector>
 
-void fill_songs_tab(AppClient *client, Container *songs_root, std::vector<Option> &options);
+// Loads the library cache into the catalog (which the other tabs then fill from) and lists every song
+void fill_songs_tab(AppClient *client, Container *songs_root);
 
 void put_selected_on_screen(AppClient *client);
 
+// The selected song, if its row is showing
+TrackId selected_song(AppClient *client);
+
+// Selects the row after (or before) the selected one, wrapping around at the ends
+void select_next_song(AppClient *client);
+
+void select_previous_song(AppClient *client);
+
+// Updates only the rows of songs the library watcher saw change, appear or disappear
+void songs_tab_apply_changes(AppClient *client, const CatalogChanges &changes);
+
 
 
 #endif //SONGS_TAB_H
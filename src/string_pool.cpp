@@ -0,0 +1,95 @@
+
+#include "string_pool.h"
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#define CHUNK_SIZE (256 * 1024)
+#define ENTRIES_PER_BLOCK 4096
+#define MAX_BLOCKS 4096 // 16M distinct strings
+
+struct PoolEntry {
+    const char *text;
+    uint32_t length;
+};
+
+static std::mutex pool_mutex;
+static std::unordered_map<std::string_view, StringId> pool_index;
+static std::atomic<PoolEntry *> pool_blocks[MAX_BLOCKS];
+static std::atomic<uint32_t> pool_count{0};
+static std::vector<char *> chunks;
+static size_t chunk_used = CHUNK_SIZE;
+static size_t arena_bytes = 0;
+
+static const char *arena_copy(std::string_view s) {
+    size_t needed = s.size() + 1;
+    char *dest;
+    if (needed > CHUNK_SIZE / 4) {
+        // Big strings get a chunk of their own, so they don't waste the rest of the current one
+        dest = new char[needed];
+    } else {
+        if (chunk_used + needed > CHUNK_SIZE) {
+            chunks.push_back(new char[CHUNK_SIZE]);
+            chunk_used = 0;
+        }
+        dest = chunks.back() + chunk_used;
+        chunk_used += needed;
+    }
+    memcpy(dest, s.data(), s.size());
+    dest[s.size()] = '\0';
+    arena_bytes += needed;
+    return dest;
+}
+
+static StringId add_entry(std::string_view s) {
+    uint32_t id = pool_count.load(std::memory_order_relaxed);
+    auto block = pool_blocks[id / ENTRIES_PER_BLOCK].load(std::memory_order_relaxed);
+    if (!block) {
+        block = new PoolEntry[ENTRIES_PER_BLOCK];
+        pool_blocks[id / ENTRIES_PER_BLOCK].store(block, std::memory_order_release);
+    }
+    const char *text = arena_copy(s);
+    block[id % ENTRIES_PER_BLOCK] = {text, (uint32_t) s.size()};
+    pool_index.emplace(std::string_view(text, s.size()), id);
+    pool_count.store(id + 1, std::memory_order_release);
+    return id;
+}
+
+StringId intern(std::string_view s) {
+    std::lock_guard<std::mutex> guard(pool_mutex);
+    if (pool_count.load(std::memory_order_relaxed) == 0)
+        add_entry("");
+    auto it = pool_index.find(s);
+    if (it != pool_index.end())
+        return it->second;
+    return add_entry(s);
+}
+
+StringId pool_find(std::string_view s) {
+    std::lock_guard<std::mutex> guard(pool_mutex);
+    auto it = pool_index.find(s);
+    return it == pool_index.end() ? 0 : it->second;
+}
+
+std::string_view pool_view(StringId id) {
+    if (id >= pool_count.load(std::memory_order_acquire))
+        return "";
+    auto &entry = pool_blocks[id / ENTRIES_PER_BLOCK].load(std::memory_order_acquire)[id % ENTRIES_PER_BLOCK];
+    return std::string_view(entry.text, entry.length);
+}
+
+const char *pool_cstr(StringId id) {
+    return pool_view(id).data();
+}
+
+std::string pool_string(StringId id) {
+    return std::string(pool_view(id));
+}
+
+void pool_stats(size_t *strings, size_t *bytes) {
+    std::lock_guard<std::mutex> guard(pool_mutex);
+    *strings = pool_count.load();
+    *bytes = arena_bytes;
+}
@@ -0,0 +1,30 @@
+/* date = October 19th 2026 4:20 pm */
+
+#ifndef STRING_POOL_H
+#define STRING_POOL_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Every distinct string is stored once, in big arena chunks that are never freed, and handed out as a small id.
+// Id 0 is always the empty string.
+typedef uint32_t StringId;
+
+// Safe from any thread
+StringId intern(std::string_view s);
+
+// The id 's' already has, or 0 if it was never interned (so lookups of strings that might not be known don't add them)
+StringId pool_find(std::string_view s);
+
+// Lock free, and the view (and the '\0' right after it) stays valid for the life of the program
+std::string_view pool_view(StringId id);
+
+const char *pool_cstr(StringId id);
+
+std::string pool_string(StringId id);
+
+// How many distinct strings, and how many bytes the arena holds
+void pool_stats(size_t *strings, size_t *bytes);
+
+#endif //STRING_POOL_H
@@ -0,0 +1,74 @@
+/* date = October 19th 2026 7:05 pm */
+
+#ifndef TRACK_H
+#define TRACK_H
+
+#include "string_pool.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct Option {
+    std::string full;
+    std::string name;
+    std::string artist;
+    std::string album;
+    std::string genre;
+    std::string year;
+    std::string length;
+    std::string track;
+    std::string disc;
+    
+    // What the title, artist, album and genre are searched and sorted by (see collation_key), worked out once when
+    // the tags are read and kept in the library cache. Empty when that's the text itself.
+    std::string title_key;
+    std::string artist_key;
+    std::string album_key;
+    std::string genre_key;
+    
+    // What the file looked like when its tags were read (to notice changes on rescan)
+    uint64_t size = 0;
+    int64_t mtime = 0; // nanoseconds
+    uint64_t inode = 0;
+    bool has_art = false; // embedded cover art
+};
+
+// What the views keep of a song: Option is only used while scanning and reading the cache
+struct Track {
+    StringId path = 0;
+    StringId title = 0;
+    StringId artist = 0;
+    StringId album = 0;
+    StringId genre = 0;
+    uint16_t year = 0;
+    uint16_t track = 0;
+    uint16_t disc = 0;
+    uint32_t length = 0; // seconds
+    bool has_art = false;
+    
+    // The collation keys from Option, the same ids when that's the text itself
+    StringId title_key = 0;
+    StringId artist_key = 0;
+    StringId album_key = 0;
+    StringId genre_key = 0;
+};
+
+// What a song's file looked like when its tags were read, which a rescan compares the file against
+struct SongStamp {
+    StringId path = 0;
+    uint64_t size = 0;
+    int64_t mtime = 0; // nanoseconds
+    uint64_t inode = 0;
+    bool has_art = false;
+};
+
+// An album as the library cache keeps it, so the albums don't have to be worked out again at every start
+struct AlbumEntry {
+    std::string name; // empty for the songs without an album
+    std::vector<uint32_t> songs; // indices of its songs in the cache, by disc, then track
+    uint32_t length = 0;
+    uint16_t year = 0;
+    int32_t art = -1; // index of the song the cover is taken from (the first one with embedded art if any has it)
+};
+
+#endif //TRACK_H
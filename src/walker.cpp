@@ -0,0 +1,156 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "walker.h"
+#include "library.h"
+#include "io_scheduler.h"
+#include "rt_log.h"
+#include <condition_variable>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct Walk {
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<std::string> directories; // waiting to be read
+    int busy = 0; // threads reading a directory (which might find more)
+    const std::function<void(std::vector<WalkEntry> &)> *on_files;
+};
+
+static bool stat_song(int directory_fd, const char *name, WalkEntry *entry) {
+    struct statx stx{};
+    if (statx(directory_fd, name, AT_STATX_SYNC_AS_STAT | AT_NO_AUTOMOUNT,
+              STATX_TYPE | STATX_SIZE | STATX_MTIME | STATX_INO, &stx) != 0)
+        return false;
+    if (!S_ISREG(stx.stx_mode))
+        return false;
+    entry->size = stx.stx_size;
+    entry->mtime = (int64_t) stx.stx_mtime.tv_sec * 1000000000ll + stx.stx_mtime.tv_nsec;
+    entry->inode = stx.stx_ino;
+    entry->device = makedev(stx.stx_dev_major, stx.stx_dev_minor);
+    return true;
+}
+
+// Reads one directory, queueing the ones under it and handing its songs on
+static void read_directory(Walk *walk, const std::string &directory) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    int fd = open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno != EACCES && errno != ENOENT)
+            rt_log(RT_WARNING, "Library walk: couldn't open %s (%s)", directory.c_str(), strerror(errno));
+        return;
+    }
+
+    std::vector<std::string> found_directories;
+    std::vector<WalkEntry> songs;
+    alignas(linux_dirent64) char buffer[32 * 1024];
+    while (true) {
+        long length = syscall(SYS_getdents64, fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            if (length < 0)
+                rt_log(RT_WARNING, "Library walk: couldn't read %s (%s)", directory.c_str(), strerror(errno));
+            break;
+        }
+        for (long offset = 0; offset < length;) {
+            auto d = (linux_dirent64 *) (buffer + offset);
+            offset += d->d_reclen;
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            unsigned char type = d->d_type;
+            if (type == DT_UNKNOWN) {
+                // Some filesystems don't fill d_type in, so those cost a stat
+                struct stat st{};
+                if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+                    continue;
+                type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISLNK(st.st_mode) ? DT_LNK : S_ISREG(st.st_mode) ? DT_REG : 0;
+            }
+
+            std::string path = directory + "/" + name;
+            if (type == DT_DIR) {
+                found_directories.push_back(path);
+            } else if ((type == DT_REG || type == DT_LNK) && is_audio_file(path)) {
+                WalkEntry entry;
+                if (stat_song(fd, name, &entry)) {
+                    entry.path = std::move(path);
+                    songs.push_back(std::move(entry));
+                }
+            }
+        }
+    }
+    close(fd);
+
+    if (!found_directories.empty()) {
+        {
+            std::lock_guard<std::mutex> guard(walk->mutex);
+            for (auto &d: found_directories)
+                walk->directories.push_back(std::move(d));
+        }
+        walk->cv.notify_all();
+    }
+    if (!songs.empty())
+        (*walk->on_files)(songs);
+}
+
+static void walk_thread(Walk *walk) {
+    lower_thread_priority();
+    std::unique_lock<std::mutex> lock(walk->mutex);
+    while (true) {
+        walk->cv.wait(lock, [walk] { return !walk->directories.empty() || walk->busy == 0; });
+        if (walk->directories.empty())
+            return; // Nobody is reading anything that could add more
+        // Deepest first, so the queue stays small
+        std::string directory = std::move(walk->directories.back());
+        walk->directories.pop_back();
+        walk->busy++;
+        lock.unlock();
+
+        read_directory(walk, directory);
+
+        lock.lock();
+        walk->busy--;
+        if (walk->busy == 0 && walk->directories.empty())
+            walk->cv.notify_all();
+    }
+}
+
+void walk_library(const std::string &root, int threads, const std::function<void(std::vector<WalkEntry> &)> &on_files) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    Walk walk;
+    walk.on_files = &on_files;
+    std::string start = root;
+    while (start.size() > 1 && start.back() == '/')
+        start.pop_back();
+    walk.directories.push_back(start);
+
+    std::vector<std::thread> walkers;
+    for (int i = 0; i < std::max(1, threads); i++)
+        walkers.emplace_back(walk_thread, &walk);
+    for (auto &w: walkers)
+        w.join();
+}
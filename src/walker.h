@@ -0,0 +1,26 @@
+/* date = October 19th 2026 6:30 pm */
+
+#ifndef WALKER_H
+#define WALKER_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include <sys/types.h>
+
+struct WalkEntry {
+    std::string path;
+    uint64_t size;
+    int64_t mtime; // nanoseconds
+    uint64_t inode;
+    dev_t device;
+};
+
+// Walks 'root' on 'threads' threads, reading directories with getdents64 and going by d_type, so only the audio
+// files themselves get stat'ed (with statx, relative to their open directory). 'on_files' is called from the
+// walking threads with one directory's songs at a time, so their tags can be read while the walk goes on.
+// Symlinked songs are followed, symlinked directories aren't. Returns once everything has been walked.
+void walk_library(const std::string &root, int threads, const std::function<void(std::vector<WalkEntry> &)> &on_files);
+
+#endif //WALKER_H
@@ -0,0 +1,379 @@
+
+#ifdef TRACY_ENABLE
+
+#include "../tracy/public/tracy/Tracy.hpp"
+
+#endif
+
+#include "watcher.h"
+#include "library.h"
+#include "catalog.h"
+#include "songs_tab.h"
+#include "album_tab.h"
+#include "artist_tab.h"
+#include "playlist_tab.h"
+#include "utility.h"
+#include "rt_log.h"
+#include "io_scheduler.h"
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Events are held until the library has been quiet for this long (copying a big box set fires thousands of them)
+#define DEBOUNCE_MS 250
+// A copy that keeps going for minutes still shows up in pieces
+#define MAX_DEBOUNCE_MS 2000
+
+#define WATCH_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE | IN_DELETE_SELF | IN_ONLYDIR)
+
+struct WatchBatch {
+    std::set<std::string> files; // written or moved in
+    std::set<std::string> gone; // deleted or moved out
+    std::set<std::string> directories; // created or moved in, walked whole
+    std::set<std::string> gone_directories;
+};
+
+struct LibraryWatcher {
+    App *app = nullptr;
+    AppClient *client = nullptr;
+    std::string cache_path;
+    std::string root;
+    int inotify_fd = -1;
+    int results_fd = -1;
+
+    // Only touched from the main thread
+    WatchBatch pending;
+    long first_pending = 0;
+    Timeout *debounce = nullptr;
+    bool songs_since_art = false;
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::unordered_map<int, std::string> directories; // watch descriptor -> path
+    bool warned_about_limit = false;
+    std::deque<WatchBatch> batches; // waiting for the worker
+    std::vector<Option> changed; // waiting for the main thread
+    std::vector<std::string> removed;
+};
+
+static LibraryWatcher *watcher = nullptr;
+
+static void add_watch(const std::string &directory) {
+    int wd = inotify_add_watch(watcher->inotify_fd, directory.c_str(), WATCH_MASK);
+    std::lock_guard<std::mutex> guard(watcher->mutex);
+    if (wd == -1) {
+        if (errno == ENOSPC && !watcher->warned_about_limit) {
+            watcher->warned_about_limit = true;
+            rt_log(RT_WARNING, "Library watcher: out of inotify watches at %s (raise fs.inotify.max_user_watches)",
+                   directory.c_str());
+        }
+        return;
+    }
+    watcher->directories[wd] = directory;
+}
+
+// Watches 'directory' and everything under it, collecting the songs found along the way into 'files'
+static void watch_tree(const std::string &directory, std::set<std::string> *files) {
+    namespace fs = std::filesystem;
+    add_watch(directory);
+    try {
+        for (const auto &entry: fs::recursive_directory_iterator(directory, fs::directory_options::skip_permission_denied)) {
+            std::error_code ec;
+            if (entry.is_directory(ec)) {
+                add_watch(entry.path().string());
+            } else if (files && is_audio_file(entry.path().string())) {
+                files->insert(entry.path().string());
+            }
+        }
+    } catch (const std::exception &e) {
+        rt_log(RT_WARNING, "Library watcher: couldn't walk %s: %s", directory.c_str(), e.what());
+    }
+}
+
+static void unwatch_tree(const std::string &directory) {
+    std::string prefix = directory + "/";
+    std::lock_guard<std::mutex> guard(watcher->mutex);
+    for (auto it = watcher->directories.begin(); it != watcher->directories.end();) {
+        if (it->second == directory || it->second.compare(0, prefix.size(), prefix) == 0) {
+            inotify_rm_watch(watcher->inotify_fd, it->first);
+            it = watcher->directories.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+static bool unchanged(const Option &a, const Option &b) {
+    return a.size == b.size && a.mtime == b.mtime && a.inode == b.inode;
+}
+
+static void process_batch(IoScheduler &scheduler, WatchBatch &batch) {
+#ifdef TRACY_ENABLE
+    ZoneScoped;
+#endif
+    auto start = std::chrono::steady_clock::now();
+
+    // Directories that left are dropped before ones that came in, so a move inside the library re-watches the new path
+    for (auto &directory: batch.gone_directories) {
+        unwatch_tree(directory);
+        for (auto &path: cached_songs_under(directory))
+            batch.gone.insert(path);
+    }
+    for (auto &directory: batch.directories) {
+        std::set<std::string> found;
+        watch_tree(directory, &found);
+        // After an overflow we don't know what was missed, so whatever isn't there anymore is gone
+        for (auto &path: cached_songs_under(directory))
+            if (!found.count(path))
+                batch.gone.insert(path);
+        for (auto &path: found) {
+            batch.files.insert(path);
+            batch.gone.erase(path);
+        }
+    }
+
+    // Tags are read the way the library scan reads them: as many at once as the device keeps up with, in inode order
+    std::vector<std::pair<std::string, Option>> results;
+    for (auto &path: batch.files)
+        results.emplace_back(path, Option());
+    std::mutex done_mutex;
+    std::condition_variable done_cv;
+    size_t done = 0;
+    for (auto &result: results) {
+        struct stat st{};
+        if (stat(result.first.c_str(), &st) != 0) { // Already gone again, so it stays empty
+            std::lock_guard<std::mutex> guard(done_mutex);
+            done++;
+            continue;
+        }
+        scheduler.submit(st.st_dev, st.st_ino, [&result, &done_mutex, &done_cv, &done] {
+            result.second = read_song(result.first);
+            {
+                std::lock_guard<std::mutex> guard(done_mutex);
+                done++;
+            }
+            done_cv.notify_one();
+        });
+    }
+    {
+        std::unique_lock<std::mutex> lock(done_mutex);
+        done_cv.wait(lock, [&] { return done == results.size(); });
+    }
+
+    std::vector<Option> changed;
+    std::vector<std::string> removed;
+    for (auto &result: results) {
+        Option &o = result.second;
+        Option cached;
+        bool known = cached_song(result.first, &cached);
+        if (o.full.empty()) {
+            if (known)
+                removed.push_back(result.first);
+        } else if (!known || !unchanged(o, cached)) {
+            changed.push_back(o);
+        }
+    }
+    for (auto &path: batch.gone) {
+        Option cached;
+        if (cached_song(path, &cached))
+            removed.push_back(path);
+    }
+    if (changed.empty() && removed.empty())
+        return;
+
+    rt_log(RT_INFO, "Library watcher: %zu changed, %zu removed (%zu files looked at) in %ld ms",
+           changed.size(), removed.size(), batch.files.size(),
+           (long) std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count());
+    post_library_changes(changed, removed);
+}
+
+void post_library_changes(const std::vector<Option> &changed, const std::vector<std::string> &removed) {
+    if (!watcher)
+        return;
+    {
+        std::lock_guard<std::mutex> guard(watcher->mutex);
+        watcher->changed.insert(watcher->changed.end(), changed.begin(), changed.end());
+        watcher->removed.insert(watcher->removed.end(), removed.begin(), removed.end());
+    }
+    uint64_t one = 1;
+    write(watcher->results_fd, &one, sizeof(one));
+}
+
+static void watcher_thread() {
+    lower_thread_priority();
+    watch_tree(watcher->root, nullptr);
+
+    unsigned int threads = std::thread::hardware_concurrency();
+    if (threads == 0)
+        threads = 4;
+    IoScheduler scheduler(threads);
+
+    while (true) {
+        WatchBatch batch;
+        {
+            std::unique_lock<std::mutex> lock(watcher->mutex);
+            watcher->cv.wait(lock, [] { return !watcher->batches.empty(); });
+            batch = std::move(watcher->batches.front());
+            watcher->batches.pop_front();
+        }
+        process_batch(scheduler, batch);
+    }
+}
+
+static void debounce_timeout(App *app, AppClient *client, Timeout *, void *) {
+    watcher->debounce = nullptr;
+    {
+        std::lock_guard<std::mutex> guard(watcher->mutex);
+        watcher->batches.push_back(std::move(watcher->pending));
+    }
+    watcher->pending = WatchBatch();
+    watcher->cv.notify_one();
+}
+
+static void handle_event(const struct inotify_event *event) {
+    auto &pending = watcher->pending;
+    if (event->mask & IN_Q_OVERFLOW) {
+        rt_log(RT_WARNING, "Library watcher: event queue overflowed, walking the whole library");
+        pending.directories.insert(watcher->root);
+        return;
+    }
+
+    std::string directory;
+    {
+        std::lock_guard<std::mutex> guard(watcher->mutex);
+        auto it = watcher->directories.find(event->wd);
+        if (it == watcher->directories.end())
+            return;
+        directory = it->second;
+        if (event->mask & IN_IGNORED) {
+            watcher->directories.erase(it);
+            return;
+        }
+    }
+    if (event->mask & IN_DELETE_SELF) {
+        if (directory == watcher->root)
+            rt_log(RT_WARNING, "Library watcher: %s was removed", directory.c_str());
+        return;
+    }
+    if (event->len == 0)
+        return;
+    std::string path = directory + "/" + event->name;
+
+    if (event->mask & IN_ISDIR) {
+        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            pending.directories.insert(path);
+            pending.gone_directories.erase(path);
+        } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            pending.gone_directories.insert(path);
+            pending.directories.erase(path);
+        }
+        return;
+    }
+
+    if (!is_audio_file(path))
+        return;
+    if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        pending.files.insert(path);
+        pending.gone.erase(path);
+    } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        pending.gone.insert(path);
+        pending.files.erase(path);
+    }
+}
+
+static void inotify_wakeup(App *app, int fd, void *) {
+    alignas(struct inotify_event) char buffer[16 * 1024];
+    bool any = false;
+    while (true) {
+        ssize_t length = read(fd, buffer, sizeof(buffer));
+        if (length <= 0)
+            break;
+        for (char *p = buffer; p < buffer + length;) {
+            auto event = (const struct inotify_event *) p;
+            handle_event(event);
+            p += sizeof(struct inotify_event) + event->len;
+        }
+        any = true;
+    }
+    if (!any)
+        return;
+
+    // Re-arm on every burst, but don't let a long copy hold everything back forever
+    long now = get_current_time_in_ms();
+    if (!watcher->debounce) {
+        watcher->first_pending = now;
+        watcher->debounce = app_timeout_create(app, watcher->client, DEBOUNCE_MS, debounce_timeout, nullptr,
+                                               "library_watcher_debounce");
+    } else if (now - watcher->first_pending < MAX_DEBOUNCE_MS) {
+        watcher->debounce = app_timeout_replace(app, watcher->client, watcher->debounce, DEBOUNCE_MS,
+                                                debounce_timeout, nullptr);
+    }
+}
+
+static void results_wakeup(App *app, int fd, void *) {
+    uint64_t count;
+    read(fd, &count, sizeof(count));
+
+    std::vector<Option> changed;
+    std::vector<std::string> removed;
+    {
+        std::lock_guard<std::mutex> guard(watcher->mutex);
+        changed.swap(watcher->changed);
+        removed.swap(watcher->removed);
+    }
+    if (!changed.empty() || !removed.empty()) {
+        auto changes = catalog_apply_changes(changed, removed);
+        library_apply_changes(changed, removed);
+        songs_tab_apply_changes(watcher->client, changes);
+        album_tab_apply_changes(watcher->client, changes);
+        artist_tab_apply_changes(watcher->client, changes);
+        playlist_tab_apply_changes(watcher->client, changes);
+    }
+    library_checkpoint(watcher->cache_path);
+    // Albums that showed up get their art once the scan is through (or right away, for the watcher's changes)
+    watcher->songs_since_art |= !changed.empty();
+    if (!library_scan_progress().running) {
+        if (watcher->songs_since_art)
+            update_album_art();
+        watcher->songs_since_art = false;
+        request_refresh(app, watcher->client); // Takes the scan progress down
+    }
+}
+
+void start_library_watcher(App *app, AppClient *client, std::string cache_path, std::string root) {
+    if (watcher)
+        return;
+    int results_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (results_fd == -1)
+        return;
+
+    watcher = new LibraryWatcher;
+    watcher->app = app;
+    watcher->client = client;
+    watcher->cache_path = cache_path;
+    watcher->root = root;
+    watcher->results_fd = results_fd;
+    poll_descriptor(app, results_fd, EPOLLIN, results_wakeup, nullptr, "library_watcher_results");
+
+    // Without inotify the library still fills in from scans, it just won't notice changes until the next start
+    int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd == -1) {
+        rt_log(RT_WARNING, "Library watcher: inotify_init1 failed (%s)", strerror(errno));
+        return;
+    }
+    watcher->inotify_fd = inotify_fd;
+    poll_descriptor(app, inotify_fd, EPOLLIN, inotify_wakeup, nullptr, "library_watcher_inotify");
+
+    std::thread t(watcher_thread);
+    t.detach();
+}
@@ -0,0 +1,18 @@
+/* date = October 19th 2026 2:05 pm */
+
+#ifndef WATCHER_H
+#define WATCHER_H
+
+#include "application.h"
+#include "main.h"
+#include <string>
+#include <vector>
+
+// Watches 'root' (and every directory under it) through inotify, and hands songs that are added, changed or
+// removed to the songs and album tabs without rebuilding them
+void start_library_watcher(App *app, AppClient *client, std::string cache_path, std::string root);
+
+// Queues songs for the tabs from any thread (the scan uses this too); they're applied on the main loop
+void post_library_changes(const std::vector<Option> &changed, const std::vector<std::string> &removed);
+
+#endif //WATCHER_H
@@ -0,0 +1,297 @@
+
+// Times the library code end to end against a music directory (see lfp_gen_library for making a big one):
+// the first scan, a rescan with nothing changed, loading the cache (straight into tracks), the songs tab
+// sort, loading the catalog (and its search index and facets), recounting the facets, sorting by columns, search
+// keystrokes, importing a big playlist, and how many songs a search goes through per second. The report on stdout is
+// JSON with one key per line in a fixed order, so two of them diff cleanly between commits. The log (scan stats, per
+// device I/O) goes to stderr.
+//
+//   lfp_bench_library <music directory> [--runs N] [--query text] [--cache path]
+
+#include "catalog.h"
+#include "facets.h"
+#include "library.h"
+#include "playlists.h"
+#include "search.h"
+#include "song_sort.h"
+#include "rt_log.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static double milliseconds_since(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Median of 'runs' timings of 'work'
+static double median_ms(int runs, const std::function<void()> &work) {
+    std::vector<double> times;
+    for (int i = 0; i < runs; i++) {
+        auto start = std::chrono::steady_clock::now();
+        work();
+        times.push_back(milliseconds_since(start));
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// What the scan thread handed over, put into the catalog once the scan is done (what the watcher's main thread
+// wakeup does as it goes)
+static std::mutex batches_mutex;
+static std::vector<Option> scanned_changed;
+static std::vector<std::string> scanned_removed;
+
+static void collect_batch(const std::vector<Option> &changed, const std::vector<std::string> &removed) {
+    std::lock_guard<std::mutex> guard(batches_mutex);
+    scanned_changed.insert(scanned_changed.end(), changed.begin(), changed.end());
+    scanned_removed.insert(scanned_removed.end(), removed.begin(), removed.end());
+}
+
+struct ScanResult {
+    double ms;
+    TagIoStats io;
+};
+
+static ScanResult timed_scan(const std::string &cache_path, const std::string &root) {
+    auto before = tag_io_stats();
+    auto start = std::chrono::steady_clock::now();
+    scan_library(root, collect_batch);
+    while (library_scan_progress().running)
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    ScanResult result;
+    result.ms = milliseconds_since(start);
+    {
+        std::lock_guard<std::mutex> guard(batches_mutex);
+        catalog_apply_changes(scanned_changed, scanned_removed);
+        library_apply_changes(scanned_changed, scanned_removed);
+        scanned_changed.clear();
+        scanned_removed.clear();
+    }
+    library_save(cache_path);
+    auto after = tag_io_stats();
+    result.io = {after.opens - before.opens, after.reads - before.reads, after.seeks - before.seeks,
+                 after.bytes - before.bytes};
+    return result;
+}
+
+// 'text' as the inside of a JSON string
+static std::string json_escape(const std::string &text) {
+    std::string escaped;
+    for (char c: text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char) c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static void print_usage(FILE *out, const char *program) {
+    fprintf(out, "usage: %s <music directory> [--runs N] [--query text] [--cache path]\n", program);
+}
+
+int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
+            print_usage(stdout, argv[0]);
+            return 0;
+        }
+    }
+    if (argc < 2) {
+        print_usage(stderr, argv[0]);
+        return 1;
+    }
+    std::string root = argv[1];
+    int runs = 5;
+    std::string query = "love";
+    std::string cache_path = "/tmp/lfp_bench_" + std::to_string(getpid()) + ".cache";
+    for (int i = 2; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--runs") == 0)
+            runs = std::max(1, std::atoi(argv[i + 1]));
+        else if (strcmp(argv[i], "--query") == 0)
+            query = argv[i + 1];
+        else if (strcmp(argv[i], "--cache") == 0)
+            cache_path = argv[i + 1];
+    }
+    rt_log_start("");
+    unlink(cache_path.c_str());
+
+    auto scan = timed_scan(cache_path, root);
+    auto rescan = timed_scan(cache_path, root);
+    struct stat cache_stat{};
+    stat(cache_path.c_str(), &cache_stat);
+
+    std::vector<Track> tracks;
+    std::vector<SongStamp> stamps;
+    std::vector<AlbumEntry> index;
+    double load_ms = median_ms(runs, [&] {
+        tracks.clear();
+        stamps.clear();
+        index.clear();
+        load_from_cache(cache_path, tracks, stamps, &index);
+    });
+
+    // What songs_tab_apply_changes does with a big batch (at startup the album index already has this order)
+    std::vector<Track> sorted;
+    double sort_ms = median_ms(runs, [&] {
+        sorted = tracks;
+        std::sort(sorted.begin(), sorted.end(), comes_before);
+    });
+
+    // The catalog everything looks songs and albums up in, loaded from the cache's album index
+    double catalog_ms = median_ms(runs, [&] {
+        catalog_load(tracks, index);
+    });
+    set_cached_songs(stamps);
+    size_t album_count = catalog_album_count();
+
+    // What a click in the facet sidebar costs: with the biggest genre picked, picking (then dropping) the biggest
+    // decade and counting every facet again
+    double facet_counts_us = 0;
+    auto genres = facet_values(FACET_GENRE, FACET_SIDEBAR_VALUES);
+    auto decades = facet_values(FACET_DECADE, FACET_SIDEBAR_VALUES);
+    if (!genres.empty() && !decades.empty()) {
+        auto biggest = std::max_element(decades.begin(), decades.end(), [](const FacetValue &a, const FacetValue &b) {
+            return a.count < b.count;
+        });
+        facet_toggle(FACET_GENRE, genres[0].key);
+        facet_counts_us = 1000 * median_ms(runs, [&] {
+            for (int twice = 0; twice < 2; twice++) {
+                facet_toggle(FACET_DECADE, biggest->key);
+                for (int f = 0; f < FACET_COUNT; f++)
+                    facet_values((Facet) f, FACET_SIDEBAR_VALUES);
+            }
+        }) / 2;
+        facet_clear_selection();
+    }
+
+    // Clicking the Artist header, then shift clicking Year twice (artist, then newest first), on every song
+    std::vector<TrackId> ids;
+    for (TrackId id = 0; id < catalog_track_count(); id++)
+        if (catalog_album_of(id) != NO_ALBUM)
+            ids.push_back(id);
+    std::vector<SortKey> sort_keys(2);
+    sort_keys[0].column = SORT_ARTIST;
+    sort_keys[1].column = SORT_YEAR;
+    sort_keys[1].descending = true;
+    double column_sort_ms = median_ms(runs, [&] {
+        sort_permutation(ids, sort_keys);
+    });
+
+    // Typing the query one letter at a time, every keystroke searching the whole catalog
+    size_t matches = 0;
+    double filter_ms = median_ms(runs, [&] {
+        for (size_t length = 1; length <= query.size(); length++)
+            matches = search_library(query.substr(0, length)).size();
+    }) / std::max<size_t>(1, query.size());
+
+    // The same, but the way the search thread does it: every keystroke only re-filters the last one's hits
+    double narrowed_ms = median_ms(runs, [&] {
+        std::vector<SearchHit> hits;
+        std::vector<TrackId> last;
+        SearchRun run;
+        for (size_t length = 1; length <= query.size(); length++) {
+            run.within = length > 1 ? &last : nullptr;
+            run.within_version = run.version;
+            search_library_run(query.substr(0, length), &run, &hits);
+            last.clear();
+            for (auto &hit: hits)
+                last.push_back(hit.id);
+            std::sort(last.begin(), last.end());
+        }
+    }) / std::max<size_t>(1, query.size());
+
+    // Importing a 50,000 entry M3U of the library's songs (in no particular order, most of them more than once)
+    std::string playlist_path = cache_path + ".m3u";
+    if (FILE *file = fopen(playlist_path.c_str(), "w")) {
+        char cwd[PATH_MAX] = "";
+        getcwd(cwd, sizeof(cwd));
+        fprintf(file, "#EXTM3U\n");
+        for (size_t i = 0; i < 50000 && !ids.empty(); i++) {
+            auto &track = catalog_track(ids[i * 7919 % ids.size()]);
+            auto path = pool_view(track.path);
+            fprintf(file, "#EXTINF:%u,%s - %s\n%s%s%s\n", track.length, pool_cstr(track.artist), pool_cstr(track.title),
+                    path[0] == '/' ? "" : cwd, path[0] == '/' ? "" : "/", path.data());
+        }
+        fclose(file);
+    }
+    size_t playlist_unresolved = 0;
+    double playlist_import_ms = median_ms(runs, [&] {
+        playlist_unresolved = playlist(import_playlist(playlist_path)).unresolved.size();
+    });
+    unlink(playlist_path.c_str());
+
+    // Rows per second when every song is looked at (the index turned off), with and without the character mask
+    // prefilter, for a 1, 3 and 8 character query
+    const char *scan_queries[] = {"o", "ren", "lorenika"};
+    double rows_per_sec[3][2];
+    for (int q = 0; q < 3; q++) {
+        for (int prefilter = 0; prefilter < 2; prefilter++) {
+            double ms = median_ms(runs, [&] {
+                std::vector<SearchHit> hits;
+                SearchRun run;
+                run.use_index = false;
+                run.use_prefilter = prefilter;
+                search_library_run(scan_queries[q], &run, &hits);
+            });
+            rows_per_sec[q][prefilter] = tracks.size() / std::max(ms / 1000, 1e-9);
+        }
+    }
+
+    struct rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    size_t pool_strings, pool_bytes;
+    pool_stats(&pool_strings, &pool_bytes);
+    rt_log_flush();
+    unlink(cache_path.c_str());
+
+    printf("{\n");
+    printf("  \"songs\": %zu,\n", tracks.size());
+    printf("  \"albums\": %zu,\n", album_count);
+    printf("  \"scan_ms\": %.1f,\n", scan.ms);
+    printf("  \"scan_opens\": %ld,\n", scan.io.opens);
+    printf("  \"scan_reads\": %ld,\n", scan.io.reads);
+    printf("  \"scan_seeks\": %ld,\n", scan.io.seeks);
+    printf("  \"scan_bytes_read\": %ld,\n", scan.io.bytes);
+    printf("  \"rescan_ms\": %.1f,\n", rescan.ms);
+    printf("  \"rescan_opens\": %ld,\n", rescan.io.opens);
+    printf("  \"cache_bytes\": %ld,\n", (long) cache_stat.st_size);
+    printf("  \"load_ms\": %.2f,\n", load_ms);
+    printf("  \"sort_ms\": %.2f,\n", sort_ms);
+    printf("  \"catalog_ms\": %.2f,\n", catalog_ms);
+    printf("  \"column_sort_ms\": %.2f,\n", column_sort_ms);
+    printf("  \"facet_counts_us\": %.1f,\n", facet_counts_us);
+    printf("  \"filter_query\": \"%s\",\n", json_escape(query).c_str());
+    printf("  \"filter_keystroke_ms\": %.3f,\n", filter_ms);
+    printf("  \"filter_matches\": %zu,\n", matches);
+    printf("  \"filter_narrowed_keystroke_ms\": %.3f,\n", narrowed_ms);
+    printf("  \"playlist_import_ms\": %.2f,\n", playlist_import_ms);
+    printf("  \"playlist_unresolved\": %zu,\n", playlist_unresolved);
+    for (int q = 0; q < 3; q++) {
+        size_t length = strlen(scan_queries[q]);
+        printf("  \"scan_rows_per_sec_%zu\": %.0f,\n", length, rows_per_sec[q][1]);
+        printf("  \"scan_rows_per_sec_%zu_no_prefilter\": %.0f,\n", length, rows_per_sec[q][0]);
+    }
+    printf("  \"pool_strings\": %zu,\n", pool_strings);
+    printf("  \"pool_bytes\": %zu,\n", pool_bytes);
+    printf("  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+    printf("  \"runs\": %d\n", runs);
+    printf("}\n");
+    return 0;
+}
@@ -0,0 +1,545 @@
+
+// Writes a synthetic music library: tiny files (a few frames of silence, or none) that TagLib reads like real ones,
+// with artists, albums, discs, compilations, loose songs, missing tags, non-ASCII names and cover art spread
+// about like a real collection. The same seed always gives the same library.
+//
+//   lfp_gen_library <directory> <number of songs> [--seed N] [--formats mp3,flac,m4a,ogg]
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+
+#include "stb_image_write.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+#include <taglib/fileref.h>
+#include <taglib/tpropertymap.h>
+#include <taglib/mpegfile.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/attachedpictureframe.h>
+#include <taglib/flacfile.h>
+#include <taglib/flacpicture.h>
+#include <taglib/mp4file.h>
+#include <taglib/mp4coverart.h>
+#include <taglib/vorbisfile.h>
+#include <taglib/xiphcomment.h>
+
+static std::mt19937 rng;
+
+static int uniform(int low, int high) {
+    return std::uniform_int_distribution<int>(low, high)(rng);
+}
+
+static bool chance(double p) {
+    return std::uniform_real_distribution<double>(0, 1)(rng) < p;
+}
+
+static void put_u32_be(std::string &s, uint32_t v) {
+    for (int shift = 24; shift >= 0; shift -= 8)
+        s.push_back((char) (v >> shift));
+}
+
+static void put_u16_be(std::string &s, uint16_t v) {
+    s.push_back((char) (v >> 8));
+    s.push_back((char) v);
+}
+
+static void put_u32_le(std::string &s, uint32_t v) {
+    for (int shift = 0; shift <= 24; shift += 8)
+        s.push_back((char) (v >> shift));
+}
+
+static void put_u64_le(std::string &s, uint64_t v) {
+    for (int shift = 0; shift <= 56; shift += 8)
+        s.push_back((char) (v >> shift));
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// Untagged skeletons (TagLib only edits files that already exist)
+
+// MPEG-1 layer III, 128 kbps, 44.1 kHz, stereo: a Xing frame saying how long it "is", then a couple of empty frames
+static std::string mp3_skeleton(int seconds) {
+    const int frame_length = 417;
+    uint32_t frames = seconds * 44100 / 1152;
+    std::string data;
+    for (int i = 0; i < 3; i++) {
+        std::string frame = "\xFF\xFB\x90\x00";
+        frame.resize(frame_length, '\0');
+        if (i == 0) {
+            std::string xing = "Xing";
+            put_u32_be(xing, 0x3); // frames and bytes
+            put_u32_be(xing, frames);
+            put_u32_be(xing, frames * frame_length);
+            frame.replace(4 + 32, xing.size(), xing);
+        }
+        data += frame;
+    }
+    return data;
+}
+
+// Just STREAMINFO, with the sample count giving the length
+static std::string flac_skeleton(int seconds) {
+    std::string info;
+    put_u16_be(info, 4096);
+    put_u16_be(info, 4096);
+    info.append(6, '\0'); // frame sizes unknown
+    uint64_t samples = (uint64_t) seconds * 44100;
+    uint64_t packed = (44100ull << 44) | (1ull << 41) | (15ull << 36) | samples;
+    for (int shift = 56; shift >= 0; shift -= 8)
+        info.push_back((char) (packed >> shift));
+    info.append(16, '\0'); // md5
+    std::string data = "fLaC";
+    data.push_back((char) 0x80); // last block, STREAMINFO
+    data.push_back(0);
+    put_u16_be(data, info.size());
+    return data + info;
+}
+
+static std::string box(const char *type, const std::string &payload) {
+    std::string b;
+    put_u32_be(b, payload.size() + 8);
+    b += std::string(type, 4) + payload;
+    return b;
+}
+
+static std::string full_box(const char *type, uint32_t flags, const std::string &payload) {
+    std::string b;
+    put_u32_be(b, flags); // version 0
+    return box(type, b + payload);
+}
+
+static std::string unity_matrix() {
+    std::string m;
+    uint32_t values[9] = {0x10000, 0, 0, 0, 0x10000, 0, 0, 0, 0x40000000};
+    for (auto v: values)
+        put_u32_be(m, v);
+    return m;
+}
+
+// One AAC track with no samples: enough atoms for TagLib to find the length and add 'udta' to
+static std::string m4a_skeleton(int seconds) {
+    std::string mvhd;
+    put_u32_be(mvhd, 0);
+    put_u32_be(mvhd, 0);
+    put_u32_be(mvhd, 1000);
+    put_u32_be(mvhd, seconds * 1000);
+    put_u32_be(mvhd, 0x10000); // rate
+    put_u16_be(mvhd, 0x100); // volume
+    mvhd.append(10, '\0');
+    mvhd += unity_matrix();
+    mvhd.append(24, '\0');
+    put_u32_be(mvhd, 2); // next track
+
+    std::string tkhd;
+    put_u32_be(tkhd, 0);
+    put_u32_be(tkhd, 0);
+    put_u32_be(tkhd, 1); // track id
+    put_u32_be(tkhd, 0);
+    put_u32_be(tkhd, seconds * 1000);
+    tkhd.append(8, '\0');
+    put_u16_be(tkhd, 0);
+    put_u16_be(tkhd, 0);
+    put_u16_be(tkhd, 0x100);
+    put_u16_be(tkhd, 0);
+    tkhd += unity_matrix();
+    put_u32_be(tkhd, 0);
+    put_u32_be(tkhd, 0);
+
+    std::string mdhd;
+    put_u32_be(mdhd, 0);
+    put_u32_be(mdhd, 0);
+    put_u32_be(mdhd, 44100);
+    put_u32_be(mdhd, seconds * 44100);
+    put_u16_be(mdhd, 0x55c4); // "und"
+    put_u16_be(mdhd, 0);
+
+    std::string hdlr;
+    put_u32_be(hdlr, 0);
+    hdlr += "soun";
+    hdlr.append(12, '\0');
+    hdlr.push_back('\0');
+
+    std::string mp4a;
+    mp4a.append(6, '\0');
+    put_u16_be(mp4a, 1); // data reference
+    mp4a.append(8, '\0');
+    put_u16_be(mp4a, 2); // channels
+    put_u16_be(mp4a, 16); // bits
+    put_u16_be(mp4a, 0);
+    put_u16_be(mp4a, 0);
+    put_u32_be(mp4a, 44100u << 16);
+    std::string stsd;
+    put_u32_be(stsd, 1);
+    stsd += box("mp4a", mp4a);
+
+    std::string empty_table;
+    put_u32_be(empty_table, 0);
+    std::string stsz;
+    put_u32_be(stsz, 0);
+    put_u32_be(stsz, 0);
+    std::string stbl = full_box("stsd", 0, stsd) + full_box("stts", 0, empty_table) + full_box("stsc", 0, empty_table) +
+                       full_box("stsz", 0, stsz) + full_box("stco", 0, empty_table);
+    std::string dref;
+    put_u32_be(dref, 1);
+    dref += full_box("url ", 1, "");
+    std::string smhd;
+    put_u32_be(smhd, 0);
+    std::string minf = full_box("smhd", 0, smhd) + box("dinf", full_box("dref", 0, dref)) + box("stbl", stbl);
+    std::string mdia = full_box("mdhd", 0, mdhd) + full_box("hdlr", 0, hdlr) + box("minf", minf);
+    std::string trak = full_box("tkhd", 7, tkhd) + box("mdia", mdia);
+
+    std::string ftyp = "M4A ";
+    put_u32_be(ftyp, 0);
+    ftyp += "M4A mp42isom";
+    return box("ftyp", ftyp) + box("moov", full_box("mvhd", 0, mvhd) + box("trak", trak)) + box("mdat", "");
+}
+
+static uint32_t ogg_crc(const std::string &page) {
+    static uint32_t table[256];
+    if (!table[1]) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t r = i << 24;
+            for (int j = 0; j < 8; j++)
+                r = (r & 0x80000000) ? (r << 1) ^ 0x04c11db7 : r << 1;
+            table[i] = r;
+        }
+    }
+    uint32_t crc = 0;
+    for (unsigned char c: page)
+        crc = (crc << 8) ^ table[((crc >> 24) & 0xff) ^ c];
+    return crc;
+}
+
+static std::string ogg_page(int type, uint64_t granule, uint32_t sequence, const std::vector<std::string> &packets) {
+    std::string lacing;
+    std::string body;
+    for (auto &p: packets) {
+        size_t left = p.size();
+        while (left >= 255) {
+            lacing.push_back((char) 255);
+            left -= 255;
+        }
+        lacing.push_back((char) left);
+        body += p;
+    }
+    std::string page = "OggS";
+    page.push_back(0);
+    page.push_back((char) type);
+    put_u64_le(page, granule);
+    put_u32_le(page, 0x4c465031); // serial
+    put_u32_le(page, sequence);
+    put_u32_le(page, 0); // crc, filled in below
+    page.push_back((char) lacing.size());
+    page += lacing + body;
+    uint32_t crc = ogg_crc(page);
+    for (int i = 0; i < 4; i++)
+        page[22 + i] = (char) (crc >> (i * 8));
+    return page;
+}
+
+// Vorbis headers (the setup one is a stand-in, nothing decodes these) and one audio page for the length
+static std::string ogg_skeleton(int seconds) {
+    std::string identification = "\x01vorbis";
+    put_u32_le(identification, 0);
+    identification.push_back(2);
+    put_u32_le(identification, 44100);
+    put_u32_le(identification, 0);
+    put_u32_le(identification, 128000);
+    put_u32_le(identification, 0);
+    identification.push_back((char) 0xb8);
+    identification.push_back(1);
+
+    std::string comment = "\x03vorbis";
+    put_u32_le(comment, 3);
+    comment += "lfp";
+    put_u32_le(comment, 0);
+    comment.push_back(1);
+
+    std::string setup = "\x05vorbis";
+    setup.append(32, '\0');
+
+    return ogg_page(0x02, 0, 0, {identification}) + ogg_page(0, 0, 1, {comment, setup}) +
+           ogg_page(0x04, (uint64_t) seconds * 44100, 2, {std::string(16, '\0')});
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// Names
+
+static const char *syllables[] = {"ka", "lo", "mi", "ren", "sa", "to", "vel", "dor", "an", "ni", "ze", "ro", "mar",
+                                  "qu", "is", "el", "ba", "tor", "lu", "fen", "gra", "ve", "o", "shi", "na", "bri"};
+static const char *accented[] = {"é", "ø", "ß", "ü", "ñ", "å", "ç"};
+static const char *foreign[] = {"日本", "Жизнь", "Ελλάδα", "서울", "Café", "Ölmez", "Über", "Šťastný"};
+static const char *genres[] = {"Rock", "Pop", "Jazz", "Electronic", "Classical", "Hip-Hop", "Metal", "Folk",
+                               "Soundtrack", "Ambient", "Blues", "Country", "Reggae", "Soul", "Punk"};
+
+static std::string word() {
+    std::string w;
+    int parts = uniform(1, 3);
+    for (int i = 0; i < parts; i++)
+        w += syllables[uniform(0, sizeof(syllables) / sizeof(*syllables) - 1)];
+    if (chance(0.05))
+        w += accented[uniform(0, sizeof(accented) / sizeof(*accented) - 1)];
+    w[0] = std::toupper((unsigned char) w[0]);
+    return w;
+}
+
+static std::string name(int min_words, int max_words) {
+    if (chance(0.04))
+        return foreign[uniform(0, sizeof(foreign) / sizeof(*foreign) - 1)];
+    std::string n;
+    int words = uniform(min_words, max_words);
+    for (int i = 0; i < words; i++)
+        n += (i ? " " : "") + word();
+    return n;
+}
+
+// Most genres are rare, a few are everywhere
+static std::string genre() {
+    int count = sizeof(genres) / sizeof(*genres);
+    int i = std::min(count - 1, (int) std::geometric_distribution<int>(0.3)(rng));
+    return genres[i];
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+// Cover art
+
+static void append_to_string(void *context, void *data, int size) {
+    ((std::string *) context)->append((const char *) data, size);
+}
+
+// A gradient JPEG (so it doesn't compress to nothing), or empty for albums without art
+static std::string cover_art() {
+    int sizes[] = {0, 0, 0, 0, 0, 0, 0, 300, 300, 300, 300, 300, 300, 300, 300, 600, 600, 600, 600, 1400};
+    int size = sizes[uniform(0, sizeof(sizes) / sizeof(*sizes) - 1)];
+    if (size == 0)
+        return "";
+    std::vector<unsigned char> pixels(size * size * 3);
+    int r = uniform(0, 255), g = uniform(0, 255), b = uniform(0, 255);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            auto p = &pixels[(y * size + x) * 3];
+            p[0] = (r + x) & 0xff;
+            p[1] = (g + y) & 0xff;
+            p[2] = (b + ((x ^ y) & 0x3f)) & 0xff;
+        }
+    }
+    std::string jpeg;
+    stbi_write_jpg_to_func(append_to_string, &jpeg, size, size, 3, pixels.data(), 85);
+    return jpeg;
+}
+
+// ------------------------------------------------------------------------------------------------------------------
+
+struct Song {
+    std::string path;
+    std::string format;
+    std::string title;
+    std::string artist;
+    std::string album; // empty for loose songs
+    std::string genre;
+    int year = 0;
+    int track = 0;
+    int tracks = 0;
+    int disc = 0;
+    int discs = 0;
+    int seconds = 0;
+    const std::string *art = nullptr;
+};
+
+static std::string safe_file_name(std::string s) {
+    for (auto &c: s)
+        if (c == '/')
+            c = '_';
+    return s.empty() ? "_" : s;
+}
+
+static bool write_song(const Song &s) {
+    std::string skeleton;
+    if (s.format == "mp3")
+        skeleton = mp3_skeleton(s.seconds);
+    else if (s.format == "flac")
+        skeleton = flac_skeleton(s.seconds);
+    else if (s.format == "m4a")
+        skeleton = m4a_skeleton(s.seconds);
+    else
+        skeleton = ogg_skeleton(s.seconds);
+    {
+        std::ofstream out(s.path, std::ios::binary);
+        out.write(skeleton.data(), skeleton.size());
+        if (!out)
+            return false;
+    }
+
+    TagLib::PropertyMap properties;
+    auto set = [&properties](const char *key, const std::string &value) {
+        if (!value.empty())
+            properties[key] = TagLib::StringList(TagLib::String(value, TagLib::String::UTF8));
+    };
+    set("TITLE", s.title);
+    set("ARTIST", s.artist);
+    set("ALBUM", s.album);
+    set("GENRE", s.genre);
+    if (s.year)
+        set("DATE", std::to_string(s.year));
+    if (s.track)
+        set("TRACKNUMBER", std::to_string(s.track) + "/" + std::to_string(s.tracks));
+    if (s.disc)
+        set("DISCNUMBER", std::to_string(s.disc) + "/" + std::to_string(s.discs));
+
+    bool has_art = s.art && !s.art->empty();
+    TagLib::ByteVector art = has_art ? TagLib::ByteVector(s.art->data(), s.art->size()) : TagLib::ByteVector();
+    auto flac_picture = [&art] {
+        auto picture = new TagLib::FLAC::Picture;
+        picture->setType(TagLib::FLAC::Picture::FrontCover);
+        picture->setMimeType("image/jpeg");
+        picture->setData(art);
+        return picture;
+    };
+
+    if (s.format == "mp3") {
+        TagLib::MPEG::File file(s.path.c_str());
+        if (!file.isValid())
+            return false;
+        file.ID3v2Tag(true)->setProperties(properties);
+        if (has_art) {
+            auto frame = new TagLib::ID3v2::AttachedPictureFrame;
+            frame->setType(TagLib::ID3v2::AttachedPictureFrame::FrontCover);
+            frame->setMimeType("image/jpeg");
+            frame->setPicture(art);
+            file.ID3v2Tag()->addFrame(frame);
+        }
+        return file.save(TagLib::MPEG::File::ID3v2, TagLib::File::StripOthers);
+    } else if (s.format == "flac") {
+        TagLib::FLAC::File file(s.path.c_str());
+        if (!file.isValid())
+            return false;
+        file.xiphComment(true)->setProperties(properties);
+        if (has_art)
+            file.addPicture(flac_picture());
+        return file.save();
+    } else if (s.format == "m4a") {
+        TagLib::MP4::File file(s.path.c_str());
+        if (!file.isValid())
+            return false;
+        file.tag()->setProperties(properties);
+        if (has_art) {
+            TagLib::MP4::CoverArtList covers;
+            covers.append(TagLib::MP4::CoverArt(TagLib::MP4::CoverArt::JPEG, art));
+            file.tag()->setItem("covr", covers);
+        }
+        return file.save();
+    } else {
+        TagLib::Ogg::Vorbis::File file(s.path.c_str());
+        if (!file.isValid())
+            return false;
+        file.tag()->setProperties(properties);
+        if (has_art)
+            file.tag()->addPicture(flac_picture());
+        return file.save();
+    }
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        fprintf(stderr, "usage: %s <directory> <number of songs> [--seed N] [--formats mp3,flac,m4a,ogg]\n", argv[0]);
+        return 1;
+    }
+    std::string root = argv[1];
+    long count = std::atol(argv[2]);
+    unsigned int seed = 1;
+    std::vector<std::string> formats = {"mp3", "mp3", "mp3", "mp3", "flac", "flac", "flac", "m4a", "m4a", "ogg"};
+    for (int i = 3; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--seed") == 0) {
+            seed = std::atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--formats") == 0) {
+            formats.clear();
+            std::string list = argv[i + 1];
+            size_t start = 0;
+            while (start <= list.size()) {
+                size_t comma = list.find(',', start);
+                if (comma == std::string::npos)
+                    comma = list.size();
+                std::string format = list.substr(start, comma - start);
+                if (format == "mp3" || format == "flac" || format == "m4a" || format == "ogg")
+                    formats.push_back(format);
+                start = comma + 1;
+            }
+            if (formats.empty()) {
+                fprintf(stderr, "No known formats in '%s'\n", argv[i + 1]);
+                return 1;
+            }
+        }
+    }
+    rng.seed(seed);
+
+    long written = 0, failed = 0;
+    std::map<std::string, long> per_format;
+    std::vector<std::string> compilation_artists;
+    while (written + failed < count) {
+        // Artists have a handful of albums, a few have lots
+        std::string artist = name(1, 3);
+        std::string artist_directory = root + "/" + safe_file_name(artist);
+        std::filesystem::create_directories(artist_directory);
+        compilation_artists.push_back(artist);
+        int albums = std::min(15, 1 + (int) std::geometric_distribution<int>(0.45)(rng));
+        std::string artist_genre = genre();
+
+        for (int a = 0; a < albums && written + failed < count; a++) {
+            bool loose = chance(0.03); // songs that never had an album
+            bool compilation = !loose && compilation_artists.size() > 10 && chance(0.05);
+            std::string album = loose ? "" : name(1, 4);
+            if (compilation)
+                album += " (Various Artists)";
+            int discs = chance(0.12) ? (chance(0.15) ? 3 : 2) : 1;
+            int tracks = loose ? uniform(1, 4) : uniform(8, 16);
+            int year = uniform(1960, 2025);
+            std::string art = loose ? "" : cover_art();
+            std::string format = formats[uniform(0, formats.size() - 1)];
+            std::string directory = loose ? artist_directory : artist_directory + "/" + safe_file_name(album);
+            std::filesystem::create_directories(directory);
+
+            for (int disc = 1; disc <= discs; disc++) {
+                for (int t = 1; t <= tracks && written + failed < count; t++) {
+                    Song s;
+                    s.format = format;
+                    s.title = chance(0.02) ? "" : name(1, 5);
+                    s.artist = compilation ? compilation_artists[uniform(0, compilation_artists.size() - 1)] : artist;
+                    s.album = album;
+                    s.genre = chance(0.05) ? "" : (chance(0.8) ? artist_genre : genre());
+                    s.year = chance(0.1) ? 0 : year;
+                    s.track = chance(0.03) ? 0 : t;
+                    s.tracks = tracks;
+                    s.disc = discs > 1 || chance(0.5) ? disc : 0;
+                    s.discs = discs;
+                    s.seconds = uniform(90, 420);
+                    s.art = &art;
+                    char prefix[16];
+                    snprintf(prefix, sizeof(prefix), discs > 1 ? "%d-%02d " : "%02d ", discs > 1 ? disc : t, t);
+                    s.path = directory + "/" + prefix + safe_file_name(s.title.empty() ? "Untitled" : s.title) +
+                             "." + format;
+                    if (write_song(s)) {
+                        written++;
+                        per_format[format]++;
+                    } else {
+                        fprintf(stderr, "Couldn't write %s\n", s.path.c_str());
+                        failed++;
+                    }
+                }
+            }
+        }
+    }
+
+    printf("Wrote %ld songs to %s (", written, root.c_str());
+    bool first = true;
+    for (auto &f: per_format) {
+        printf("%s%ld %s", first ? "" : ", ", f.second, f.first.c_str());
+        first = false;
+    }
+    printf(")\n");
+    return failed ? 1 : 0;
+}